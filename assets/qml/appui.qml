@@ -20,19 +20,50 @@ Item {
             id: downstream
             objectName: "downstreamGraph"
             model: downstreamData
+            samplePeriod: updatePeriod
 
             color: "#ff9900"
             Layout.fillWidth: true
             Layout.fillHeight: true
         }
+        HeatmapGraph {
+            id: downstreamHeatmap
+            model: downstreamData
+            upperBound: downstream.upperBound
+            // the columns span 30 days, at 2.5 s per sample each one covers about 42 min
+            samplesPerColumn: Math.ceil(30 * 24 * 3600 * 1000 / (updatePeriod * columns))
+
+            color: downstream.color
+            Layout.fillWidth: true
+            Layout.preferredHeight: parent.height / 4
+        }
         Graph {
             id: upstream
             objectName: "upstreamGraph"
             model: upstreamData
+            samplePeriod: updatePeriod
 
             color: "#9900ff"
             Layout.fillWidth: true
             Layout.fillHeight: true
         }
     }
+
+    // visible time span, zooming and panning applies to each graph separately
+    function describeSpan(graph) {
+        var samples = graph.visibleSamples > 1 ? graph.visibleSamples : graph.model.count;
+        var seconds = Math.round(samples * graph.samplePeriod / 1000);
+        var text = seconds >= 120 ? Math.round(seconds / 60) + " min" : seconds + " s";
+
+        return graph.viewOffset > 0 ? text + " (paused)" : text;
+    }
+
+    Text {
+        anchors.right: parent.right
+        anchors.bottom: parent.bottom
+        anchors.margins: 4
+        color: "#a0a0a0"
+        font.pixelSize: 11
+        text: describeSpan(downstream) + " / " + describeSpan(upstream)
+    }
 }
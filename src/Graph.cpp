@@ -40,21 +40,63 @@
 
 #include "Graph.hpp"
 
+#include "GraphModel.hpp"
+#include "ShaderCache.hpp"
+
 #include <QtCore/QDebug>
 #include <QtCore/QRectF>
 
+#include <QtGui/QFont>
+#include <QtGui/QFontMetrics>
+#include <QtGui/QImage>
+#include <QtGui/QMouseEvent>
+#include <QtGui/QPainter>
+#include <QtGui/QPolygonF>
+#include <QtGui/QTouchEvent>
+#include <QtGui/QWheelEvent>
+
 #include <QtQuick/QQuickWindow>
+#include <QtQuick/QSGFlatColorMaterial>
 #include <QtQuick/QSGGeometry>
 #include <QtQuick/QSGGeometryNode>
 #include <QtQuick/QSGNode>
 #include <QtQuick/QSGSimpleMaterial>
+#include <QtQuick/QSGSimpleTextureNode>
 #include <QtQuick/QSGTexture>
-
+#include <QtQuick/QSGTextureMaterial>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+#include <QtQuick/QSGRendererInterface>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <memory>
 #include <vector>
 
 namespace fritzmon {
 
+// shaders
+
+static const char *const NOISY_ATTRIBUTES[] = { "aVertex", "aTexCoord", nullptr };
+static const char *const LINE_ATTRIBUTES[] = { "pos", "t", nullptr };
+static const ShaderCache::Program NOISY_PROGRAM = {
+    ":/fritzmon/shaders/noisy.vsh", ":/fritzmon/shaders/noisy.fsh", NOISY_ATTRIBUTES
+};
+static const ShaderCache::Program LINE_PROGRAM = {
+    ":/fritzmon/shaders/line.vsh", ":/fritzmon/shaders/line.fsh", LINE_ATTRIBUTES
+};
+
+static QList<QByteArray> attributeList(const char *const *attributes)
+{
+    auto list = QList<QByteArray>();
+
+    for (; *attributes; ++attributes)
+        list << *attributes;
+
+    return list;
+}
+
 // background
 
 static constexpr auto NOISE_SIZE = 64;
@@ -64,6 +106,7 @@ class BackgroundNode : public QSGGeometryNode
 public:
     BackgroundNode(QQuickWindow *window, const QColor &color);
 
+    void setColor(const QColor &color);
     void setRect(const QRectF &bounds);
 };
 
@@ -84,12 +127,19 @@ class NoisyShader : public QSGSimpleMaterialShader<NoisyMaterial>
 
 public:
     NoisyShader() {
-        setShaderSourceFile(QOpenGLShader::Vertex, ":/fritzmon/shaders/noisy.vsh");
-        setShaderSourceFile(QOpenGLShader::Fragment, ":/fritzmon/shaders/noisy.fsh");
+        setShaderSourceFile(QOpenGLShader::Vertex, NOISY_PROGRAM.vertexShaderPath);
+        setShaderSourceFile(QOpenGLShader::Fragment, NOISY_PROGRAM.fragmentShaderPath);
     }
 
     QList<QByteArray> attributes() const override {
-        return QList<QByteArray>() << "aVertex" << "aTexCoord";
+        return attributeList(NOISY_ATTRIBUTES);
+    }
+
+    void compile() override {
+        if (ShaderCache::instance().loadProgram(program(), NOISY_PROGRAM))
+            return;
+        QSGSimpleMaterialShader<NoisyMaterial>::compile();
+        ShaderCache::instance().storeProgram(program(), NOISY_PROGRAM);
     }
 
     void updateState(const NoisyMaterial *m, const NoisyMaterial *data) override {
@@ -147,20 +197,70 @@ BackgroundNode::BackgroundNode(QQuickWindow *window, const QColor &color)
     setFlag(OwnsGeometry, true);
 }
 
+void BackgroundNode::setColor(const QColor &color)
+{
+    static_cast<QSGSimpleMaterial<NoisyMaterial> *>(material())->state()->color = color;
+    markDirty(QSGNode::DirtyMaterial);
+}
+
 void BackgroundNode::setRect(const QRectF &bounds)
 {
     QSGGeometry::updateTexturedRectGeometry(geometry(), bounds, QRectF(0, 0, 1, 1));
     markDirty(QSGNode::DirtyGeometry);
 }
 
+// samples
+
+struct GraphPoint
+{
+    float position; //< sample index, or the position inside a bucket of a coarser tier
+    float value;
+};
+
+// interpolates the points just outside of [left, right] onto the borders and drops the rest
+static void clipPoints(std::vector<GraphPoint> &points, float left, float right)
+{
+    auto interpolate = [](const GraphPoint &a, const GraphPoint &b, float position) {
+        auto t = (position - a.position) / (b.position - a.position);
+
+        return GraphPoint{ position, a.value + (b.value - a.value) * t };
+    };
+    auto begin = std::find_if(points.begin(), points.end(), [left](const GraphPoint &point) {
+        return point.position >= left;
+    });
+
+    if ((begin != points.begin()) && (begin != points.end())) {
+        *(begin - 1) = interpolate(*(begin - 1), *begin, left);
+        --begin;
+    }
+    points.erase(points.begin(), begin);
+
+    auto end = std::find_if(points.begin(), points.end(), [right](const GraphPoint &point) {
+        return point.position > right;
+    });
+
+    if ((end != points.begin()) && (end != points.end())) {
+        *end = interpolate(*(end - 1), *end, right);
+        ++end;
+    }
+    points.erase(end, points.end());
+}
+
 // Line
 
+// the shader extends the strip of each segment ``LINE_SIZE`` pixels downwards from the samples
+static constexpr auto LINE_SIZE = 10.0f;
+static constexpr auto LINE_SPREAD = 0.8f;
+
 class LineNode : public QSGGeometryNode
 {
 public:
     LineNode(float size, float spread, const QColor &color);
 
-    void updateGeometry(const QRectF &bounds, float upperBound, const std::vector<float> &samples);
+    void setColor(const QColor &color);
+    // ``left`` is the position shown on the left border
+    void updateGeometry(const QRectF &bounds, float upperBound,
+                        const std::vector<GraphPoint> &points, float left, float pixelsPerSample);
 
 private:
     QSGGeometry m_geometry;
@@ -179,12 +279,19 @@ class LineShader : public QSGSimpleMaterialShader<LineMaterial>
 
 public:
     LineShader() {
-        setShaderSourceFile(QOpenGLShader::Vertex, ":/fritzmon/shaders/line.vsh");
-        setShaderSourceFile(QOpenGLShader::Fragment, ":/fritzmon/shaders/line.fsh");
+        setShaderSourceFile(QOpenGLShader::Vertex, LINE_PROGRAM.vertexShaderPath);
+        setShaderSourceFile(QOpenGLShader::Fragment, LINE_PROGRAM.fragmentShaderPath);
     }
 
     QList<QByteArray> attributes() const override {
-        return QList<QByteArray>() << "pos" << "t";
+        return attributeList(LINE_ATTRIBUTES);
+    }
+
+    void compile() override {
+        if (ShaderCache::instance().loadProgram(program(), LINE_PROGRAM))
+            return;
+        QSGSimpleMaterialShader<LineMaterial>::compile();
+        ShaderCache::instance().storeProgram(program(), LINE_PROGRAM);
     }
 
     void updateState(const LineMaterial *m, const LineMaterial *n) override {
@@ -247,21 +354,33 @@ LineNode::LineNode(float size, float spread, const QColor &color)
     setFlag(OwnsMaterial);
 }
 
+void LineNode::setColor(const QColor &color)
+{
+    static_cast<QSGSimpleMaterial<LineMaterial> *>(material())->state()->color = color;
+    markDirty(QSGNode::DirtyMaterial);
+}
+
 void LineNode::updateGeometry(const QRectF &bounds, float upperBound,
-                              const std::vector<float> &samples)
+                              const std::vector<GraphPoint> &points, float left,
+                              float pixelsPerSample)
 {
-    m_geometry.allocate(samples.size() * 2);
+    if (points.size() < 2) {
+        m_geometry.allocate(0);
+        markDirty(QSGNode::DirtyGeometry);
+
+        return;
+    }
+
+    m_geometry.allocate(points.size() * 2);
 
     auto x = bounds.x();
-    auto w = bounds.width();
     auto h = bounds.height();
-    auto dx = w / (samples.size() - 1);
     auto dy = h / upperBound;
     auto *vertex = static_cast<LineVertex *>(m_geometry.vertexData());
 
-    for (int i = 0; i < samples.size(); ++i) {
-        auto ix = x + dx * i;
-        auto iy = h - dy * samples[i];
+    for (auto i = 0u; i < points.size(); ++i) {
+        auto ix = x + (points[i].position - left) * pixelsPerSample;
+        auto iy = h - dy * points[i].value;
 
         vertex[i * 2].set(ix, iy, 0);
         vertex[i * 2 + 1].set(ix, iy, 1);
@@ -270,13 +389,469 @@ void LineNode::updateGeometry(const QRectF &bounds, float upperBound,
     markDirty(QSGNode::DirtyGeometry);
 }
 
+// axes
+
+static constexpr auto GRID_TICK_TARGET = 4; //< preferred number of grid lines
+static constexpr auto LABEL_PIXEL_SIZE = 11;
+static constexpr auto LABEL_PADDING = 3;
+
+struct AxisTick
+{
+    float value;
+    QString label;
+};
+
+// Picks a "nice" step of 1, 2 or 5 times a power of ten, so the labels stay short.
+static float tickStep(float upperBound)
+{
+    auto rough = upperBound / GRID_TICK_TARGET;
+    auto magnitude = std::pow(10.0f, std::floor(std::log10(rough)));
+    auto residual = rough / magnitude;
+
+    if (residual > 5.0f)
+        return 10.0f * magnitude;
+    else if (residual > 2.0f)
+        return 5.0f * magnitude;
+    else if (residual > 1.0f)
+        return 2.0f * magnitude;
+    return magnitude;
+}
+
+static std::vector<AxisTick> axisTicks(float upperBound, const QString &unit)
+{
+    auto ticks = std::vector<AxisTick>();
+
+    if (!(upperBound > 0.0f) || !std::isfinite(upperBound))
+        return ticks;
+
+    auto step = tickStep(upperBound);
+
+    for (auto i = 1; step * i < upperBound; ++i)
+        ticks.push_back({ step * i, QString::number(step * i, 'g', 4) });
+    if (!ticks.empty() && !unit.isEmpty())
+        ticks.back().label.append(QLatin1Char(' ')).append(unit);
+
+    return ticks;
+}
+
+static float tickPosition(const QRectF &bounds, float upperBound, float value)
+{
+    // align to the pixel center to keep one pixel wide lines crisp
+    return std::floor(bounds.y() + bounds.height() - bounds.height() / upperBound * value) + 0.5f;
+}
+
+class GridNode : public QSGGeometryNode
+{
+public:
+    explicit GridNode(const QColor &color);
+
+    void setColor(const QColor &color);
+    void updateGeometry(const QRectF &bounds, float upperBound, const std::vector<AxisTick> &ticks);
+
+private:
+    QSGGeometry m_geometry;
+    QSGFlatColorMaterial m_material;
+};
+
+GridNode::GridNode(const QColor &color)
+  : QSGGeometryNode(),
+    m_geometry(QSGGeometry::defaultAttributes_Point2D(), 0)
+{
+    m_geometry.setDrawingMode(GL_LINES);
+    m_geometry.setLineWidth(1.0f);
+    setGeometry(&m_geometry);
+    m_material.setColor(color);
+    setMaterial(&m_material);
+}
+
+void GridNode::setColor(const QColor &color)
+{
+    m_material.setColor(color);
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+void GridNode::updateGeometry(const QRectF &bounds, float upperBound,
+                              const std::vector<AxisTick> &ticks)
+{
+    m_geometry.allocate(ticks.size() * 2);
+
+    auto *vertex = m_geometry.vertexDataAsPoint2D();
+
+    for (const auto &tick : ticks) {
+        auto y = tickPosition(bounds, upperBound, tick.value);
+
+        (vertex++)->set(bounds.left(), y);
+        (vertex++)->set(bounds.right(), y);
+    }
+
+    markDirty(QSGNode::DirtyGeometry);
+}
+
+/* All tick labels are rendered once into a single texture, and every label is drawn as a quad
+ * sampling its part of it.  The texture only has to be regenerated if the labels change, a
+ * resize merely moves the quads.
+ */
+class LabelNode : public QSGGeometryNode
+{
+public:
+    LabelNode();
+
+    void updateLabels(QQuickWindow *window, const QColor &color,
+                      const std::vector<AxisTick> &ticks);
+    void updateGeometry(const QRectF &bounds, float upperBound, const std::vector<AxisTick> &ticks);
+
+private:
+    QSGGeometry m_geometry;
+    QSGTextureMaterial m_material;
+    std::unique_ptr<QSGTexture> m_atlas;
+    QSizeF m_atlasSize;               //< in logical pixels
+    std::vector<QRectF> m_labelRects; //< label positions in the atlas, in logical pixels
+};
+
+LabelNode::LabelNode()
+  : QSGGeometryNode(),
+    m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 0)
+{
+    m_geometry.setDrawingMode(GL_TRIANGLES);
+    setGeometry(&m_geometry);
+    m_material.setFlag(QSGMaterial::Blending);
+    setMaterial(&m_material);
+}
+
+void LabelNode::updateLabels(QQuickWindow *window, const QColor &color,
+                             const std::vector<AxisTick> &ticks)
+{
+    auto font = QFont();
+
+    font.setPixelSize(LABEL_PIXEL_SIZE);
+
+    auto metrics = QFontMetrics(font);
+    auto rowHeight = metrics.height();
+    auto width = 1;
+
+    m_labelRects.clear();
+    for (const auto &tick : ticks) {
+        auto labelWidth = metrics.width(tick.label);
+
+        m_labelRects.emplace_back(0, rowHeight * m_labelRects.size(), labelWidth, rowHeight);
+        width = std::max(width, labelWidth);
+    }
+
+    auto ratio = window->effectiveDevicePixelRatio();
+
+    m_atlasSize = QSizeF(width, std::max<int>(rowHeight * ticks.size(), 1));
+
+    auto image = QImage((m_atlasSize * ratio).toSize(), QImage::Format_ARGB32_Premultiplied);
+
+    image.setDevicePixelRatio(ratio);
+    image.fill(Qt::transparent);
+
+    QPainter painter(&image);
+
+    painter.setFont(font);
+    painter.setPen(color);
+    for (auto i = 0u; i < ticks.size(); ++i)
+        painter.drawText(m_labelRects[i], Qt::AlignLeft | Qt::AlignVCenter, ticks[i].label);
+    painter.end();
+
+    m_atlas.reset(window->createTextureFromImage(image, QQuickWindow::TextureHasAlphaChannel));
+    m_atlas->setFiltering(QSGTexture::Linear);
+    m_material.setTexture(m_atlas.get());
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+void LabelNode::updateGeometry(const QRectF &bounds, float upperBound,
+                               const std::vector<AxisTick> &ticks)
+{
+    if (!m_atlas || (ticks.size() != m_labelRects.size())) {
+        m_geometry.allocate(0);
+        markDirty(QSGNode::DirtyGeometry);
+
+        return;
+    }
+
+    m_geometry.allocate(ticks.size() * 6);
+
+    auto subRect = m_atlas->normalizedTextureSubRect();
+    auto *vertex = m_geometry.vertexDataAsTexturedPoint2D();
+
+    for (auto i = 0u; i < ticks.size(); ++i) {
+        const auto &source = m_labelRects[i];
+        auto y = tickPosition(bounds, upperBound, ticks[i].value) - 0.5f - source.height();
+        auto target = QRectF(QPointF(bounds.x() + LABEL_PADDING,
+                                     std::max<qreal>(y, bounds.y())), source.size());
+        auto tx0 = subRect.x() + subRect.width() * source.left() / m_atlasSize.width();
+        auto tx1 = subRect.x() + subRect.width() * source.right() / m_atlasSize.width();
+        auto ty0 = subRect.y() + subRect.height() * source.top() / m_atlasSize.height();
+        auto ty1 = subRect.y() + subRect.height() * source.bottom() / m_atlasSize.height();
+
+        (vertex++)->set(target.left(), target.top(), tx0, ty0);
+        (vertex++)->set(target.right(), target.top(), tx1, ty0);
+        (vertex++)->set(target.left(), target.bottom(), tx0, ty1);
+        (vertex++)->set(target.right(), target.top(), tx1, ty0);
+        (vertex++)->set(target.right(), target.bottom(), tx1, ty1);
+        (vertex++)->set(target.left(), target.bottom(), tx0, ty1);
+    }
+
+    markDirty(QSGNode::DirtyGeometry);
+}
+
+// software fallback
+
+/* Without OpenGL, the scene graph only draws rectangles and textures, so the whole graph is
+ * painted with QPainter: the background with the grid and labels into an image, which only
+ * changes with the size or the scale, and the line into transparent tiles.  The tiles are placed
+ * by their position on the scrolled line, so scrolling only moves them; the tiles scrolled in and
+ * the ones the line continues into are painted and uploaded, the others keep their textures.
+ */
+
+static constexpr auto SOFTWARE_LINE_WIDTH = 3.0f;
+static constexpr auto SOFTWARE_TILE_WIDTH = 128; //< in device pixels
+
+static const std::vector<uchar> &noiseTable()
+{
+    static const auto table = [](){
+        auto values = std::vector<uchar>(NOISE_SIZE * NOISE_SIZE);
+
+        for (auto &value : values)
+            value = static_cast<uchar>(rand() & 0xff);
+
+        return values;
+    }();
+
+    return table;
+}
+
+// mimics noisy.fsh
+static void paintBackground(QImage &image, const QColor &color)
+{
+    const auto &noise = noiseTable();
+    auto width = image.width();
+    auto height = image.height();
+    auto ratio = image.devicePixelRatio();
+
+    for (auto y = 0; y < height; ++y) {
+        auto *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        auto ny = static_cast<int>(y / ratio) % NOISE_SIZE;
+        auto dv = 0.4f - static_cast<float>(y) / height;
+
+        for (auto x = 0; x < width; ++x) {
+            auto nx = static_cast<int>(x / ratio) % NOISE_SIZE;
+            auto du = 0.5f - static_cast<float>(x) / width;
+            auto shade = noise[ny * NOISE_SIZE + nx] / 255.0f * 0.05f
+                         - std::sqrt(du * du + dv * dv) * 0.3f;
+            auto channel = [shade](float c) {
+                return qBound(0, static_cast<int>((c + shade) * 255.0f), 255);
+            };
+
+            line[x] = qPremultiply(qRgba(channel(color.redF()), channel(color.greenF()),
+                                         channel(color.blueF()), color.alpha()));
+        }
+    }
+}
+
+static void paintAxes(QImage &image, const QColor &gridColor, const QColor &labelColor,
+                      float upperBound, const std::vector<AxisTick> &ticks)
+{
+    auto bounds = QRectF(QPointF(), QSizeF(image.size()) / image.devicePixelRatio());
+    auto font = QFont();
+
+    font.setPixelSize(LABEL_PIXEL_SIZE);
+
+    auto rowHeight = QFontMetrics(font).height();
+    QPainter painter(&image);
+
+    painter.setFont(font);
+    for (const auto &tick : ticks) {
+        auto y = tickPosition(bounds, upperBound, tick.value);
+
+        painter.setPen(gridColor);
+        painter.drawLine(QPointF(bounds.left(), y), QPointF(bounds.right(), y));
+        painter.setPen(labelColor);
+        painter.drawText(QRectF(bounds.x() + LABEL_PADDING,
+                                std::max<qreal>(y - 0.5f - rowHeight, bounds.y()),
+                                bounds.width() - LABEL_PADDING, rowHeight),
+                         Qt::AlignLeft | Qt::AlignVCenter, tick.label);
+    }
+}
+
+/* Computes the line in device pixels.  If there are more points than pixel columns, each column
+ * is reduced to its minimum and maximum, so the cost is bound by the width instead of the number
+ * of samples.
+ */
+static QPolygonF linePoints(const std::vector<GraphPoint> &points, float spacing, int scroll,
+                            float height, float scale, float offset)
+{
+    auto polygon = QPolygonF();
+    auto x = [&](const GraphPoint &point) { return point.position * spacing - scroll; };
+    auto y = [&](float value) { return height - scale * value + offset; };
+
+    if (points.size() < 2)
+        return polygon;
+    if ((x(points.back()) - x(points.front())) >= points.size()) {
+        polygon.reserve(points.size());
+        for (const auto &point : points)
+            polygon.append(QPointF(x(point), y(point.value)));
+
+        return polygon;
+    }
+
+    auto column = std::numeric_limits<int>::min();
+    auto low = 0.0f;
+    auto high = 0.0f;
+    auto flush = [&]() {
+        if (column != std::numeric_limits<int>::min()) {
+            polygon.append(QPointF(column, y(low)));
+            if (high != low)
+                polygon.append(QPointF(column, y(high)));
+        }
+    };
+
+    for (const auto &point : points) {
+        auto px = static_cast<int>(std::floor(x(point)));
+
+        if (px != column) {
+            flush();
+            column = px;
+            low = high = point.value;
+        } else {
+            low = std::min(low, point.value);
+            high = std::max(high, point.value);
+        }
+    }
+    flush();
+
+    return polygon;
+}
+
+// the tile ``index`` covers the device pixels [index, index + 1) * SOFTWARE_TILE_WIDTH of the line
+struct LineTile
+{
+    int index;
+    QImage image;
+    std::unique_ptr<QSGTexture> texture;
+    QSGSimpleTextureNode *node; //< owned by the line layer
+};
+
+class SoftwareGraphNode : public QSGNode
+{
+public:
+    SoftwareGraphNode();
+
+    // returns nullptr if there is no such tile yet
+    LineTile *tile(int index);
+    LineTile &addTile(int index, int height);
+    // removes the tiles outside of [first, last], all of them for an empty range
+    void removeTiles(int first, int last);
+
+    QSGSimpleTextureNode *background;
+    QSGNode *lineLayer;
+    std::unique_ptr<QSGTexture> backgroundTexture;
+    std::vector<LineTile> lineTiles;
+    std::vector<AxisTick> ticks;
+    float spacing;   //< distance between samples in device pixels
+    int scroll;      //< horizontal offset of the line tiles in device pixels
+    int tier;        //< level of detail of the line tiles
+    int paintedRows; //< number of samples contained in the line tiles
+};
+
+SoftwareGraphNode::SoftwareGraphNode()
+  : QSGNode(),
+    background(new QSGSimpleTextureNode()),
+    lineLayer(new QSGNode()),
+    backgroundTexture(),
+    lineTiles(),
+    ticks(),
+    spacing(0.0f),
+    scroll(0),
+    tier(0),
+    paintedRows(0)
+{
+    appendChildNode(background);
+    appendChildNode(lineLayer);
+}
+
+LineTile *SoftwareGraphNode::tile(int index)
+{
+    auto it = std::find_if(lineTiles.begin(), lineTiles.end(), [index](const LineTile &tile) {
+        return tile.index == index;
+    });
+
+    return (it != lineTiles.end()) ? &*it : nullptr;
+}
+
+LineTile &SoftwareGraphNode::addTile(int index, int height)
+{
+    auto image = QImage(SOFTWARE_TILE_WIDTH, height, QImage::Format_ARGB32_Premultiplied);
+
+    image.fill(Qt::transparent);
+    lineTiles.push_back({ index, image, nullptr, new QSGSimpleTextureNode() });
+    lineLayer->appendChildNode(lineTiles.back().node);
+
+    return lineTiles.back();
+}
+
+void SoftwareGraphNode::removeTiles(int first, int last)
+{
+    auto end = std::remove_if(lineTiles.begin(), lineTiles.end(),
+                              [this, first, last](LineTile &tile) {
+        if ((tile.index >= first) && (tile.index <= last))
+            return false;
+        lineLayer->removeChildNode(tile.node);
+        delete tile.node;
+
+        return true;
+    });
+
+    lineTiles.erase(end, lineTiles.end());
+}
+
+// view
+
+static constexpr auto MIN_VISIBLE_SAMPLES = 8;
+static constexpr auto WHEEL_ZOOM_FACTOR = 1.25;
+static constexpr auto VIEW_CHUNK_SIZE = 256; //< buckets are read from the model in chunks
+
+struct Graph::ViewWindow
+{
+    float left;  //< sample position on the left border
+    float right; //< sample position on the right border
+    int tier;    //< level of detail, see GraphModel
+};
+
+/* Holds the points of the visible buckets and the neighbouring chunks, so panning and appending
+ * samples mostly get by without going back to the model.
+ */
+struct Graph::ViewCache
+{
+    int tier = -1;
+    int first = 0;     //< first bucket contained
+    int count = 0;     //< number of buckets contained
+    bool tail = false; //< contains the last, possibly incomplete, bucket
+    int rowCount = 0;  //< number of samples when the cache was filled
+    std::vector<GraphPoint> points;
+};
+
+/* The samples of the current view, prepared on the GUI thread while polishing. The render thread
+ * only takes a reference during the sync, so it never touches the model.
+ */
+struct Graph::Snapshot
+{
+    ViewWindow view = { 0.0f, 1.0f, 0 };
+    int rowCount = 0;
+    std::vector<GraphPoint> points; //< includes one bucket beyond each border
+};
+
 // graph
 
 class GraphNode : public QSGNode
 {
 public:
     BackgroundNode *background;
+    GridNode *grid;
     LineNode *line;
+    LabelNode *labels;
+    std::vector<AxisTick> ticks;
 };
 
 Graph::Graph(QQuickItem *parent)
@@ -284,11 +859,41 @@ Graph::Graph(QQuickItem *parent)
     m_samplesModel(nullptr),
     m_color(QColor("#ff9900")),
     m_backgroundColor(QColor("#333333")),
+    m_gridColor(QColor(255, 255, 255, 48)),
+    m_labelColor(QColor(255, 255, 255, 160)),
+    m_unit(QStringLiteral("kbit/s")),
     m_upperBound(10.0f),
+    m_visibleSamples(0),
+    m_viewOffset(0.0),
+    m_samplePeriod(0),
+    m_backend(AutomaticBackend),
     m_geometryChanged(false),
-    m_samplesChanged(false)
+    m_samplesChanged(false),
+    m_scaleChanged(false),
+    m_gridChanged(false),
+    m_colorsChanged(false),
+    m_softwareNode(false),
+    m_firstChangedRow(0),
+    m_knownRowCount(0),
+    m_dragPosition(0.0),
+    m_pinchDistance(0.0),
+    m_viewCache(std::make_unique<ViewCache>()),
+    m_snapshot(std::make_shared<Snapshot>())
 {
     setFlag(ItemHasContents, true);
+    setAcceptedMouseButtons(Qt::LeftButton);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    setAcceptTouchEvents(true);
+#endif
+}
+
+void Graph::prepareShaders()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    if (QQuickWindow::sceneGraphBackend() == QLatin1String("software"))
+        return;
+#endif
+    ShaderCache::instance().warmUp({ NOISY_PROGRAM, LINE_PROGRAM });
 }
 
 Graph::~Graph()
@@ -299,8 +904,13 @@ Graph::~Graph()
 
 void Graph::setBackgroundColor(const QColor &newColor)
 {
-    m_color = newColor;
+    if (newColor == m_backgroundColor)
+        return;
+    m_backgroundColor = newColor;
     emit backgroundColorChanged(newColor);
+
+    m_colorsChanged = true;
+    update();
 }
 
 QColor Graph::backgroundColor() const
@@ -310,8 +920,13 @@ QColor Graph::backgroundColor() const
 
 void Graph::setColor(const QColor &newColor)
 {
+    if (newColor == m_color)
+        return;
     m_color = newColor;
     emit colorChanged(newColor);
+
+    m_colorsChanged = true;
+    update();
 }
 
 QColor Graph::color() const
@@ -319,6 +934,54 @@ QColor Graph::color() const
     return m_color;
 }
 
+void Graph::setGridColor(const QColor &newColor)
+{
+    if (newColor == m_gridColor)
+        return;
+    m_gridColor = newColor;
+    emit gridColorChanged(newColor);
+
+    m_gridChanged = true;
+    update();
+}
+
+QColor Graph::gridColor() const
+{
+    return m_gridColor;
+}
+
+void Graph::setLabelColor(const QColor &newColor)
+{
+    if (newColor == m_labelColor)
+        return;
+    m_labelColor = newColor;
+    emit labelColorChanged(newColor);
+
+    m_scaleChanged = true;
+    update();
+}
+
+QColor Graph::labelColor() const
+{
+    return m_labelColor;
+}
+
+void Graph::setUnit(const QString &newUnit)
+{
+    if (newUnit == m_unit)
+        return;
+    m_unit = newUnit;
+    emit unitChanged(newUnit);
+
+    m_scaleChanged = true;
+    update();
+}
+
+QString Graph::unit() const
+{
+    return m_unit;
+}
+
 void Graph::setModel(const QVariant &newModel)
 {
     auto modelptr = newModel.value<QAbstractListModel *>();
@@ -337,13 +1000,15 @@ void Graph::setModel(const QVariant &newModel)
             delete m_samplesModel;
     }
     m_samplesModel = modelptr;
+    m_firstChangedRow = 0;
+    m_knownRowCount = m_samplesModel ? m_samplesModel->rowCount() : 0;
+    m_viewOffset = 0.0;
     if (m_samplesModel)
         connect(m_samplesModel, &QAbstractListModel::dataChanged,
                 this,           &Graph::onSampleDataChanged);
     emit modelChanged();
 
-    m_samplesChanged = true;
-    update();
+    polish();
 }
 
 QVariant Graph::model() const
@@ -353,11 +1018,14 @@ QVariant Graph::model() const
 
 void Graph::setUpperBound(float newUpperBound)
 {
+    if (newUpperBound == m_upperBound)
+        return;
     m_upperBound = newUpperBound;
 
     emit upperBoundChanged(newUpperBound);
 
     m_samplesChanged = true;
+    m_scaleChanged = true;
     update();
 }
 
@@ -366,44 +1034,520 @@ float Graph::upperBound() const
     return m_upperBound;
 }
 
+void Graph::setVisibleSamples(int newVisibleSamples)
+{
+    if (newVisibleSamples == m_visibleSamples)
+        return;
+    m_visibleSamples = newVisibleSamples;
+
+    emit visibleSamplesChanged(newVisibleSamples);
+
+    polish();
+}
+
+int Graph::visibleSamples() const
+{
+    return m_visibleSamples;
+}
+
+void Graph::setViewOffset(qreal newViewOffset)
+{
+    auto rowCount = m_samplesModel ? m_samplesModel->rowCount() : 0;
+    auto length = (m_visibleSamples > 1) ? m_visibleSamples : rowCount;
+
+    newViewOffset = qBound<qreal>(0.0, newViewOffset, std::max(rowCount - length, 0));
+    if (newViewOffset == m_viewOffset)
+        return;
+    m_viewOffset = newViewOffset;
+
+    emit viewOffsetChanged(newViewOffset);
+
+    polish();
+}
+
+qreal Graph::viewOffset() const
+{
+    return m_viewOffset;
+}
+
+void Graph::setSamplePeriod(int newSamplePeriod)
+{
+    if (newSamplePeriod == m_samplePeriod)
+        return;
+    m_samplePeriod = newSamplePeriod;
+
+    emit samplePeriodChanged(newSamplePeriod);
+}
+
+int Graph::samplePeriod() const
+{
+    return m_samplePeriod;
+}
+
+void Graph::zoom(qreal factor, qreal x)
+{
+    auto rowCount = m_samplesModel ? m_samplesModel->rowCount() : 0;
+    auto length = (m_visibleSamples > 1) ? m_visibleSamples : std::max(rowCount, 2);
+    auto anchorRatio = (width() > 0.0) ? qBound<qreal>(0.0, x / width(), 1.0) : 1.0;
+    // keep the sample under the anchor in place
+    auto anchor = rowCount - 1 - m_viewOffset - (length - 1) * (1.0 - anchorRatio);
+    auto newLength = qBound(MIN_VISIBLE_SAMPLES, qRound(length * factor),
+                            std::max(rowCount, MIN_VISIBLE_SAMPLES));
+
+    setVisibleSamples(newLength);
+    setViewOffset(rowCount - 1 - anchor - (newLength - 1) * (1.0 - anchorRatio));
+}
+
+void Graph::pan(qreal dx)
+{
+    auto rowCount = m_samplesModel ? m_samplesModel->rowCount() : 0;
+    auto length = (m_visibleSamples > 1) ? m_visibleSamples : std::max(rowCount, 2);
+
+    if (width() > 0.0)
+        setViewOffset(m_viewOffset + dx * (length - 1) / width());
+}
+
+void Graph::resetView()
+{
+    setViewOffset(0.0);
+}
+
+void Graph::setBackend(Backend newBackend)
+{
+    if (newBackend == m_backend)
+        return;
+    m_backend = newBackend;
+
+    emit backendChanged(newBackend);
+
+    update();
+}
+
+Graph::Backend Graph::backend() const
+{
+    return m_backend;
+}
+
+void Graph::wheelEvent(QWheelEvent *event)
+{
+    zoom(std::pow(WHEEL_ZOOM_FACTOR, -event->angleDelta().y() / 120.0), event->posF().x());
+    event->accept();
+}
+
+void Graph::mousePressEvent(QMouseEvent *event)
+{
+    m_dragPosition = event->localPos().x();
+    event->accept();
+}
+
+void Graph::mouseMoveEvent(QMouseEvent *event)
+{
+    pan(event->localPos().x() - m_dragPosition);
+    m_dragPosition = event->localPos().x();
+    event->accept();
+}
+
+void Graph::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    resetView();
+    event->accept();
+}
+
+void Graph::touchEvent(QTouchEvent *event)
+{
+    const auto &points = event->touchPoints();
+
+    // single touches are synthesized into mouse events and pan the graph
+    if (points.size() != 2) {
+        m_pinchDistance = 0.0;
+        event->ignore();
+
+        return;
+    }
+
+    // only the horizontal distance matters, since only the time axis is zoomed
+    auto distance = std::abs(points[0].pos().x() - points[1].pos().x());
+    auto center = (points[0].pos().x() + points[1].pos().x()) / 2.0;
+
+    if ((m_pinchDistance > 0.0) && (distance > 0.0))
+        zoom(m_pinchDistance / distance, center);
+    m_pinchDistance = (event->touchPointStates() & Qt::TouchPointReleased) ? 0.0 : distance;
+    event->accept();
+}
+
 void Graph::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
 {
     m_geometryChanged = true;
+    // the level of detail depends on the width
+    polish();
     update();
     QQuickItem::geometryChanged(newGeometry, oldGeometry);
 }
 
+void Graph::updatePolish()
+{
+    auto snapshot = std::make_shared<Snapshot>();
+    auto *w = window();
+    auto ratio = w ? w->effectiveDevicePixelRatio() : 1.0;
+
+    snapshot->rowCount = m_samplesModel ? m_samplesModel->rowCount() : 0;
+    snapshot->view = viewWindow(snapshot->rowCount, width() * ratio);
+    snapshot->points = viewPoints(snapshot->view, snapshot->rowCount);
+    m_snapshot = std::move(snapshot);
+    m_samplesChanged = true;
+    update();
+}
+
 QSGNode *Graph::updatePaintNode(QSGNode *node, UpdatePaintNodeData *data)
 {
     Q_UNUSED(data);
 
-    auto nodeptr = std::unique_ptr<GraphNode>(static_cast<GraphNode *>(node));
     auto bounds = boundingRect();
+    auto software = useSoftwareBackend();
+    // the GUI thread is blocked until here, taking the snapshot is all the sync has to do
+    auto snapshot = m_snapshot;
+
+    // the node types of the backends are unrelated, so switching means starting from scratch
+    if (node && (software != m_softwareNode)) {
+        delete node;
+        node = nullptr;
+    }
+    m_softwareNode = software;
+    if (bounds.isEmpty()) {
+        delete node;
+        node = nullptr;
+    } else if (software)
+        node = updateSoftwareNode(node, bounds, *snapshot);
+    else
+        node = updateSceneGraphNode(node, bounds, *snapshot);
+    m_geometryChanged = false;
+    m_samplesChanged = false;
+    m_scaleChanged = false;
+    m_gridChanged = false;
+    m_colorsChanged = false;
+    m_firstChangedRow = std::numeric_limits<int>::max();
+
+    return node;
+}
+
+bool Graph::useSoftwareBackend() const
+{
+    switch (m_backend) {
+    case OpenGLBackend:
+        return false;
+    case SoftwareBackend:
+        return true;
+    case AutomaticBackend:
+        break;
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    // e.g. when started with QT_QUICK_BACKEND=software
+    auto *renderer = window()->rendererInterface();
+
+    return renderer && (renderer->graphicsApi() == QSGRendererInterface::Software);
+#else
+    return false;
+#endif
+}
+
+Graph::ViewWindow Graph::viewWindow(int rowCount, float width) const
+{
+    auto length = (m_visibleSamples > 1) ? m_visibleSamples : std::max(rowCount, 2);
+    auto right = rowCount - 1 - m_viewOffset;
+    auto samplesPerPixel = (length - 1) / std::max(width, 1.0f);
+    auto *model = qobject_cast<GraphModel *>(m_samplesModel);
+    auto tiers = model ? model->tierCount() : 0;
+    auto tier = 0;
+
+    // use the coarsest tier still having a bucket per pixel
+    while ((tier < tiers) && ((1 << (GraphModel::TIER_SHIFT * (tier + 1))) <= samplesPerPixel))
+        ++tier;
+
+    return { static_cast<float>(right - (length - 1)), static_cast<float>(right), tier };
+}
+
+std::vector<GraphPoint> Graph::viewPoints(const ViewWindow &view, int rowCount)
+{
+    auto points = std::vector<GraphPoint>();
+    auto *model = qobject_cast<GraphModel *>(m_samplesModel);
+
+    if (!m_samplesModel || (rowCount == 0))
+        return points;
+
+    auto bucketSize = 1 << (GraphModel::TIER_SHIFT * view.tier);
+    auto buckets = (view.tier == 0) ? rowCount : static_cast<int>(model->tier(view.tier).size());
+    // one bucket beyond each border, so the line enters and leaves the window
+    auto first = static_cast<int>(std::floor(view.left / bucketSize)) - 1;
+    auto last = static_cast<int>(std::floor(view.right / bucketSize)) + 1;
+
+    if ((last < 0) || (first >= buckets))
+        return points;
+    first = std::max(first, 0);
+    last = std::min(last, buckets - 1);
+
+    auto &cache = *m_viewCache;
+    auto pointsPerBucket = (view.tier == 0) ? 1 : 2;
+    auto span = last - first + 1;
+    auto appendBuckets = [this, model, &cache, &view, bucketSize](int begin, int end) {
+        if (view.tier == 0) {
+            for (auto i = begin; i < end; ++i) {
+                auto value = model ? model->samples()[i]
+                                   : m_samplesModel->data(m_samplesModel->index(i)).value<float>();
+
+                cache.points.push_back({ static_cast<float>(i), value });
+            }
+        } else {
+            const auto &tier = model->tier(view.tier);
+
+            // spread minimum and maximum over the bucket, a vertical segment would be invisible
+            for (auto i = begin; i < end; ++i) {
+                cache.points.push_back({ (i + 0.25f) * bucketSize, tier[i].minimum });
+                cache.points.push_back({ (i + 0.75f) * bucketSize, tier[i].maximum });
+            }
+        }
+    };
+
+    // samples appended to the tail extend the cache, only the last bucket of a coarser tier may
+    // have changed besides the new ones
+    if ((cache.tier == view.tier) && cache.tail && (cache.count > 0)
+        && (cache.rowCount < rowCount) && (m_firstChangedRow >= cache.rowCount)) {
+        auto end = cache.first + cache.count;
+        auto from = (view.tier == 0) ? end : end - 1;
+
+        cache.points.resize((from - cache.first) * pointsPerBucket);
+        appendBuckets(from, buckets);
+        cache.count = buckets - cache.first;
+        cache.rowCount = rowCount;
+
+        // the chunks scrolled out by more than a window width are dropped
+        auto keep = std::max(first - span, 0) / VIEW_CHUNK_SIZE * VIEW_CHUNK_SIZE;
+
+        if (keep > cache.first) {
+            cache.points.erase(cache.points.begin(),
+                               cache.points.begin() + (keep - cache.first) * pointsPerBucket);
+            cache.count -= keep - cache.first;
+            cache.first = keep;
+        }
+    }
+
+    auto valid = (cache.tier == view.tier) && (first >= cache.first)
+                 && (last < cache.first + cache.count)
+                 && (!cache.tail || (cache.rowCount == rowCount))
+                 && (m_firstChangedRow >= cache.rowCount);
+
+    if (!valid) {
+        // prefetch a window width on both sides, aligned to whole chunks
+        auto begin = std::max(first - span, 0) / VIEW_CHUNK_SIZE * VIEW_CHUNK_SIZE;
+        auto end = std::min((last + span) / VIEW_CHUNK_SIZE * VIEW_CHUNK_SIZE + VIEW_CHUNK_SIZE,
+                            buckets);
+
+        cache.tier = view.tier;
+        cache.first = begin;
+        cache.count = end - begin;
+        cache.tail = (end == buckets);
+        cache.rowCount = rowCount;
+        cache.points.clear();
+        cache.points.reserve(cache.count * pointsPerBucket);
+        appendBuckets(begin, end);
+    }
+
+    points.assign(cache.points.cbegin() + (first - cache.first) * pointsPerBucket,
+                  cache.points.cbegin() + (last + 1 - cache.first) * pointsPerBucket);
+
+    return points;
+}
+
+QSGNode *Graph::updateSceneGraphNode(QSGNode *node, const QRectF &bounds,
+                                     const Snapshot &snapshot)
+{
+    auto nodeptr = std::unique_ptr<GraphNode>(static_cast<GraphNode *>(node));
 
-    if (bounds.isEmpty())
-        return nullptr;
     if (!nodeptr) {
         nodeptr = std::make_unique<GraphNode>();
         // those objects are managed by the QObject hierarchy, so no smartpointers are used
         nodeptr->background = new BackgroundNode(window(), m_backgroundColor);
-        nodeptr->line = new LineNode(10.0f, 0.8f, m_color);
+        nodeptr->grid = new GridNode(m_gridColor);
+        nodeptr->line = new LineNode(LINE_SIZE, LINE_SPREAD, m_color);
+        nodeptr->labels = new LabelNode();
         nodeptr->appendChildNode(nodeptr->background);
+        nodeptr->appendChildNode(nodeptr->grid);
         nodeptr->appendChildNode(nodeptr->line);
+        nodeptr->appendChildNode(nodeptr->labels);
+        m_geometryChanged = true;
+        m_scaleChanged = true;
     }
     if (m_geometryChanged) {
         nodeptr->background->setRect(bounds);
     }
-    if (m_samplesModel && (m_geometryChanged || m_samplesChanged)) {
-        // bruteforce approach
-        auto rowCount = m_samplesModel->rowCount();
-        auto samples = std::vector<float>(rowCount);
+    if (m_scaleChanged) {
+        // the label texture is the only expensive part of the axes, so it is regenerated here
+        // and nowhere else
+        nodeptr->ticks = axisTicks(m_upperBound, m_unit);
+        nodeptr->labels->updateLabels(window(), m_labelColor, nodeptr->ticks);
+    }
+    if (m_scaleChanged || m_gridChanged)
+        nodeptr->grid->setColor(m_gridColor);
+    if (m_colorsChanged) {
+        nodeptr->background->setColor(m_backgroundColor);
+        nodeptr->line->setColor(m_color);
+    }
+    if (m_geometryChanged || m_scaleChanged) {
+        nodeptr->grid->updateGeometry(bounds, m_upperBound, nodeptr->ticks);
+        nodeptr->labels->updateGeometry(bounds, m_upperBound, nodeptr->ticks);
+    }
+    if (m_geometryChanged || m_samplesChanged) {
+        const auto &view = snapshot.view;
+        auto points = snapshot.points;
 
-        for (auto i = 0; i < rowCount; ++i)
-            samples[i] = m_samplesModel->data(m_samplesModel->index(i)).value<float>();
-        nodeptr->line->updateGeometry(bounds, m_upperBound, samples);
+        clipPoints(points, view.left, view.right);
+        nodeptr->line->updateGeometry(bounds, m_upperBound, points, view.left,
+                                      bounds.width() / (view.right - view.left));
     }
-    m_geometryChanged = false;
-    m_samplesChanged = false;
+
+    // stop managing the object
+    return nodeptr.release();
+}
+
+QSGNode *Graph::updateSoftwareNode(QSGNode *node, const QRectF &bounds,
+                                   const Snapshot &snapshot)
+{
+    auto nodeptr = std::unique_ptr<SoftwareGraphNode>(static_cast<SoftwareGraphNode *>(node));
+    auto *w = window();
+
+    if (!nodeptr) {
+        nodeptr = std::make_unique<SoftwareGraphNode>();
+        m_geometryChanged = true;
+        m_scaleChanged = true;
+    }
+
+    auto ratio = w->effectiveDevicePixelRatio();
+    auto deviceSize = (bounds.size() * ratio).toSize();
+    // the grid is painted into the background image along with the labels, a new line color
+    // requires the whole line to be painted again as well
+    auto backgroundChanged = m_geometryChanged || m_scaleChanged || m_gridChanged
+                             || m_colorsChanged;
+    auto fullRepaint = backgroundChanged || (m_firstChangedRow < nodeptr->paintedRows);
+
+    if (backgroundChanged) {
+        auto image = QImage(deviceSize, QImage::Format_ARGB32_Premultiplied);
+
+        image.setDevicePixelRatio(ratio);
+        nodeptr->ticks = axisTicks(m_upperBound, m_unit);
+        paintBackground(image, m_backgroundColor);
+        paintAxes(image, m_gridColor, m_labelColor, m_upperBound, nodeptr->ticks);
+
+        auto texture = std::unique_ptr<QSGTexture>(w->createTextureFromImage(image));
+
+        nodeptr->background->setTexture(texture.get());
+        nodeptr->background->setRect(bounds);
+        nodeptr->backgroundTexture.swap(texture);
+    }
+    if (!fullRepaint && !m_samplesChanged)
+        return nodeptr.release();
+
+    auto rowCount = snapshot.rowCount;
+    auto width = deviceSize.width();
+    auto height = deviceSize.height();
+    const auto &view = snapshot.view;
+    auto spacing = (width - 1) / (view.right - view.left);
+    // keep the right border of the view at the right border of the image; the offset is an
+    // integer, so previously painted content stays valid after shifting it
+    auto scroll = static_cast<int>(std::ceil(view.right * spacing - (width - 1)));
+    auto dirtyLeft = 0;
+
+    if ((m_visibleSamples <= 1) || (view.tier != 0) || (nodeptr->tier != 0)
+            || (spacing != nodeptr->spacing) || (nodeptr->paintedRows == 0))
+        fullRepaint = true;
+    if (!fullRepaint) {
+        auto dx = scroll - nodeptr->scroll;
+        // repaint everything from the last painted sample on, including the width of the pen
+        auto lastX = (nodeptr->paintedRows - 1) * spacing - scroll;
+        auto x0 = static_cast<int>(std::floor(std::min<float>(width - dx, lastX)
+                                              - SOFTWARE_LINE_WIDTH * ratio));
+
+        if ((dx < 0) || (dx >= width) || (x0 <= 0))
+            fullRepaint = true;
+        else
+            dirtyLeft = x0;
+    }
+
+    auto tileIndex = [](int x) {
+        return static_cast<int>(std::floor(static_cast<float>(x) / SOFTWARE_TILE_WIDTH));
+    };
+    auto firstTile = tileIndex(scroll);
+    auto lastTile = tileIndex(scroll + width - 1);
+
+    if (fullRepaint)
+        nodeptr->removeTiles(1, 0);
+    else
+        nodeptr->removeTiles(firstTile, lastTile);
+    for (auto index = firstTile; index <= lastTile; ++index)
+        if (!nodeptr->tile(index)) {
+            // a new tile is empty, so it is painted completely
+            nodeptr->addTile(index, height);
+            dirtyLeft = std::min(dirtyLeft, std::max(index * SOFTWARE_TILE_WIDTH - scroll, 0));
+        }
+
+    auto points = QPolygonF();
+
+    if (rowCount > 1) {
+        // start with the last point left of the dirty strip
+        auto left = (dirtyLeft + scroll) / spacing;
+        auto first = std::lower_bound(snapshot.points.cbegin(), snapshot.points.cend(), left,
+                                      [](const GraphPoint &point, float position) {
+                                          return point.position < position;
+                                      });
+
+        if (first != snapshot.points.cbegin())
+            --first;
+        // QPainter centers the pen on the samples, the shader strip lies below them
+        points = linePoints(std::vector<GraphPoint>(first, snapshot.points.cend()), spacing,
+                            scroll, height, height / m_upperBound, LINE_SIZE / 2.0f * ratio);
+    }
+
+    auto dirty = QRect(dirtyLeft, 0, width - dirtyLeft, height);
+
+    for (auto &tile : nodeptr->lineTiles) {
+        auto tileLeft = tile.index * SOFTWARE_TILE_WIDTH - scroll;
+        auto tileDirty = dirty.intersected(QRect(tileLeft, 0, SOFTWARE_TILE_WIDTH, height));
+
+        if (!tileDirty.isEmpty()) {
+            QPainter painter(&tile.image);
+
+            painter.translate(-tileLeft, 0);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.fillRect(tileDirty, Qt::transparent);
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            painter.setClipRect(tileDirty);
+            if (!points.isEmpty()) {
+                painter.setRenderHint(QPainter::Antialiasing);
+                painter.setPen(QPen(m_color, SOFTWARE_LINE_WIDTH * ratio, Qt::SolidLine,
+                                    Qt::RoundCap, Qt::RoundJoin));
+                painter.drawPolyline(points);
+            }
+            painter.end();
+
+            auto texture = std::unique_ptr<QSGTexture>(
+                        w->createTextureFromImage(tile.image,
+                                                  QQuickWindow::TextureHasAlphaChannel));
+
+            tile.node->setTexture(texture.get());
+            tile.texture.swap(texture);
+        }
+
+        // the tiles at the borders are cropped to the view
+        auto left = std::max(tileLeft, 0);
+        auto right = std::min(tileLeft + SOFTWARE_TILE_WIDTH, width);
+
+        tile.node->setRect(QRectF(bounds.x() + left / ratio, bounds.y(), (right - left) / ratio,
+                                  bounds.height()));
+        tile.node->setSourceRect(QRectF(left - tileLeft, 0, right - left, height));
+    }
+
+    nodeptr->spacing = spacing;
+    nodeptr->scroll = scroll;
+    nodeptr->tier = view.tier;
+    nodeptr->paintedRows = rowCount;
 
     // stop managing the object
     return nodeptr.release();
@@ -412,12 +1556,19 @@ QSGNode *Graph::updatePaintNode(QSGNode *node, UpdatePaintNodeData *data)
 void Graph::onSampleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
                                 const QVector<int> &roles)
 {
-    Q_UNUSED(topLeft);
     Q_UNUSED(bottomRight);
     Q_UNUSED(roles);
 
-    m_samplesChanged = true;
-    update();
+    auto rowCount = m_samplesModel->rowCount();
+
+    // keep a panned view in place while new samples arrive
+    if ((m_viewOffset > 0.0) && (rowCount > m_knownRowCount)) {
+        m_viewOffset += rowCount - m_knownRowCount;
+        emit viewOffsetChanged(m_viewOffset);
+    }
+    m_knownRowCount = rowCount;
+    m_firstChangedRow = std::min(m_firstChangedRow, topLeft.row());
+    polish();
 }
 
 } // namespace fritzmon
@@ -47,11 +47,16 @@
 
 #include <QtQuick/QQuickItem>
 
+#include <memory>
+#include <vector>
+
 class QRectF;
 class QSGNode;
 
 namespace fritzmon {
 
+struct GraphPoint;
+
 class Graph : public QQuickItem
 {
     Q_OBJECT
@@ -60,13 +65,33 @@ class Graph : public QQuickItem
                WRITE setBackgroundColor
                NOTIFY backgroundColorChanged)
     Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(QColor gridColor READ gridColor WRITE setGridColor NOTIFY gridColorChanged)
+    Q_PROPERTY(QColor labelColor READ labelColor WRITE setLabelColor NOTIFY labelColorChanged)
     Q_PROPERTY(QVariant model READ model WRITE setModel NOTIFY modelChanged)
     Q_PROPERTY(float upperBound READ upperBound WRITE setUpperBound NOTIFY upperBoundChanged)
+    Q_PROPERTY(QString unit READ unit WRITE setUnit NOTIFY unitChanged)
+    Q_PROPERTY(int visibleSamples
+               READ visibleSamples
+               WRITE setVisibleSamples
+               NOTIFY visibleSamplesChanged)
+    Q_PROPERTY(qreal viewOffset READ viewOffset WRITE setViewOffset NOTIFY viewOffsetChanged)
+    Q_PROPERTY(int samplePeriod READ samplePeriod WRITE setSamplePeriod NOTIFY samplePeriodChanged)
+    Q_PROPERTY(Backend backend READ backend WRITE setBackend NOTIFY backendChanged)
 
 public:
+    enum Backend {
+        AutomaticBackend, //< software if the scene graph does not use OpenGL
+        OpenGLBackend,
+        SoftwareBackend   //< QPainter based, works with the software scene graph adaptation
+    };
+    Q_ENUM(Backend)
+
     Graph(QQuickItem *parent=nullptr);
     ~Graph();
 
+    // compiles the shaders in the background, call before the first window is shown
+    static void prepareShaders();
+
     void setModel(const QVariant &newModel);
     QVariant model() const;
 
@@ -76,29 +101,98 @@ public:
     void setColor(const QColor &newColor);
     QColor color() const;
 
+    void setGridColor(const QColor &newColor);
+    QColor gridColor() const;
+
+    void setLabelColor(const QColor &newColor);
+    QColor labelColor() const;
+
+    void setUnit(const QString &newUnit);
+    QString unit() const;
+
     void setUpperBound(float newUpperBound);
     float upperBound() const;
 
+    // 0 stretches all samples over the width, otherwise the graph scrolls
+    void setVisibleSamples(int newVisibleSamples);
+    int visibleSamples() const;
+
+    // number of samples between the newest one and the right border, 0 follows new samples
+    void setViewOffset(qreal newViewOffset);
+    qreal viewOffset() const;
+
+    // time between two samples in milliseconds, used to describe the visible time span
+    void setSamplePeriod(int newSamplePeriod);
+    int samplePeriod() const;
+
+    // scales the visible samples by factor, keeping the sample at x in place
+    Q_INVOKABLE void zoom(qreal factor, qreal x);
+    // moves the view by dx pixels, positive values show older samples
+    Q_INVOKABLE void pan(qreal dx);
+    Q_INVOKABLE void resetView();
+
+    void setBackend(Backend newBackend);
+    Backend backend() const;
+
 Q_SIGNALS:
+    void backendChanged(Backend newBackend);
     void backgroundColorChanged(const QColor &newColor);
     void colorChanged(const QColor &newColor);
+    void gridColorChanged(const QColor &newColor);
+    void labelColorChanged(const QColor &newColor);
     void modelChanged();
+    void samplePeriodChanged(int newSamplePeriod);
+    void unitChanged(const QString &newUnit);
     void upperBoundChanged(float newUpperBound);
+    void viewOffsetChanged(qreal newViewOffset);
+    void visibleSamplesChanged(int newVisibleSamples);
 
 protected:
     void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+    void updatePolish() override;
     QSGNode *updatePaintNode(QSGNode *node, UpdatePaintNodeData *data) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+    void touchEvent(QTouchEvent *event) override;
 
 private:
+    struct ViewWindow;
+    struct ViewCache;
+    struct Snapshot;
+
     Q_SLOT void onSampleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
                                     const QVector<int> &roles);
+    bool useSoftwareBackend() const;
+    ViewWindow viewWindow(int rowCount, float width) const;
+    std::vector<GraphPoint> viewPoints(const ViewWindow &view, int rowCount);
+    QSGNode *updateSceneGraphNode(QSGNode *node, const QRectF &bounds, const Snapshot &snapshot);
+    QSGNode *updateSoftwareNode(QSGNode *node, const QRectF &bounds, const Snapshot &snapshot);
 
     QAbstractListModel *m_samplesModel;
     QColor m_color;
     QColor m_backgroundColor;
+    QColor m_gridColor;
+    QColor m_labelColor;
+    QString m_unit;
     float m_upperBound;
+    int m_visibleSamples;
+    qreal m_viewOffset;
+    int m_samplePeriod;
+    Backend m_backend;
     bool m_geometryChanged;
     bool m_samplesChanged;
+    bool m_scaleChanged; //< the axis labels have to be regenerated
+    bool m_gridChanged;  //< only the color of the grid, the labels stay valid
+    bool m_colorsChanged; //< of the background or the line
+    bool m_softwareNode; //< the current paint node belongs to the software backend
+    int m_firstChangedRow;
+    int m_knownRowCount;  //< row count at the last data change, to keep a panned view in place
+    qreal m_dragPosition;
+    qreal m_pinchDistance;
+    std::unique_ptr<ViewCache> m_viewCache; //< only used on the GUI thread
+    std::shared_ptr<const Snapshot> m_snapshot;
 
     Q_DISABLE_COPY(Graph)
 };
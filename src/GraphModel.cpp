@@ -26,20 +26,50 @@
 
 #include "GraphModel.hpp"
 
+#include <algorithm>
+
 namespace fritzmon {
 
 GraphModel::GraphModel(QObject *parent)
   : QAbstractListModel(parent),
-    m_data()
+    m_data(),
+    m_tiers()
 {}
 
 void GraphModel::addSample(float value)
 {
     m_data.push_back(value);
 
+    auto position = m_data.size() - 1;
+
+    // the new sample belongs to exactly one bucket per tier; a tier is started as soon as the
+    // tier below has more than one bucket
+    for (auto level = 1u; (std::size_t(1) << (TIER_SHIFT * (level - 1))) < m_data.size(); ++level) {
+        if (m_tiers.size() < level) {
+            addTier();
+            continue;
+        }
+
+        auto &buckets = m_tiers[level - 1];
+        auto bucket = position >> (TIER_SHIFT * level);
+
+        if (bucket == buckets.size())
+            buckets.push_back({ value, value });
+        else {
+            buckets[bucket].minimum = std::min(buckets[bucket].minimum, value);
+            buckets[bucket].maximum = std::max(buckets[bucket].maximum, value);
+        }
+    }
+
     auto index = createIndex(m_data.size() - 1, 0);
 
     emit dataChanged(index, index, {});
+    emit countChanged();
+}
+
+int GraphModel::count() const
+{
+    return m_data.size();
 }
 
 int GraphModel::rowCount(const QModelIndex &parent) const
@@ -52,4 +82,46 @@ QVariant GraphModel::data(const QModelIndex &index, int role) const
     return m_data[index.row()];
 }
 
+const std::vector<float> &GraphModel::samples() const
+{
+    return m_data;
+}
+
+int GraphModel::tierCount() const
+{
+    return m_tiers.size();
+}
+
+const std::vector<GraphModel::Bucket> &GraphModel::tier(int level) const
+{
+    return m_tiers[level - 1];
+}
+
+void GraphModel::addTier()
+{
+    auto buckets = std::vector<Bucket>();
+    auto width = std::size_t(1) << TIER_SHIFT;
+
+    if (m_tiers.empty()) {
+        for (auto i = 0u; i < m_data.size(); ++i)
+            if (i % width == 0)
+                buckets.push_back({ m_data[i], m_data[i] });
+            else {
+                buckets.back().minimum = std::min(buckets.back().minimum, m_data[i]);
+                buckets.back().maximum = std::max(buckets.back().maximum, m_data[i]);
+            }
+    } else {
+        const auto &lower = m_tiers.back();
+
+        for (auto i = 0u; i < lower.size(); ++i)
+            if (i % width == 0)
+                buckets.push_back(lower[i]);
+            else {
+                buckets.back().minimum = std::min(buckets.back().minimum, lower[i].minimum);
+                buckets.back().maximum = std::max(buckets.back().maximum, lower[i].maximum);
+            }
+    }
+    m_tiers.emplace_back(std::move(buckets));
+}
+
 } // namespace fritzmon
@@ -33,20 +33,45 @@
 
 namespace fritzmon {
 
+/* Besides the samples, the model keeps a pyramid of tiers for level-of-detail rendering: bucket
+ * ``b`` of tier ``n`` holds the minimum and maximum of the samples ``[b * 4^n, (b + 1) * 4^n)``.
+ * The tiers are updated incrementally as samples are added.
+ */
 class GraphModel : public QAbstractListModel
 {
     Q_OBJECT
+    // unlike ``rowCount()``, bindings are updated as samples are added
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
 
 public:
+    struct Bucket
+    {
+        float minimum;
+        float maximum;
+    };
+
+    static constexpr auto TIER_SHIFT = 2; //< each tier combines 2^TIER_SHIFT buckets of the previous
+
     explicit GraphModel(QObject *parent=nullptr);
 
     void addSample(float value);
 
-    int rowCount(const QModelIndex &parent) const override;
-    QVariant data(const QModelIndex &index, int role) const override;
+    int count() const;
+    int rowCount(const QModelIndex &parent=QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role=Qt::DisplayRole) const override;
+
+    const std::vector<float> &samples() const;
+    int tierCount() const; //< number of tiers above the samples
+    const std::vector<Bucket> &tier(int level) const; //< ``level`` starts at 1
+
+Q_SIGNALS:
+    void countChanged();
 
 private:
+    void addTier();
+
     std::vector<float> m_data;
+    std::vector<std::vector<Bucket>> m_tiers;
 
     Q_DISABLE_COPY(GraphModel)
 };
@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "HeatmapGraph.hpp"
+
+#include "GraphModel.hpp"
+
+#include <QtCore/QDebug>
+#include <QtCore/QtMath>
+
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFunctions>
+
+#include <QtQuick/QSGGeometry>
+#include <QtQuick/QSGGeometryNode>
+#include <QtQuick/QSGTexture>
+#include <QtQuick/QSGTextureMaterial>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace fritzmon {
+
+static constexpr auto DEFAULT_SAMPLES_PER_COLUMN = 1013; //< 30 days in 1024 columns at 2.5 s
+static constexpr auto DEFAULT_COLUMNS = 1024;
+static constexpr auto DEFAULT_BINS = 64;
+static constexpr auto COLORMAP_SIZE = 256;
+
+// textures with repeat wrapping need power of two sizes on OpenGL ES 2
+static int powerOfTwo(int value)
+{
+    return static_cast<int>(qNextPowerOfTwo(static_cast<quint32>(std::max(value, 1) - 1)));
+}
+
+static QRgb mix(const QColor &a, const QColor &b, float t)
+{
+    return qRgb(qRound(a.red() + (b.red() - a.red()) * t),
+                qRound(a.green() + (b.green() - a.green()) * t),
+                qRound(a.blue() + (b.blue() - a.blue()) * t));
+}
+
+// texture
+
+/* A texture which is only ever updated column by column with glTexSubImage2D. */
+class HeatmapTexture : public QSGTexture
+{
+public:
+    HeatmapTexture(const QSize &size, QRgb fill);
+    ~HeatmapTexture();
+
+    int textureId() const override;
+    QSize textureSize() const override;
+    bool hasAlphaChannel() const override;
+    bool hasMipmaps() const override;
+    void bind() override;
+
+    // the context has to be current, which it is while updating the paint node
+    void uploadColumns(const std::vector<HeatmapGraph::ColumnUpload> &columns);
+
+private:
+    GLuint m_id;
+    QSize m_size;
+    QRgb m_fill;
+};
+
+HeatmapTexture::HeatmapTexture(const QSize &size, QRgb fill)
+  : QSGTexture(),
+    m_id(0),
+    m_size(size),
+    m_fill(fill)
+{}
+
+HeatmapTexture::~HeatmapTexture()
+{
+    auto *context = QOpenGLContext::currentContext();
+
+    if (m_id && context)
+        context->functions()->glDeleteTextures(1, &m_id);
+}
+
+int HeatmapTexture::textureId() const
+{
+    return m_id;
+}
+
+QSize HeatmapTexture::textureSize() const
+{
+    return m_size;
+}
+
+bool HeatmapTexture::hasAlphaChannel() const
+{
+    return false;
+}
+
+bool HeatmapTexture::hasMipmaps() const
+{
+    return false;
+}
+
+void HeatmapTexture::bind()
+{
+    QOpenGLContext::currentContext()->functions()->glBindTexture(GL_TEXTURE_2D, m_id);
+    updateBindOptions();
+}
+
+void HeatmapTexture::uploadColumns(const std::vector<HeatmapGraph::ColumnUpload> &columns)
+{
+    auto *f = QOpenGLContext::currentContext()->functions();
+
+    if (!m_id) {
+        auto pixels = std::vector<uchar>();
+
+        pixels.reserve(m_size.width() * m_size.height() * 4);
+        for (auto i = 0; i < m_size.width() * m_size.height(); ++i) {
+            pixels.push_back(qRed(m_fill));
+            pixels.push_back(qGreen(m_fill));
+            pixels.push_back(qBlue(m_fill));
+            pixels.push_back(0xff);
+        }
+        f->glGenTextures(1, &m_id);
+        f->glBindTexture(GL_TEXTURE_2D, m_id);
+        f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_size.width(), m_size.height(), 0, GL_RGBA,
+                        GL_UNSIGNED_BYTE, pixels.data());
+        updateBindOptions(true);
+    } else
+        f->glBindTexture(GL_TEXTURE_2D, m_id);
+    for (const auto &column : columns)
+        f->glTexSubImage2D(GL_TEXTURE_2D, 0, column.slot, 0, 1, m_size.height(), GL_RGBA,
+                           GL_UNSIGNED_BYTE, column.pixels.data());
+}
+
+// node
+
+class HeatmapNode : public QSGGeometryNode
+{
+public:
+    HeatmapNode();
+
+    // returns true if the texture was recreated and needs all columns
+    bool updateTexture(const QSize &size, QRgb fill);
+    void uploadColumns(const std::vector<HeatmapGraph::ColumnUpload> &columns);
+    void updateGeometry(const QRectF &bounds, int columnCount);
+
+private:
+    QSGGeometry m_geometry;
+    QSGOpaqueTextureMaterial m_material;
+    std::unique_ptr<HeatmapTexture> m_texture;
+};
+
+HeatmapNode::HeatmapNode()
+  : QSGGeometryNode(),
+    m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 4)
+{
+    setGeometry(&m_geometry);
+    // the columns wrap around in the texture; interpolating would blend the newest and the
+    // oldest column at the seam, and the bins are discrete anyway
+    m_material.setHorizontalWrapMode(QSGTexture::Repeat);
+    m_material.setVerticalWrapMode(QSGTexture::ClampToEdge);
+    m_material.setFiltering(QSGTexture::Nearest);
+    setMaterial(&m_material);
+}
+
+bool HeatmapNode::updateTexture(const QSize &size, QRgb fill)
+{
+    if (m_texture && (m_texture->textureSize() == size))
+        return false;
+    m_texture = std::make_unique<HeatmapTexture>(size, fill);
+    m_material.setTexture(m_texture.get());
+    markDirty(QSGNode::DirtyMaterial);
+
+    return true;
+}
+
+void HeatmapNode::uploadColumns(const std::vector<HeatmapGraph::ColumnUpload> &columns)
+{
+    m_texture->uploadColumns(columns);
+    markDirty(QSGNode::DirtyMaterial);
+}
+
+void HeatmapNode::updateGeometry(const QRectF &bounds, int columnCount)
+{
+    auto width = static_cast<float>(m_texture->textureSize().width());
+    // the newest column is at the right border, the texture repeats to the left of it
+    auto right = columnCount / width;
+
+    QSGGeometry::updateTexturedRectGeometry(&m_geometry, bounds, QRectF(right - 1.0f, 1.0f,
+                                                                        1.0f, -1.0f));
+    markDirty(QSGNode::DirtyGeometry);
+}
+
+// graph
+
+HeatmapGraph::HeatmapGraph(QQuickItem *parent)
+  : QQuickItem(parent),
+    m_samplesModel(nullptr),
+    m_backgroundColor(Qt::black),
+    m_color(Qt::red),
+    m_upperBound(10.0f),
+    m_samplesPerColumn(DEFAULT_SAMPLES_PER_COLUMN),
+    m_columns(DEFAULT_COLUMNS),
+    m_bins(DEFAULT_BINS),
+    m_processedRows(0),
+    m_columnCount(0)
+{
+    setFlag(ItemHasContents, true);
+    updateColormap();
+    resetHistograms();
+}
+
+HeatmapGraph::~HeatmapGraph()
+{}
+
+void HeatmapGraph::setModel(const QVariant &newModel)
+{
+    auto modelptr = newModel.value<QAbstractListModel *>();
+
+    if (!modelptr)
+        qDebug() << "HeatmapGraph::setModel: nullptr received";
+    if (m_samplesModel)
+        disconnect(m_samplesModel, &QAbstractListModel::dataChanged,
+                   this,           &HeatmapGraph::onSampleDataChanged);
+    m_samplesModel = modelptr;
+    if (m_samplesModel)
+        connect(m_samplesModel, &QAbstractListModel::dataChanged,
+                this,           &HeatmapGraph::onSampleDataChanged);
+    emit modelChanged();
+
+    resetHistograms();
+}
+
+QVariant HeatmapGraph::model() const
+{
+    return QVariant::fromValue(m_samplesModel.data());
+}
+
+void HeatmapGraph::setBackgroundColor(const QColor &newColor)
+{
+    if (newColor == m_backgroundColor)
+        return;
+    m_backgroundColor = newColor;
+
+    emit backgroundColorChanged(newColor);
+
+    updateColormap();
+    markAllSlotsDirty();
+}
+
+QColor HeatmapGraph::backgroundColor() const
+{
+    return m_backgroundColor;
+}
+
+void HeatmapGraph::setColor(const QColor &newColor)
+{
+    if (newColor == m_color)
+        return;
+    m_color = newColor;
+
+    emit colorChanged(newColor);
+
+    updateColormap();
+    markAllSlotsDirty();
+}
+
+QColor HeatmapGraph::color() const
+{
+    return m_color;
+}
+
+void HeatmapGraph::setUpperBound(float newUpperBound)
+{
+    if (newUpperBound == m_upperBound)
+        return;
+    m_upperBound = newUpperBound;
+
+    emit upperBoundChanged(newUpperBound);
+
+    // the bins cover different ranges now
+    resetHistograms();
+}
+
+float HeatmapGraph::upperBound() const
+{
+    return m_upperBound;
+}
+
+void HeatmapGraph::setSamplesPerColumn(int newSamplesPerColumn)
+{
+    newSamplesPerColumn = std::max(newSamplesPerColumn, 1);
+    if (newSamplesPerColumn == m_samplesPerColumn)
+        return;
+    m_samplesPerColumn = newSamplesPerColumn;
+
+    emit samplesPerColumnChanged(m_samplesPerColumn);
+
+    resetHistograms();
+}
+
+int HeatmapGraph::samplesPerColumn() const
+{
+    return m_samplesPerColumn;
+}
+
+void HeatmapGraph::setColumns(int newColumns)
+{
+    newColumns = powerOfTwo(newColumns);
+    if (newColumns == m_columns)
+        return;
+    m_columns = newColumns;
+
+    emit columnsChanged(m_columns);
+
+    resetHistograms();
+}
+
+int HeatmapGraph::columns() const
+{
+    return m_columns;
+}
+
+void HeatmapGraph::setBins(int newBins)
+{
+    newBins = powerOfTwo(newBins);
+    if (newBins == m_bins)
+        return;
+    m_bins = newBins;
+
+    emit binsChanged(m_bins);
+
+    resetHistograms();
+}
+
+int HeatmapGraph::bins() const
+{
+    return m_bins;
+}
+
+void HeatmapGraph::updatePolish()
+{
+    // several samples usually end up in the same column, so the pixels are created only once per
+    // frame; without frames in between, uploading everything once is cheaper
+    if (m_uploads.size() + m_dirtySlots.size() > static_cast<std::size_t>(m_columns)) {
+        m_uploads.clear();
+        for (auto slot = 0; slot < m_columns; ++slot)
+            m_uploads.push_back(columnUpload(slot));
+    } else {
+        for (auto slot : m_dirtySlots)
+            m_uploads.push_back(columnUpload(slot));
+    }
+    for (auto slot : m_dirtySlots)
+        m_slotDirty[slot] = false;
+    m_dirtySlots.clear();
+    update();
+}
+
+QSGNode *HeatmapGraph::updatePaintNode(QSGNode *node, UpdatePaintNodeData *data)
+{
+    Q_UNUSED(data);
+
+    auto nodeptr = std::unique_ptr<HeatmapNode>(static_cast<HeatmapNode *>(node));
+    auto bounds = boundingRect();
+
+    if (bounds.isEmpty())
+        return nullptr;
+    if (!QOpenGLContext::currentContext()) {
+        qDebug() << "HeatmapGraph::updatePaintNode: only OpenGL is supported";
+
+        return nullptr;
+    }
+    if (!nodeptr)
+        nodeptr = std::make_unique<HeatmapNode>();
+    if (nodeptr->updateTexture(QSize(m_columns, m_bins), m_colormap.front())) {
+        // a new texture only contains the background
+        m_uploads.clear();
+        for (auto slot = 0; slot < m_columns; ++slot)
+            m_uploads.push_back(columnUpload(slot));
+    }
+    if (!m_uploads.empty())
+        nodeptr->uploadColumns(m_uploads);
+    m_uploads.clear();
+    nodeptr->updateGeometry(bounds, m_columnCount);
+
+    // stop managing the object
+    return nodeptr.release();
+}
+
+void HeatmapGraph::onSampleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
+                                       const QVector<int> &roles)
+{
+    Q_UNUSED(bottomRight);
+    Q_UNUSED(roles);
+
+    // samples are only expected to be appended
+    if (topLeft.row() < m_processedRows)
+        resetHistograms();
+    else
+        addSamples(m_samplesModel->rowCount());
+}
+
+void HeatmapGraph::resetHistograms()
+{
+    auto rowCount = m_samplesModel ? m_samplesModel->rowCount() : 0;
+    auto columnCount = (rowCount + m_samplesPerColumn - 1) / m_samplesPerColumn;
+    // older columns would be overwritten anyway
+    auto firstColumn = std::max(columnCount - m_columns, 0);
+
+    m_counts.assign(m_columns * m_bins, 0);
+    m_slotDirty.assign(m_columns, false);
+    m_dirtySlots.clear();
+    m_uploads.clear();
+    m_processedRows = firstColumn * m_samplesPerColumn;
+    m_columnCount = firstColumn;
+    addSamples(rowCount);
+    markAllSlotsDirty();
+}
+
+void HeatmapGraph::addSamples(int rowCount)
+{
+    auto *model = qobject_cast<GraphModel *>(m_samplesModel);
+
+    for (; m_processedRows < rowCount; ++m_processedRows) {
+        auto column = m_processedRows / m_samplesPerColumn;
+        auto slot = column & (m_columns - 1);
+        auto *histogram = &m_counts[slot * m_bins];
+
+        if (column == m_columnCount) {
+            // reuse the slot of the oldest column
+            std::fill(histogram, histogram + m_bins, 0);
+            ++m_columnCount;
+        }
+
+        auto value = model ? model->samples()[m_processedRows]
+                           : m_samplesModel->data(m_samplesModel->index(m_processedRows))
+                                           .value<float>();
+        auto bin = static_cast<int>(std::floor(value / m_upperBound * m_bins));
+
+        ++histogram[qBound(0, bin, m_bins - 1)];
+        markSlotDirty(slot);
+    }
+}
+
+void HeatmapGraph::updateColormap()
+{
+    // background over the color to white, so frequent values stand out
+    m_colormap.resize(COLORMAP_SIZE);
+    for (auto i = 0; i < COLORMAP_SIZE; ++i) {
+        auto t = i / static_cast<float>(COLORMAP_SIZE - 1);
+
+        m_colormap[i] = (t < 0.5f) ? mix(m_backgroundColor, m_color, t * 2.0f)
+                                   : mix(m_color, Qt::white, t * 2.0f - 1.0f);
+    }
+}
+
+void HeatmapGraph::markSlotDirty(int slot)
+{
+    if (!m_slotDirty[slot]) {
+        m_slotDirty[slot] = true;
+        m_dirtySlots.push_back(slot);
+        polish();
+    }
+}
+
+void HeatmapGraph::markAllSlotsDirty()
+{
+    for (auto slot = 0; slot < m_columns; ++slot)
+        markSlotDirty(slot);
+}
+
+HeatmapGraph::ColumnUpload HeatmapGraph::columnUpload(int slot) const
+{
+    auto upload = ColumnUpload{ slot, std::vector<uchar>() };
+    const auto *histogram = &m_counts[slot * m_bins];
+    // normalized per column, incomplete columns would look faded otherwise
+    auto maximum = *std::max_element(histogram, histogram + m_bins);
+
+    upload.pixels.reserve(m_bins * 4);
+    for (auto bin = 0; bin < m_bins; ++bin) {
+        // the square root keeps rare values visible
+        auto t = maximum ? std::sqrt(histogram[bin] / static_cast<float>(maximum)) : 0.0f;
+        auto color = m_colormap[qRound(t * (COLORMAP_SIZE - 1))];
+
+        upload.pixels.push_back(qRed(color));
+        upload.pixels.push_back(qGreen(color));
+        upload.pixels.push_back(qBlue(color));
+        upload.pixels.push_back(0xff);
+    }
+
+    return upload;
+}
+
+} // namespace fritzmon
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_HEATMAPGRAPH_HPP
+#define FRITZMON_HEATMAPGRAPH_HPP
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QPointer>
+
+#include <QtGui/QColor>
+
+#include <QtQuick/QQuickItem>
+
+#include <vector>
+
+namespace fritzmon {
+
+/* Shows the distribution of the sample values over time: each column is a histogram of the
+ * samples of one bucket, brighter cells being more frequent values.
+ *
+ * The histograms are kept in a ring buffer and updated as samples are appended; only the columns
+ * which changed are uploaded to the texture.
+ */
+class HeatmapGraph : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(QColor backgroundColor
+               READ backgroundColor
+               WRITE setBackgroundColor
+               NOTIFY backgroundColorChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+    Q_PROPERTY(QVariant model READ model WRITE setModel NOTIFY modelChanged)
+    Q_PROPERTY(float upperBound READ upperBound WRITE setUpperBound NOTIFY upperBoundChanged)
+    Q_PROPERTY(int samplesPerColumn
+               READ samplesPerColumn
+               WRITE setSamplesPerColumn
+               NOTIFY samplesPerColumnChanged)
+    Q_PROPERTY(int columns READ columns WRITE setColumns NOTIFY columnsChanged)
+    Q_PROPERTY(int bins READ bins WRITE setBins NOTIFY binsChanged)
+
+public:
+    struct ColumnUpload
+    {
+        int slot;                  //< column of the texture
+        std::vector<uchar> pixels; //< RGBA, lowest bin first
+    };
+
+    HeatmapGraph(QQuickItem *parent=nullptr);
+    ~HeatmapGraph();
+
+    // the model is shared with other graphs, so its ownership is not taken
+    void setModel(const QVariant &newModel);
+    QVariant model() const;
+
+    void setBackgroundColor(const QColor &newColor);
+    QColor backgroundColor() const;
+
+    void setColor(const QColor &newColor);
+    QColor color() const;
+
+    void setUpperBound(float newUpperBound);
+    float upperBound() const;
+
+    void setSamplesPerColumn(int newSamplesPerColumn);
+    int samplesPerColumn() const;
+
+    // number of columns shown, rounded up to a power of two
+    void setColumns(int newColumns);
+    int columns() const;
+
+    // number of value ranges per column, rounded up to a power of two
+    void setBins(int newBins);
+    int bins() const;
+
+Q_SIGNALS:
+    void backgroundColorChanged(const QColor &newColor);
+    void binsChanged(int newBins);
+    void colorChanged(const QColor &newColor);
+    void columnsChanged(int newColumns);
+    void modelChanged();
+    void samplesPerColumnChanged(int newSamplesPerColumn);
+    void upperBoundChanged(float newUpperBound);
+
+protected:
+    void updatePolish() override;
+    QSGNode *updatePaintNode(QSGNode *node, UpdatePaintNodeData *data) override;
+
+private:
+    Q_SLOT void onSampleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
+                                    const QVector<int> &roles);
+    void resetHistograms();
+    void addSamples(int rowCount);
+    void updateColormap();
+    void markSlotDirty(int slot);
+    void markAllSlotsDirty();
+    ColumnUpload columnUpload(int slot) const;
+
+    QPointer<QAbstractListModel> m_samplesModel;
+    QColor m_backgroundColor;
+    QColor m_color;
+    float m_upperBound;
+    int m_samplesPerColumn;
+    int m_columns;
+    int m_bins;
+    std::vector<quint32> m_counts; //< m_columns histograms of m_bins each, a ring buffer
+    int m_processedRows;
+    int m_columnCount;             //< columns started so far, the newest one may be incomplete
+    std::vector<QRgb> m_colormap;
+    std::vector<int> m_dirtySlots;
+    std::vector<bool> m_slotDirty;
+    std::vector<ColumnUpload> m_uploads; //< prepared while polishing, taken by the render thread
+
+    Q_DISABLE_COPY(HeatmapGraph)
+};
+
+} // namespace fritzmon
+
+#endif // FRITZMON_HEATMAPGRAPH_HPP
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace fritzmon {
+
+static constexpr auto HALF_SUB_BUCKET_COUNT = Histogram::SUB_BUCKET_COUNT / 2;
+
+static int highestBit(quint64 value)
+{
+    auto bit = -1;
+
+    for (; value; value >>= 1)
+        ++bit;
+
+    return bit;
+}
+
+Histogram::Histogram()
+  : m_counts(),
+    m_count(0),
+    m_minimum(std::numeric_limits<qint64>::max()),
+    m_maximum(0),
+    m_sum(0.0)
+{}
+
+void Histogram::record(qint64 value)
+{
+    value = std::max<qint64>(value, 0);
+
+    auto index = static_cast<std::size_t>(bucketIndex(value));
+
+    if (index >= m_counts.size())
+        m_counts.resize(index + 1, 0);
+    ++m_counts[index];
+    ++m_count;
+    m_minimum = std::min(m_minimum, value);
+    m_maximum = std::max(m_maximum, value);
+    m_sum += value;
+}
+
+void Histogram::reset()
+{
+    *this = Histogram();
+}
+
+quint64 Histogram::count() const
+{
+    return m_count;
+}
+
+qint64 Histogram::minimum() const
+{
+    return m_count ? m_minimum : 0;
+}
+
+qint64 Histogram::maximum() const
+{
+    return m_maximum;
+}
+
+double Histogram::mean() const
+{
+    return m_count ? m_sum / m_count : 0.0;
+}
+
+qint64 Histogram::valueAtPercentile(double percentile) const
+{
+    if (!m_count)
+        return 0;
+
+    auto fraction = std::min(std::max(percentile, 0.0), 100.0) / 100.0;
+    auto rank = std::max<quint64>(static_cast<quint64>(std::ceil(fraction * m_count)), 1);
+    auto total = quint64(0);
+
+    for (auto index = std::size_t(0); index < m_counts.size(); ++index) {
+        total += m_counts[index];
+        if (total >= rank)
+            return std::min(highestEquivalentValue(static_cast<int>(index)), m_maximum);
+    }
+
+    return m_maximum;
+}
+
+// values below SUB_BUCKET_COUNT get a bucket each, above that the value is shifted until it fits
+// into the upper half of the sub-buckets, and the shift selects the group of buckets
+int Histogram::bucketIndex(qint64 value)
+{
+    auto shift = std::max(highestBit(static_cast<quint64>(value)) - (SUB_BUCKET_BITS - 1), 0);
+
+    return shift * HALF_SUB_BUCKET_COUNT + static_cast<int>(value >> shift);
+}
+
+qint64 Histogram::highestEquivalentValue(int index)
+{
+    if (index < SUB_BUCKET_COUNT)
+        return index;
+
+    auto shift = index / HALF_SUB_BUCKET_COUNT - 1;
+    auto subBucket = qint64(index - shift * HALF_SUB_BUCKET_COUNT);
+
+    return ((subBucket + 1) << shift) - 1;
+}
+
+} // namespace fritzmon
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_HISTOGRAM_HPP
+#define FRITZMON_HISTOGRAM_HPP
+
+#include <QtCore/QtGlobal>
+
+#include <vector>
+
+namespace fritzmon {
+
+/* A log-linear histogram in the style of HdrHistogram.
+ *
+ * Every power of two is divided into ``SUB_BUCKET_COUNT / 2`` linear buckets, so a recorded value
+ * is reported with a relative error of at most 1 / 16, whatever its magnitude.  Recording is a
+ * couple of shifts and an increment, the memory grows with the largest recorded value only.
+ */
+class Histogram
+{
+public:
+    static constexpr auto SUB_BUCKET_BITS = 5;
+    static constexpr auto SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+
+    Histogram();
+
+    void record(qint64 value); //< negative values are recorded as 0
+    void reset();
+
+    quint64 count() const;
+    qint64 minimum() const;
+    qint64 maximum() const;
+    double mean() const;
+    // the highest value equivalent to the one at ``percentile`` (0 to 100)
+    qint64 valueAtPercentile(double percentile) const;
+
+private:
+    static int bucketIndex(qint64 value);
+    static qint64 highestEquivalentValue(int index);
+
+    std::vector<quint64> m_counts;
+    quint64 m_count;
+    qint64 m_minimum;
+    qint64 m_maximum;
+    double m_sum;
+};
+
+} // namespace fritzmon
+
+#endif // FRITZMON_HISTOGRAM_HPP
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Metrics.hpp"
+
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+namespace fritzmon {
+
+static constexpr auto *ACTIONS_KEY = "actions";
+static constexpr auto *COMPLETE_KEY = "complete";
+static constexpr auto *COUNT_KEY = "count";
+static constexpr auto *FIRST_BYTE_KEY = "firstByte";
+static constexpr auto *MAXIMUM_KEY = "max";
+static constexpr auto *MEAN_KEY = "mean";
+static constexpr auto *MINIMUM_KEY = "min";
+static constexpr auto *P50_KEY = "p50";
+static constexpr auto *P90_KEY = "p90";
+static constexpr auto *P99_KEY = "p99";
+static constexpr auto *POLL_JITTER_KEY = "pollJitter";
+static constexpr auto *QUEUED_KEY = "queued";
+
+static QVariantMap summarize(const Histogram &histogram)
+{
+    auto summary = QVariantMap();
+
+    summary[COUNT_KEY] = histogram.count();
+    summary[MINIMUM_KEY] = histogram.minimum();
+    summary[MEAN_KEY] = histogram.mean();
+    summary[P50_KEY] = histogram.valueAtPercentile(50.0);
+    summary[P90_KEY] = histogram.valueAtPercentile(90.0);
+    summary[P99_KEY] = histogram.valueAtPercentile(99.0);
+    summary[MAXIMUM_KEY] = histogram.maximum();
+
+    return summary;
+}
+
+static void writeLine(QTextStream &out, const QString &name, const Histogram &histogram)
+{
+    out << name << ": n=" << histogram.count() << " min=" << histogram.minimum()
+        << " p50=" << histogram.valueAtPercentile(50.0)
+        << " p90=" << histogram.valueAtPercentile(90.0)
+        << " p99=" << histogram.valueAtPercentile(99.0)
+        << " max=" << histogram.maximum() << " us\n";
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+
+    return metrics;
+}
+
+Metrics::Metrics()
+  : QObject(),
+    m_requestLatencies(),
+    m_pollJitter()
+{}
+
+Metrics::RequestLatency &Metrics::requestLatency(const QString &actionName)
+{
+    return m_requestLatencies[actionName];
+}
+
+Histogram &Metrics::pollJitter()
+{
+    return m_pollJitter;
+}
+
+QVariantMap Metrics::summary() const
+{
+    auto actions = QVariantMap();
+
+    for (auto latency = m_requestLatencies.cbegin(); latency != m_requestLatencies.cend();
+         ++latency) {
+        auto action = QVariantMap();
+
+        action[QUEUED_KEY] = summarize(latency->queued);
+        action[FIRST_BYTE_KEY] = summarize(latency->firstByte);
+        action[COMPLETE_KEY] = summarize(latency->complete);
+        actions[latency.key()] = action;
+    }
+
+    auto summary = QVariantMap();
+
+    summary[ACTIONS_KEY] = actions;
+    summary[POLL_JITTER_KEY] = summarize(m_pollJitter);
+
+    return summary;
+}
+
+QString Metrics::report() const
+{
+    auto text = QString();
+    QTextStream out(&text);
+    auto actionNames = m_requestLatencies.keys();
+
+    actionNames.sort();
+    for (const auto &actionName : actionNames) {
+        const auto &latency = *m_requestLatencies.constFind(actionName);
+
+        writeLine(out, actionName + "/" + QUEUED_KEY, latency.queued);
+        writeLine(out, actionName + "/" + FIRST_BYTE_KEY, latency.firstByte);
+        writeLine(out, actionName + "/" + COMPLETE_KEY, latency.complete);
+    }
+    writeLine(out, POLL_JITTER_KEY, m_pollJitter);
+    out.flush();
+
+    return text;
+}
+
+void Metrics::reset()
+{
+    m_requestLatencies.clear();
+    m_pollJitter.reset();
+}
+
+} // namespace fritzmon
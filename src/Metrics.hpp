@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_METRICS_HPP
+#define FRITZMON_METRICS_HPP
+
+#include "Histogram.hpp"
+
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QVariantMap>
+
+namespace fritzmon {
+
+/* Latency and timing histograms of the running application, all values in microseconds.
+ *
+ * For every SOAP action, the time spent in the session queue, the time until the first byte of
+ * the reply (the router's share) and the time until the reply is complete are recorded.  The
+ * deviation of the poll timer from its period is recorded as jitter.  The registry is available
+ * to QML as the ``metrics`` context property.
+ */
+class Metrics : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct RequestLatency
+    {
+        Histogram queued;    //< from the invocation until the request is sent
+        Histogram firstByte; //< from sending until the first byte of the reply
+        Histogram complete;  //< from sending until the reply is complete
+    };
+
+    static Metrics &instance();
+
+    RequestLatency &requestLatency(const QString &actionName);
+    Histogram &pollJitter();
+
+    // {"actions": {name: {"queued": ..., "firstByte": ..., "complete": ...}}, "pollJitter": ...}
+    Q_INVOKABLE QVariantMap summary() const;
+    Q_INVOKABLE QString report() const;
+    Q_INVOKABLE void reset();
+
+private:
+    Metrics();
+
+    QHash<QString, RequestLatency> m_requestLatencies; //< keyed by the action name
+    Histogram m_pollJitter;
+
+    Q_DISABLE_COPY(Metrics)
+};
+
+} // namespace fritzmon
+
+#endif // FRITZMON_METRICS_HPP
@@ -28,7 +28,7 @@
 
 #include "Graph.hpp"
 #include "GraphModel.hpp"
-#include "upnp/Device.hpp"
+#include "Metrics.hpp"
 #include "upnp/Service.hpp"
 
 #include <QtCore/QCoreApplication>
@@ -36,9 +36,12 @@
 #include <QtQml/QQmlContext>
 
 #include <algorithm>
+#include <cstdlib>
 
 namespace fritzmon {
 
+using tr064::WANCommonInterfaceConfig;
+
 static constexpr auto *ORG_NAME = "Purple Kraken Software";
 static constexpr auto *ORG_DOMAIN = "purplekraken.com";
 static constexpr auto *APP_NAME = "fritzmon";
@@ -48,25 +51,30 @@ static constexpr auto *DEVICE_DEFAULT_HOST = "fritz.box";
 static constexpr auto DEVICE_DEFAULT_PORT = 49000;
 static constexpr auto DEVICE_DEFAULT_ENCRYPTION = false;
 static constexpr auto *DEVICE_DESCRIPTION_DOCUMENT = "/igddesc.xml";
+static constexpr auto INITIAL_DISCOVERY_BACKOFF = 1000; //< in ms
+static constexpr auto MAXIMUM_DISCOVERY_BACKOFF = 60000; //< in ms
 static constexpr auto *DOWNSTREAM_DATA_PROPERTY = "downstreamData";
 static constexpr auto *DOWNSTREAM_GRAPH = "downstreamGraph";
-static constexpr auto *GET_ADDON_INFOS_ACTION_NAME = "GetAddonInfos";
-static constexpr auto *GET_COMMON_LINK_PROPERTIES_ACTION_NAME = "GetCommonLinkProperties";
-static constexpr auto *NEW_BYTE_RECEIVE_RATE_ARGUMENT = "NewByteReceiveRate";
-static constexpr auto *NEW_BYTE_SEND_RATE_ARGUMENT = "NewByteSendRate";
-static constexpr auto *NEW_LAYER_1_DOWNSTREAM_MAX_BIT_RATE = "NewLayer1DownstreamMaxBitRate";
-static constexpr auto *NEW_LAYER_1_UPSTREAM_MAX_BIT_RATE = "NewLayer1UpstreamMaxBitRate";
+static constexpr auto *METRICS_PROPERTY = "metrics";
+static constexpr auto *PHYSICAL_LINK_STATUS_VARIABLE = "PhysicalLinkStatus";
+static constexpr auto *PHYSICAL_LINK_UP = "Up";
+static constexpr auto *UPDATE_PERIOD_PROPERTY = "updatePeriod";
 static constexpr auto *UPSTREAM_DATA_PROPERTY = "upstreamData";
 static constexpr auto *UPSTREAM_GRAPH = "upstreamGraph";
 static constexpr auto *WAN_COMMON_INTERFACE_CONFIG_SERVICE_TYPE = "urn:schemas-upnp-org:service:WANCommonInterfaceConfig:1";
-static constexpr auto *WAN_DEVICE_TYPE = "urn:schemas-upnp-org:device:WANDevice:1";
 
 MonitorApp::MonitorApp(QObject *parent)
   : QObject(parent),
-    m_appState(AppState::Initializing),
+    m_sessions(),
+    m_deviceFinder(m_sessions),
+    m_deviceDescriptionURL(),
+    m_discoveryBackoff(INITIAL_DISCOVERY_BACKOFF),
     m_downstreamData(new GraphModel),
     m_updatePeriod(DEFAULT_UPDATE_PERIOD),
-    m_upstreamData(new GraphModel)
+    m_upstreamData(new GraphModel),
+    m_wanCommonConfig(),
+    m_wanDeviceName(),
+    m_physicalLinkStatus()
 {
     QCoreApplication::setOrganizationName(ORG_NAME);
     QCoreApplication::setOrganizationDomain(ORG_DOMAIN);
@@ -80,135 +88,211 @@ MonitorApp::MonitorApp(QObject *parent)
     if (!m_settings.useSSL())
         m_settings.setUseSSL(DEVICE_DEFAULT_ENCRYPTION);
 
-    auto deviceDescriptionURL = m_settings.deviceURL();
+    m_deviceDescriptionURL = m_settings.deviceURL();
+    m_deviceDescriptionURL.setPath(DEVICE_DESCRIPTION_DOCUMENT);
 
-    deviceDescriptionURL.setPath(DEVICE_DESCRIPTION_DOCUMENT);
-    connect(&m_deviceFinder, &upnp::DeviceFinder::deviceAdded, this, &MonitorApp::onDeviceAdded);
-    m_deviceFinder.findDevice(deviceDescriptionURL);
+    // the discovery may find the router under another authority than the configured one
+    m_sessions.setSessionCreated([this](net::NetworkSession *session) {
+        session->setCredentials(m_settings.userName(), m_settings.password());
+        // a recovered router is noticed within one update period
+        session->circuitBreaker().setMaximumBackoff(m_updatePeriod);
+        connect(session, &net::NetworkSession::reachableChanged,
+                this,    &MonitorApp::onReachableChanged);
+    });
+    connect(&m_updateTimer, &QTimer::timeout, this, &MonitorApp::onUpdateTimeout);
+    // overlaps the shader compilation with the device discovery
+    Graph::prepareShaders();
+    // only the WANCommonInterfaceConfig is used, its description is loaded by the first invocation
+    m_deviceFinder.setLazyServiceDescriptions(m_settings.lazyDescriptions());
+    // polling starts as soon as the one service needed is ready, not when the whole tree is built
+    connect(&m_deviceFinder, &upnp::DeviceFinder::serviceReady, this, &MonitorApp::onServiceReady);
+    connect(&m_deviceFinder, &upnp::DeviceFinder::deviceRemoved,
+            this,            &MonitorApp::onDeviceRemoved);
+    connect(&m_deviceFinder, &upnp::DeviceFinder::searchComplete,
+            this,            &MonitorApp::onSearchComplete);
+    findDevice();
 
     auto *rootContext = m_view.rootContext();
 
     rootContext->setContextProperty(DOWNSTREAM_DATA_PROPERTY, QVariant::fromValue(m_downstreamData));
     rootContext->setContextProperty(UPSTREAM_DATA_PROPERTY, QVariant::fromValue(m_upstreamData));
+    rootContext->setContextProperty(UPDATE_PERIOD_PROPERTY, m_updatePeriod);
+    rootContext->setContextProperty(METRICS_PROPERTY, &Metrics::instance());
+    connect(qApp, &QCoreApplication::aboutToQuit, []() {
+        qDebug().noquote() << "MonitorApp: metrics:\n" + Metrics::instance().report();
+    });
     m_view.setResizeMode(QQuickView::SizeRootObjectToView);
     m_view.setSource(QUrl(APPUI_QML_PATH));
     m_view.show();
 }
 
-void MonitorApp::onDeviceAdded(upnp::Device *device)
+void MonitorApp::findDevice()
 {
-    if (device->type() == WAN_DEVICE_TYPE) {
-        auto end = std::end(device->services());
-        auto service = std::find_if(std::begin(device->services()), end, [](const std::unique_ptr<upnp::Service> &servicePtr){
-            return servicePtr->serviceTypeIdentifier() == WAN_COMMON_INTERFACE_CONFIG_SERVICE_TYPE;
-        });
+    m_discoveryTimer.start();
+    if (m_settings.useDiscovery())
+        m_deviceFinder.startFind();
+    else
+        m_deviceFinder.findDevice(m_deviceDescriptionURL);
+}
 
-        if (service != end) {
-            m_wanCommonConfigService = service->get();
-            connect(m_wanCommonConfigService, &upnp::Service::actionInvoked,
-                    this,                     &MonitorApp::onServiceActionInvoked);
-            connect(&m_updateTimer, &QTimer::timeout, this, &MonitorApp::onUpdateTimeout);
-            m_wanCommonConfigService->invokeAction(GET_COMMON_LINK_PROPERTIES_ACTION_NAME,
-                                                   QVariantMap());
-            m_updateTimer.start(m_updatePeriod);
-        }
-    } else
-        for (const auto &subdevice : device->children())
-            onDeviceAdded(subdevice.get());
+void MonitorApp::onServiceReady(const QString &udn, upnp::Service *service)
+{
+    if (m_wanCommonConfig
+            || (service->serviceTypeIdentifier() != WAN_COMMON_INTERFACE_CONFIG_SERVICE_TYPE))
+        return;
+
+    qDebug() << "MonitorApp::onServiceReady:" << service->id() << "ready after"
+             << m_discoveryTimer.elapsed() << "ms";
+    m_wanCommonConfig.reset(new tr064::WANCommonInterfaceConfig(service));
+    m_wanDeviceName = udn;
+    m_physicalLinkStatus.clear();
+    m_wanCommonConfig->getCommonLinkProperties([this](const auto &response) {
+        onLinkPropertiesReceived(response);
+    });
+    // the link properties are only fetched again when the router reports a new link
+    connect(service, &upnp::Service::stateVariableChanged,
+            this,    &MonitorApp::onStateVariableChanged);
+    service->subscribe();
+    m_updateTimer.start(m_updatePeriod);
+    m_tickTimer.start();
 }
 
-void MonitorApp::onServiceActionInvoked(const QVariantMap &outputArguments,
-                                        const QVariant &returnValue)
+void MonitorApp::onDeviceRemoved(const QString &udn)
 {
-    qDebug() << "MonitorApp::onServiceActionInvoked: return value:" << returnValue;
-
-    if (outputArguments.empty())
-        qDebug() << "MonitorApp::onServiceActionInvoked: no output arguments";
-    else {
-        switch (m_appState) {
-        case AppState::Initializing:
-            {
-            auto rootObject = m_view.rootObject();
-
-            if (outputArguments.contains(NEW_LAYER_1_DOWNSTREAM_MAX_BIT_RATE)) {
-                auto value = outputArguments[NEW_LAYER_1_DOWNSTREAM_MAX_BIT_RATE].toString()
-                                                                                 .toFloat();
-
-                qDebug() << "MonitorApp::onServiceActionInvoked: max downstream bit rate:" << value;
-
-                auto *graph = rootObject->findChild<Graph *>(DOWNSTREAM_GRAPH);
-
-                if (graph)
-                    graph->setUpperBound(value / 1024.0f); // convert bit to kbit
-                else
-                    qDebug() << "MonitorApp::onServiceActionInvoked: failed to find"
-                             << DOWNSTREAM_GRAPH;
-            } else
-                qDebug() << "MonitorApp::onServiceActionInvoked: no argument named"
-                         << NEW_LAYER_1_DOWNSTREAM_MAX_BIT_RATE;
-            if (outputArguments.contains(NEW_LAYER_1_UPSTREAM_MAX_BIT_RATE)) {
-                auto value = outputArguments[NEW_LAYER_1_UPSTREAM_MAX_BIT_RATE].toString()
-                                                                               .toFloat();
-
-                qDebug() << "MonitorApp::onServiceActionInvoked: max upstream bit rate:" << value;
-
-                auto *graph = rootObject->findChild<Graph *>(UPSTREAM_GRAPH);
-
-                if (graph)
-                    graph->setUpperBound(value / 1024.0f); // convert bit to kbit
-                else
-                    qDebug() << "MonitorApp::onServiceActionInvoked: failed to find"
-                             << UPSTREAM_GRAPH;
-            } else
-                qDebug() << "MonitorApp::onServiceActionInvoked: no argument named"
-                         << NEW_LAYER_1_DOWNSTREAM_MAX_BIT_RATE;
-            m_appState = AppState::Polling;
-            break;
-            }
-        case AppState::Polling:
-            if (outputArguments.contains(NEW_BYTE_RECEIVE_RATE_ARGUMENT)) {
-                auto value = outputArguments[NEW_BYTE_RECEIVE_RATE_ARGUMENT].toString().toFloat();
-
-                m_downstreamData->addSample(value * 8.0f / 1024.0f); // convert B to kbit
-                qDebug() << "MonitorApp::onServiceActionInvoked: downstream byte rate:" << value;
-            } else
-                qDebug() << "MonitorApp::onServiceActionInvoked: no argument named"
-                         << NEW_BYTE_RECEIVE_RATE_ARGUMENT;
-            if (outputArguments.contains(NEW_BYTE_SEND_RATE_ARGUMENT)) {
-                auto value = outputArguments[NEW_BYTE_SEND_RATE_ARGUMENT].toString().toFloat();
-
-                m_upstreamData->addSample(value * 8.0f / 1024.0f); // convert B to kbit
-                qDebug() << "MonitorApp::onServiceActionInvoked: upstream byte rate:" << value;
-            } else
-                qDebug() << "MonitorApp::onServiceActionInvoked: no argument named"
-                         << NEW_BYTE_SEND_RATE_ARGUMENT;
-            break;
-        }
+    // other devices found by the discovery do not affect the service in use
+    if (!m_wanCommonConfig || (udn != m_wanDeviceName))
+        return;
+
+    // the service is destroyed along with its device
+    m_updateTimer.stop();
+    m_wanCommonConfig.reset();
+    m_wanDeviceName.clear();
+}
+
+void MonitorApp::onReachableChanged(bool reachable)
+{
+    if (!reachable) {
+        qDebug() << "MonitorApp::onReachableChanged: router unreachable, polling suspended";
+        m_updateTimer.stop();
+
+        return;
     }
+
+    // the router may have come back with a different configuration, so it is discovered anew
+    qDebug() << "MonitorApp::onReachableChanged: router reachable again";
+    findDevice();
+}
+
+void MonitorApp::onSearchComplete()
+{
+    // the router found by SSDP may be reached under another authority than the configured one
+    auto session = m_deviceFinder.session();
+
+    if (session)
+        qDebug() << "MonitorApp::onSearchComplete:" << session->requests() << "requests,"
+                 << session->handshakes() << "handshakes," << session->handshakesAvoided()
+                 << "handshakes avoided," << session->authenticator().challenges()
+                 << "digest challenges";
+    if (m_wanCommonConfig) {
+        m_discoveryBackoff = INITIAL_DISCOVERY_BACKOFF;
+
+        return;
+    }
+    // while the router is unreachable, its recovery starts the discovery instead; without a
+    // location, there is no host which could recover
+    if (!session || session->isReachable()) {
+        qDebug() << "MonitorApp::onSearchComplete: no WAN device found, retrying in"
+                 << m_discoveryBackoff << "ms";
+        QTimer::singleShot(m_discoveryBackoff, this, [this]() {
+            if (!m_wanCommonConfig && !m_deviceFinder.searching())
+                findDevice();
+        });
+        m_discoveryBackoff = std::min(m_discoveryBackoff * 2, MAXIMUM_DISCOVERY_BACKOFF);
+    }
+}
+
+void MonitorApp::onLinkPropertiesReceived(
+        const WANCommonInterfaceConfig::GetCommonLinkPropertiesResponse &response)
+{
+    auto rootObject = m_view.rootObject();
+    auto downstreamRate = static_cast<float>(response.newLayer1DownstreamMaxBitRate);
+    auto upstreamRate = static_cast<float>(response.newLayer1UpstreamMaxBitRate);
+
+    qDebug() << "MonitorApp::onLinkPropertiesReceived: max downstream bit rate:" << downstreamRate;
+    qDebug() << "MonitorApp::onLinkPropertiesReceived: max upstream bit rate:" << upstreamRate;
+
+    auto *downstreamGraph = rootObject->findChild<Graph *>(DOWNSTREAM_GRAPH);
+
+    if (downstreamGraph)
+        downstreamGraph->setUpperBound(downstreamRate / 1024.0f); // convert bit to kbit
+    else
+        qDebug() << "MonitorApp::onLinkPropertiesReceived: failed to find" << DOWNSTREAM_GRAPH;
+
+    auto *upstreamGraph = rootObject->findChild<Graph *>(UPSTREAM_GRAPH);
+
+    if (upstreamGraph)
+        upstreamGraph->setUpperBound(upstreamRate / 1024.0f); // convert bit to kbit
+    else
+        qDebug() << "MonitorApp::onLinkPropertiesReceived: failed to find" << UPSTREAM_GRAPH;
+}
+
+void MonitorApp::onAddonInfosReceived(const WANCommonInterfaceConfig::GetAddonInfosResponse &response)
+{
+    // convert B to kbit
+    m_downstreamData->addSample(response.newByteReceiveRate * 8.0f / 1024.0f);
+    m_upstreamData->addSample(response.newByteSendRate * 8.0f / 1024.0f);
+    qDebug() << "MonitorApp::onAddonInfosReceived: downstream byte rate:"
+             << response.newByteReceiveRate << "upstream byte rate:" << response.newByteSendRate;
 }
 
 void MonitorApp::onUpdateTimeout()
 {
-    static auto noArg = QVariantMap();
-
-    auto result = m_wanCommonConfigService->invokeAction(GET_ADDON_INFOS_ACTION_NAME, noArg);
-
-    if (result != upnp::Service::InvokeActionResult::Success)
-        auto resultString = QString();
-
-        switch (result) {
-        case upnp::Service::InvokeActionResult::Success:
-            break;
-        case upnp::Service::InvokeActionResult::InvalidAction:
-            qDebug() << "MonitorApp::onDeviceAdded: invalid action";
-            break;
-        case upnp::Service::InvokeActionResult::InvocationFailed:
-            qDebug() << "MonitorApp::onDeviceAdded: invocation failed";
-            break;
-        case upnp::Service::InvokeActionResult::PendingAction:
-            qDebug() << "MonitorApp::onDeviceAdded: action pending";
-            break;
-        }
+    if (!m_wanCommonConfig)
+        return;
+
+    auto interval = m_tickTimer.nsecsElapsed() / 1000;
+
+    m_tickTimer.start();
+    Metrics::instance().pollJitter().record(std::abs(interval - m_updatePeriod * 1000));
+
+    // a slow reply no longer blocks the next tick, the invocations are queued by the service
+    auto result = m_wanCommonConfig->getAddonInfos([this](const auto &response) {
+        onAddonInfosReceived(response);
+    });
+
+    switch (result) {
+    case upnp::Service::InvokeActionResult::Success:
+        break;
+    case upnp::Service::InvokeActionResult::InvalidAction:
+        qDebug() << "MonitorApp::onUpdateTimeout: invalid action";
+        break;
+    case upnp::Service::InvokeActionResult::InvalidArgument:
+        qDebug() << "MonitorApp::onUpdateTimeout: invalid argument";
+        break;
+    case upnp::Service::InvokeActionResult::InvocationFailed:
+        qDebug() << "MonitorApp::onUpdateTimeout: invocation failed";
+        break;
+    case upnp::Service::InvokeActionResult::PendingAction:
+        qDebug() << "MonitorApp::onUpdateTimeout: too many actions pending";
+        break;
+    }
+}
+
+void MonitorApp::onStateVariableChanged(const QString &name, const QVariant &value)
+{
+    if (!m_wanCommonConfig || (name != PHYSICAL_LINK_STATUS_VARIABLE))
+        return;
+
+    auto previous = m_physicalLinkStatus;
+
+    m_physicalLinkStatus = value.toString();
+    qDebug() << "MonitorApp::onStateVariableChanged: physical link" << m_physicalLinkStatus;
+    // the first value comes with the link properties themselves, only a new link is refetched
+    if (!previous.isEmpty() && (previous != m_physicalLinkStatus)
+        && (m_physicalLinkStatus == PHYSICAL_LINK_UP))
+        m_wanCommonConfig->getCommonLinkProperties([this](const auto &response) {
+            onLinkPropertiesReceived(response);
+        });
 }
 
 } // namespace fritzmon
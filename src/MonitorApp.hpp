@@ -29,13 +29,19 @@
 
 #include "Settings.hpp"
 
+#include "net/NetworkSession.hpp"
+#include "tr064/WANCommonInterfaceConfig.hpp"
 #include "upnp/DeviceFinder.hpp"
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 #include <QtCore/QTimer>
+#include <QtCore/QUrl>
 
 #include <QtQuick/QQuickView>
 
+#include <memory>
+
 namespace fritzmon {
 
 namespace upnp {
@@ -53,22 +59,32 @@ public:
     explicit MonitorApp(QObject *parent = nullptr);
 
 private:
-    Q_SLOT void onDeviceAdded(upnp::Device *device);
-    Q_SLOT void onServiceActionInvoked(const QVariantMap &outputArguments,
-                                       const QVariant &returnValue);
+    void findDevice();
+    Q_SLOT void onServiceReady(const QString &udn, upnp::Service *service);
+    Q_SLOT void onDeviceRemoved(const QString &udn);
+    Q_SLOT void onReachableChanged(bool reachable);
+    Q_SLOT void onSearchComplete();
     Q_SLOT void onUpdateTimeout();
+    Q_SLOT void onStateVariableChanged(const QString &name, const QVariant &value);
+    void onLinkPropertiesReceived(
+            const tr064::WANCommonInterfaceConfig::GetCommonLinkPropertiesResponse &response);
+    void onAddonInfosReceived(
+            const tr064::WANCommonInterfaceConfig::GetAddonInfosResponse &response);
 
-    enum class AppState {
-        Initializing,
-        Polling
-    } m_appState;
+    net::SessionPool m_sessions; //< must be constructed before the device finder
     upnp::DeviceFinder m_deviceFinder;
+    QUrl m_deviceDescriptionURL;
+    int m_discoveryBackoff; //< until the next discovery, if the last one found nothing
     GraphModel *m_downstreamData;
     Settings m_settings;
     int m_updatePeriod;
     QTimer m_updateTimer;
+    QElapsedTimer m_tickTimer; //< for the jitter of ``m_updateTimer``
+    QElapsedTimer m_discoveryTimer; //< for the time until the service is ready
     GraphModel *m_upstreamData;
-    upnp::Service *m_wanCommonConfigService;
+    std::unique_ptr<tr064::WANCommonInterfaceConfig> m_wanCommonConfig;
+    QString m_wanDeviceName; //< UDN of the root device owning ``m_wanCommonConfig``
+    QString m_physicalLinkStatus; //< empty until the first value is known
     QQuickView m_view;
 };
 
@@ -26,6 +26,7 @@
 
 #include "Settings.hpp"
 
+#include <QtCore/QByteArray>
 #include <QtCore/QDebug>
 #include <QtCore/QSettings>
 #include <QtCore/QTextCodec>
@@ -35,15 +36,28 @@ namespace fritzmon {
 static constexpr auto *DEFAULT_HOST = "";
 static constexpr auto DEFAULT_PORT = 0;
 static constexpr auto DEFAULT_ENCRYPTION = false;
+static constexpr auto DEFAULT_DISCOVERY = false;
+static constexpr auto DEFAULT_LAZY_DESCRIPTIONS = false;
 static constexpr auto *TEXT_ENCODING = "UTF-8";
 static constexpr auto *CONNECTION_GROUP = "connection";
 static constexpr auto *HOST_KEY = "host";
 static constexpr auto *PORT_KEY = "port";
 static constexpr auto *USE_SSL_KEY = "use_ssl";
+static constexpr auto *USER_NAME_KEY = "user_name";
+static constexpr auto *USE_DISCOVERY_KEY = "use_ssdp";
+static constexpr auto *LAZY_DESCRIPTIONS_KEY = "lazy_descriptions";
 static constexpr auto *HTTP_SCHEME = "http";
 static constexpr auto *HTTPS_SCHEME = "https";
-
-Settings::Settings(QObject *parent) : QObject(parent)
+// the password is not stored with the configuration, but given anew for each session
+static constexpr auto *PASSWORD_VARIABLE = "FRITZMON_PASSWORD";
+
+Settings::Settings(QObject *parent)
+  : QObject(parent),
+    m_deviceURL(),
+    m_userName(),
+    m_password(),
+    m_useDiscovery(DEFAULT_DISCOVERY),
+    m_lazyDescriptions(DEFAULT_LAZY_DESCRIPTIONS)
 {}
 
 void Settings::setHost(const QString &newHost)
@@ -82,6 +96,54 @@ bool Settings::useSSL() const
     return m_deviceURL.scheme() == HTTPS_SCHEME;
 }
 
+void Settings::setUserName(const QString &newUserName)
+{
+    m_userName = newUserName;
+
+    emit userNameChanged(newUserName);
+}
+
+QString Settings::userName() const
+{
+    return m_userName;
+}
+
+void Settings::setPassword(const QString &newPassword)
+{
+    m_password = newPassword;
+
+    emit passwordChanged(newPassword);
+}
+
+QString Settings::password() const
+{
+    return m_password;
+}
+
+void Settings::setUseDiscovery(bool newUseDiscovery)
+{
+    m_useDiscovery = newUseDiscovery;
+
+    emit useDiscoveryChanged(newUseDiscovery);
+}
+
+bool Settings::useDiscovery() const
+{
+    return m_useDiscovery;
+}
+
+void Settings::setLazyDescriptions(bool newLazyDescriptions)
+{
+    m_lazyDescriptions = newLazyDescriptions;
+
+    emit lazyDescriptionsChanged(newLazyDescriptions);
+}
+
+bool Settings::lazyDescriptions() const
+{
+    return m_lazyDescriptions;
+}
+
 QUrl Settings::deviceURL() const
 {
     return m_deviceURL;
@@ -98,7 +160,11 @@ void Settings::readConfiguration()
     m_deviceURL.setHost(settings.value(HOST_KEY, DEFAULT_HOST).toString());
     m_deviceURL.setPort(settings.value(PORT_KEY, DEFAULT_PORT).toInt());
     setEncryption(settings.value(USE_SSL_KEY, DEFAULT_ENCRYPTION).toBool());
+    m_userName = settings.value(USER_NAME_KEY).toString();
+    m_useDiscovery = settings.value(USE_DISCOVERY_KEY, DEFAULT_DISCOVERY).toBool();
+    m_lazyDescriptions = settings.value(LAZY_DESCRIPTIONS_KEY, DEFAULT_LAZY_DESCRIPTIONS).toBool();
     settings.endGroup();
+    m_password = QString::fromLocal8Bit(qgetenv(PASSWORD_VARIABLE));
 }
 
 void Settings::writeConfiguration()
@@ -112,6 +178,9 @@ void Settings::writeConfiguration()
     settings.setValue(HOST_KEY, m_deviceURL.host());
     settings.setValue(PORT_KEY, m_deviceURL.port());
     settings.setValue(USE_SSL_KEY, m_deviceURL.scheme() == HTTPS_SCHEME);
+    settings.setValue(USER_NAME_KEY, m_userName);
+    settings.setValue(USE_DISCOVERY_KEY, m_useDiscovery);
+    settings.setValue(LAZY_DESCRIPTIONS_KEY, m_lazyDescriptions);
 }
 
 void Settings::setEncryption(bool useSSL)
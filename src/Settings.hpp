@@ -39,6 +39,12 @@ class Settings : public QObject
     Q_PROPERTY(QString host READ host WRITE setHost NOTIFY hostChanged)
     Q_PROPERTY(int port READ port WRITE setPort NOTIFY portChanged)
     Q_PROPERTY(bool useSSL READ useSSL WRITE setUseSSL NOTIFY useSSLChanged)
+    Q_PROPERTY(QString userName READ userName WRITE setUserName NOTIFY userNameChanged)
+    Q_PROPERTY(QString password READ password WRITE setPassword NOTIFY passwordChanged)
+    Q_PROPERTY(bool useDiscovery READ useDiscovery WRITE setUseDiscovery
+               NOTIFY useDiscoveryChanged)
+    Q_PROPERTY(bool lazyDescriptions READ lazyDescriptions WRITE setLazyDescriptions
+               NOTIFY lazyDescriptionsChanged)
 
 public:
     explicit Settings(QObject *parent = nullptr);
@@ -52,6 +58,24 @@ public:
     void setUseSSL(bool newUseSSL);
     bool useSSL() const;
 
+    // for the actions which require authentication
+    void setUserName(const QString &newUserName);
+    QString userName() const;
+
+    /* The password is never written to the configuration, ``readConfiguration`` takes it from
+     * the environment variable FRITZMON_PASSWORD instead.
+     */
+    void setPassword(const QString &newPassword);
+    QString password() const;
+
+    // find the router with SSDP instead of using the configured host
+    void setUseDiscovery(bool newUseDiscovery);
+    bool useDiscovery() const;
+
+    // load the service descriptions only for the services which are used
+    void setLazyDescriptions(bool newLazyDescriptions);
+    bool lazyDescriptions() const;
+
     QUrl deviceURL() const;
 
     // doesn't emit the changed signals, because all three would be emitted shortly after each
@@ -63,11 +87,19 @@ signals:
     void hostChanged(QString newHost);
     void portChanged(int newPort);
     void useSSLChanged(bool newUseSSL);
+    void userNameChanged(QString newUserName);
+    void passwordChanged(QString newPassword);
+    void useDiscoveryChanged(bool newUseDiscovery);
+    void lazyDescriptionsChanged(bool newLazyDescriptions);
 
 private:
     void setEncryption(bool useSSL);
 
     QUrl m_deviceURL;
+    QString m_userName;
+    QString m_password;
+    bool m_useDiscovery;
+    bool m_lazyDescriptions;
 
     Q_DISABLE_COPY(Settings)
 };
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ShaderCache.hpp"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRunnable>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QThreadPool>
+
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLExtraFunctions>
+#include <QtGui/QOpenGLShaderProgram>
+
+#include <functional>
+
+// not defined by the OpenGL ES 2 headers
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace fritzmon {
+
+static constexpr auto *CACHE_DIRECTORY = "shaders";
+static constexpr auto *CACHE_FILE_SUFFIX = ".bin";
+static constexpr auto CACHE_FILE_VERSION = 1u;
+
+class WarmUpTask : public QRunnable
+{
+public:
+    explicit WarmUpTask(std::function<void()> function)
+      : m_function(std::move(function))
+    {}
+
+    void run() override {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+static bool supportsProgramBinaries(QOpenGLContext *context)
+{
+    auto format = context->format();
+
+    if (context->isOpenGLES()) {
+        if (format.majorVersion() < 3)
+            return false;
+    } else if ((format.version() < qMakePair(4, 1))
+               && !context->hasExtension("GL_ARB_get_program_binary")) {
+        return false;
+    }
+
+    auto formats = GLint(0);
+
+    context->functions()->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    return formats > 0;
+}
+
+static QByteArray readSource(const char *path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "ShaderCache: failed to read" << path;
+
+        return QByteArray();
+    }
+
+    return file.readAll();
+}
+
+static QByteArray glString(QOpenGLContext *context, GLenum name)
+{
+    return QByteArray(reinterpret_cast<const char *>(context->functions()->glGetString(name)));
+}
+
+// the binaries are only valid for the driver which created them
+static QByteArray programKey(QOpenGLContext *context, const ShaderCache::Program &source)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    hash.addData(glString(context, GL_VENDOR));
+    hash.addData(glString(context, GL_RENDERER));
+    hash.addData(glString(context, GL_VERSION));
+    hash.addData(readSource(source.vertexShaderPath));
+    hash.addData(readSource(source.fragmentShaderPath));
+    for (auto *attribute = source.attributes; *attribute; ++attribute)
+        hash.addData(*attribute);
+
+    return hash.result().toHex();
+}
+
+static bool compileProgram(QOpenGLContext *context, QOpenGLShaderProgram *program,
+                           const ShaderCache::Program &source)
+{
+    if (!program->addShaderFromSourceFile(QOpenGLShader::Vertex, source.vertexShaderPath)
+            || !program->addShaderFromSourceFile(QOpenGLShader::Fragment,
+                                                 source.fragmentShaderPath))
+        return false;
+    // the attribute locations are part of the binary, they have to match the scene graph's
+    for (auto i = 0; source.attributes[i]; ++i)
+        program->bindAttributeLocation(source.attributes[i], i);
+    context->extraFunctions()->glProgramParameteri(program->programId(),
+                                                   GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    return program->link();
+}
+
+static ShaderCache::Binary programBinary(QOpenGLContext *context, QOpenGLShaderProgram *program)
+{
+    auto *f = context->extraFunctions();
+    auto binary = ShaderCache::Binary{ 0, QByteArray() };
+    auto length = GLint(0);
+
+    f->glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return binary;
+    binary.data.resize(length);
+    f->glGetProgramBinary(program->programId(), length, &length, &binary.format,
+                          binary.data.data());
+    binary.data.resize(length);
+
+    return binary;
+}
+
+static bool linkBinary(QOpenGLContext *context, QOpenGLShaderProgram *program,
+                       const ShaderCache::Binary &binary)
+{
+    auto *f = context->extraFunctions();
+    auto linked = GLint(0);
+
+    f->glProgramBinary(program->programId(), binary.format, binary.data.constData(),
+                       binary.data.size());
+    // drivers reject binaries after an update, the program can still be compiled normally then
+    f->glGetProgramiv(program->programId(), GL_LINK_STATUS, &linked);
+    if (!linked)
+        return false;
+
+    // without attached shaders, this only picks up the link status
+    return program->link();
+}
+
+static QString binaryPath(const QByteArray &key)
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QLatin1Char('/')
+           + QLatin1String(CACHE_DIRECTORY) + QLatin1Char('/') + QString::fromLatin1(key)
+           + QLatin1String(CACHE_FILE_SUFFIX);
+}
+
+ShaderCache &ShaderCache::instance()
+{
+    static ShaderCache cache;
+
+    return cache;
+}
+
+ShaderCache::ShaderCache()
+  : m_warmingUp(false)
+{}
+
+void ShaderCache::warmUp(const std::vector<Program> &programs)
+{
+    if (!QOpenGLContext::supportsThreadedOpenGL()) {
+        qDebug() << "ShaderCache::warmUp: no threaded OpenGL, shaders are compiled on first use";
+
+        return;
+    }
+
+    // surfaces can only be created on the GUI thread
+    auto *surface = new QOffscreenSurface();
+
+    surface->setFormat(QSurfaceFormat::defaultFormat());
+    surface->create();
+    {
+        QMutexLocker locker(&m_mutex);
+
+        m_warmingUp = true;
+    }
+    QThreadPool::globalInstance()->start(new WarmUpTask([this, surface, programs]() {
+        runWarmUp(surface, programs);
+    }));
+}
+
+bool ShaderCache::loadProgram(QOpenGLShaderProgram *program, const Program &source)
+{
+    auto *context = QOpenGLContext::currentContext();
+
+    if (!context || !supportsProgramBinaries(context))
+        return false;
+
+    auto key = programKey(context, source);
+    auto binary = Binary{ 0, QByteArray() };
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // waiting is still faster than compiling the same program a second time
+        while (m_warmingUp)
+            m_warmedUp.wait(&m_mutex);
+        binary = m_binaries.value(key, binary);
+    }
+    if (binary.data.isEmpty()) {
+        binary = readBinary(key);
+        if (binary.data.isEmpty())
+            return false;
+
+        QMutexLocker locker(&m_mutex);
+
+        m_binaries.insert(key, binary);
+    }
+    if (!linkBinary(context, program, binary)) {
+        qDebug() << "ShaderCache::loadProgram: binary rejected for" << source.vertexShaderPath;
+
+        return false;
+    }
+
+    return true;
+}
+
+void ShaderCache::storeProgram(QOpenGLShaderProgram *program, const Program &source)
+{
+    auto *context = QOpenGLContext::currentContext();
+
+    if (!context || !program->isLinked() || !supportsProgramBinaries(context))
+        return;
+
+    auto key = programKey(context, source);
+    auto binary = programBinary(context, program);
+
+    if (binary.data.isEmpty())
+        return;
+    writeBinary(key, binary);
+
+    QMutexLocker locker(&m_mutex);
+
+    m_binaries.insert(key, binary);
+}
+
+void ShaderCache::runWarmUp(QOffscreenSurface *surface, const std::vector<Program> &programs)
+{
+    QOpenGLContext context;
+
+    context.setFormat(surface->requestedFormat());
+    if (!context.create() || !context.makeCurrent(surface)) {
+        qDebug() << "ShaderCache::warmUp: failed to create an OpenGL context";
+    } else {
+        if (supportsProgramBinaries(&context)) {
+            for (const auto &source : programs) {
+                auto key = programKey(&context, source);
+                auto binary = readBinary(key);
+                QOpenGLShaderProgram program;
+
+                // loading a binary takes the driver some time as well, so it is done here, too
+                if (binary.data.isEmpty() || !linkBinary(&context, &program, binary)) {
+                    if (!compileProgram(&context, &program, source)) {
+                        qDebug() << "ShaderCache::warmUp: failed to compile"
+                                 << source.vertexShaderPath << program.log();
+                        continue;
+                    }
+                    binary = programBinary(&context, &program);
+                    if (binary.data.isEmpty())
+                        continue;
+                    writeBinary(key, binary);
+                }
+
+                QMutexLocker locker(&m_mutex);
+
+                m_binaries.insert(key, binary);
+            }
+        }
+        context.doneCurrent();
+    }
+    surface->deleteLater();
+
+    QMutexLocker locker(&m_mutex);
+
+    m_warmingUp = false;
+    m_warmedUp.wakeAll();
+}
+
+ShaderCache::Binary ShaderCache::readBinary(const QByteArray &key) const
+{
+    auto binary = Binary{ 0, QByteArray() };
+    QFile file(binaryPath(key));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return binary;
+
+    QDataStream stream(&file);
+    auto version = quint32(0);
+    auto format = quint32(0);
+    auto data = QByteArray();
+
+    stream >> version >> format >> data;
+    if ((stream.status() != QDataStream::Ok) || (version != CACHE_FILE_VERSION)) {
+        qDebug() << "ShaderCache: ignoring invalid cache file" << file.fileName();
+
+        return binary;
+    }
+    binary.format = format;
+    binary.data = data;
+
+    return binary;
+}
+
+void ShaderCache::writeBinary(const QByteArray &key, const Binary &binary) const
+{
+    auto path = binaryPath(key);
+
+    if (!QDir().mkpath(QFileInfo(path).path())) {
+        qDebug() << "ShaderCache: failed to create the cache directory for" << path;
+
+        return;
+    }
+
+    QSaveFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "ShaderCache: failed to write" << path;
+
+        return;
+    }
+
+    QDataStream stream(&file);
+
+    stream << quint32(CACHE_FILE_VERSION) << quint32(binary.format) << binary.data;
+    if (!file.commit())
+        qDebug() << "ShaderCache: failed to write" << path;
+}
+
+} // namespace fritzmon
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_SHADERCACHE_HPP
+#define FRITZMON_SHADERCACHE_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+#include <QtGui/qopengl.h>
+
+#include <vector>
+
+class QOffscreenSurface;
+class QOpenGLShaderProgram;
+
+namespace fritzmon {
+
+/* Keeps linked shader programs as driver specific binaries, in memory and on disk.
+ *
+ * The programs are compiled in a worker thread with its own context right after startup, so the
+ * scene graph can load the binaries on its first frame instead of compiling the sources.
+ */
+class ShaderCache
+{
+public:
+    struct Program
+    {
+        const char *vertexShaderPath;
+        const char *fragmentShaderPath;
+        const char *const *attributes; //< nullptr terminated, bound to their index
+    };
+
+    struct Binary
+    {
+        GLenum format;
+        QByteArray data;
+    };
+
+    static ShaderCache &instance();
+
+    // must be called from the GUI thread; does nothing if threaded OpenGL is not available
+    void warmUp(const std::vector<Program> &programs);
+
+    // to be called with the scene graph context current, waits for a running warm-up
+    bool loadProgram(QOpenGLShaderProgram *program, const Program &source);
+    void storeProgram(QOpenGLShaderProgram *program, const Program &source);
+
+private:
+    ShaderCache();
+
+    void runWarmUp(QOffscreenSurface *surface, const std::vector<Program> &programs);
+    Binary readBinary(const QByteArray &key) const;
+    void writeBinary(const QByteArray &key, const Binary &binary) const;
+
+    QMutex m_mutex;
+    QWaitCondition m_warmedUp;
+    bool m_warmingUp;
+    QHash<QByteArray, Binary> m_binaries; //< keyed by programKey()
+
+    Q_DISABLE_COPY(ShaderCache)
+};
+
+} // namespace fritzmon
+
+#endif // FRITZMON_SHADERCACHE_HPP
@@ -25,6 +25,7 @@
  */
 
 #include "Graph.hpp"
+#include "HeatmapGraph.hpp"
 #include "MonitorApp.hpp"
 
 #include <QtGui/QGuiApplication>
@@ -32,6 +33,7 @@
 int main(int argc, char *argv[])
 {
     qmlRegisterType<fritzmon::Graph>("Graph", 1, 0, "Graph");
+    qmlRegisterType<fritzmon::HeatmapGraph>("Graph", 1, 0, "HeatmapGraph");
 
     QGuiApplication app(argc, argv);
     fritzmon::MonitorApp monitorApp;
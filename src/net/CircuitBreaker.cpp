@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CircuitBreaker.hpp"
+
+#include <QtCore/QDebug>
+
+#include <algorithm>
+
+namespace fritzmon {
+namespace net {
+
+static constexpr auto INITIAL_BACKOFF = 500; //< in ms
+static constexpr auto PROBE_TIMEOUT = 2000;  //< in ms
+
+using ErrorSignal = void (QAbstractSocket::*)(QAbstractSocket::SocketError);
+
+CircuitBreaker::CircuitBreaker(const QString &host, quint16 port, QObject *parent)
+  : QObject(parent),
+    m_host(host),
+    m_port(port),
+    m_state(State::Closed),
+    m_failures(0),
+    m_trialPending(false),
+    m_failureThreshold(DEFAULT_FAILURE_THRESHOLD),
+    m_backoff(INITIAL_BACKOFF),
+    m_maximumBackoff(DEFAULT_MAXIMUM_BACKOFF),
+    m_probeTimer(),
+    m_probeTimeout(),
+    m_probe()
+{
+    m_probeTimer.setSingleShot(true);
+    m_probeTimeout.setSingleShot(true);
+    m_probeTimeout.setInterval(PROBE_TIMEOUT);
+    connect(&m_probeTimer, &QTimer::timeout, this, &CircuitBreaker::probe);
+    connect(&m_probeTimeout, &QTimer::timeout, this, &CircuitBreaker::onProbeFailed);
+    connect(&m_probe, &QTcpSocket::connected, this, &CircuitBreaker::onProbeConnected);
+    connect(&m_probe, static_cast<ErrorSignal>(&QAbstractSocket::error),
+            this,     &CircuitBreaker::onProbeFailed);
+}
+
+CircuitBreaker::~CircuitBreaker() = default;
+
+CircuitBreaker::State CircuitBreaker::state() const
+{
+    return m_state;
+}
+
+bool CircuitBreaker::allowsRequests() const
+{
+    return m_state != State::Open;
+}
+
+bool CircuitBreaker::tryRequest()
+{
+    switch (m_state) {
+    case State::Closed:
+        return true;
+    case State::Open:
+        return false;
+    case State::HalfOpen:
+        break;
+    }
+    if (m_trialPending)
+        return false;
+    m_trialPending = true;
+
+    return true;
+}
+
+void CircuitBreaker::recordSuccess()
+{
+    // a request sent before the breaker opened may still get through, which makes the probe moot
+    m_probeTimer.stop();
+    m_probeTimeout.stop();
+    m_probe.abort();
+    m_failures = 0;
+    m_trialPending = false;
+    m_backoff = INITIAL_BACKOFF;
+    setState(State::Closed);
+}
+
+void CircuitBreaker::recordFailure()
+{
+    ++m_failures;
+    m_trialPending = false;
+    if ((m_state == State::HalfOpen) || (m_failures >= m_failureThreshold))
+        open();
+}
+
+void CircuitBreaker::setFailureThreshold(int failureThreshold)
+{
+    m_failureThreshold = std::max(failureThreshold, 1);
+}
+
+int CircuitBreaker::failureThreshold() const
+{
+    return m_failureThreshold;
+}
+
+void CircuitBreaker::setMaximumBackoff(int maximumBackoff)
+{
+    m_maximumBackoff = std::max(maximumBackoff, INITIAL_BACKOFF);
+    m_backoff = std::min(m_backoff, m_maximumBackoff);
+}
+
+int CircuitBreaker::maximumBackoff() const
+{
+    return m_maximumBackoff;
+}
+
+void CircuitBreaker::setState(State state)
+{
+    if (state == m_state)
+        return;
+
+    auto previous = m_state;
+
+    m_state = state;
+    qDebug() << "CircuitBreaker:" << m_host << state;
+    emit stateChanged(state, previous);
+}
+
+void CircuitBreaker::open()
+{
+    if (m_state == State::Open)
+        return;
+    setState(State::Open);
+    m_probeTimer.start(m_backoff);
+}
+
+void CircuitBreaker::probe()
+{
+    // only the connection is established, nothing is sent
+    m_probe.abort();
+    m_probeTimeout.start();
+    m_probe.connectToHost(m_host, m_port);
+}
+
+void CircuitBreaker::onProbeConnected()
+{
+    // a late connection after a request has already closed the breaker
+    if (m_state != State::Open)
+        return;
+    m_probeTimeout.stop();
+    m_probe.abort();
+    m_failures = 0;
+    setState(State::HalfOpen);
+}
+
+void CircuitBreaker::onProbeFailed()
+{
+    if (m_state != State::Open)
+        return;
+    m_probeTimeout.stop();
+    m_probe.abort();
+    m_backoff = std::min(m_backoff * 2, m_maximumBackoff);
+    m_probeTimer.start(m_backoff);
+}
+
+} // namespace net
+} // namespace fritzmon
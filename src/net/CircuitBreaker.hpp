@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_NET_CIRCUITBREAKER_HPP
+#define FRITZMON_NET_CIRCUITBREAKER_HPP
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QTimer>
+
+#include <QtNetwork/QTcpSocket>
+
+namespace fritzmon {
+namespace net {
+
+/* Tracks whether a host is reachable, so requests to a dead host are not sent at all.
+ *
+ * After ``failureThreshold`` consecutive connection failures, the breaker opens.  While it is
+ * open, a TCP connection to the host is attempted with an exponential backoff, which is limited
+ * to ``maximumBackoff``.  Once the host accepts the connection, the breaker is half open and a
+ * single trial request decides whether it closes again or reopens.
+ */
+class CircuitBreaker : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class State {
+        Closed,
+        Open,
+        HalfOpen
+    };
+    Q_ENUM(State)
+
+    static constexpr auto DEFAULT_FAILURE_THRESHOLD = 3;
+    static constexpr auto DEFAULT_MAXIMUM_BACKOFF = 30000; //< in ms
+
+    CircuitBreaker(const QString &host, quint16 port, QObject *parent=nullptr);
+    ~CircuitBreaker();
+
+    State state() const;
+    bool allowsRequests() const;
+    // whether a request may be sent now, while half open only the trial request is admitted
+    bool tryRequest();
+
+    void recordSuccess();
+    void recordFailure();
+
+    void setFailureThreshold(int failureThreshold);
+    int failureThreshold() const;
+    void setMaximumBackoff(int maximumBackoff);
+    int maximumBackoff() const;
+
+Q_SIGNALS:
+    void stateChanged(State state, State previous);
+
+private:
+    void setState(State state);
+    void open();
+    Q_SLOT void probe();
+    Q_SLOT void onProbeConnected();
+    Q_SLOT void onProbeFailed();
+
+    QString m_host;
+    quint16 m_port;
+    State m_state;
+    int m_failures; //< consecutive ones
+    bool m_trialPending; //< the outcome of the trial request while half open
+    int m_failureThreshold;
+    int m_backoff;  //< until the next probe, in ms
+    int m_maximumBackoff;
+    QTimer m_probeTimer;
+    QTimer m_probeTimeout;
+    QTcpSocket m_probe;
+
+    Q_DISABLE_COPY(CircuitBreaker)
+};
+
+} // namespace net
+} // namespace fritzmon
+
+#endif // FRITZMON_NET_CIRCUITBREAKER_HPP
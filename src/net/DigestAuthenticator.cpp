@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DigestAuthenticator.hpp"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QUuid>
+
+namespace fritzmon {
+namespace net {
+
+static constexpr auto *DIGEST_SCHEME = "digest";
+static constexpr auto *ALGORITHM_PARAMETER = "algorithm";
+static constexpr auto *NONCE_PARAMETER = "nonce";
+static constexpr auto *OPAQUE_PARAMETER = "opaque";
+static constexpr auto *QOP_PARAMETER = "qop";
+static constexpr auto *REALM_PARAMETER = "realm";
+static constexpr auto *STALE_PARAMETER = "stale";
+static constexpr auto *MD5_ALGORITHM = "md5";
+static constexpr auto *MD5_SESS_ALGORITHM = "md5-sess";
+static constexpr auto *AUTH_QOP = "auth";
+static constexpr auto *TRUE_VALUE = "true";
+
+static QByteArray md5(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex();
+}
+
+// splits the parameters of an authentication challenge, the names are converted to lower case
+static QHash<QByteArray, QByteArray> parseParameters(const QByteArray &parameters)
+{
+    QHash<QByteArray, QByteArray> result;
+    auto pos = 0;
+    auto size = parameters.size();
+
+    while (pos < size) {
+        while ((pos < size) && ((parameters[pos] == ' ') || (parameters[pos] == ',')))
+            ++pos;
+
+        auto equals = parameters.indexOf('=', pos);
+
+        if (equals < 0)
+            break;
+
+        auto name = parameters.mid(pos, equals - pos).trimmed().toLower();
+        QByteArray value;
+
+        pos = equals + 1;
+        if ((pos < size) && (parameters[pos] == '"')) {
+            for (++pos; (pos < size) && (parameters[pos] != '"'); ++pos) {
+                if ((parameters[pos] == '\\') && (pos + 1 < size))
+                    ++pos;
+                value.append(parameters[pos]);
+            }
+            ++pos;
+        } else {
+            auto end = parameters.indexOf(',', pos);
+
+            if (end < 0)
+                end = size;
+            value = parameters.mid(pos, end - pos).trimmed();
+            pos = end;
+        }
+        result.insert(name, value);
+    }
+
+    return result;
+}
+
+static QByteArray quoted(const QByteArray &value)
+{
+    auto result = value;
+
+    result.replace('\\', "\\\\");
+    result.replace('"', "\\\"");
+
+    return '"' + result + '"';
+}
+
+DigestAuthenticator::DigestAuthenticator()
+  : m_userName(),
+    m_password(),
+    m_realm(),
+    m_nonce(),
+    m_opaque(),
+    m_cnonce(),
+    m_sessionKey(),
+    m_nonceCount(0),
+    m_qopAuth(false),
+    m_sessionAlgorithm(false),
+    m_stale(false),
+    m_challenges(0),
+    m_authorizations(0)
+{}
+
+DigestAuthenticator::~DigestAuthenticator() = default;
+
+void DigestAuthenticator::setCredentials(const QString &userName, const QString &password)
+{
+    m_userName = userName.toUtf8();
+    m_password = password.toUtf8();
+    m_nonce.clear();
+    m_sessionKey.clear();
+}
+
+bool DigestAuthenticator::hasCredentials() const
+{
+    return !m_userName.isEmpty();
+}
+
+bool DigestAuthenticator::setChallenge(const QByteArray &header)
+{
+    auto scheme = header.indexOf(' ');
+
+    if ((scheme < 0) || (header.left(scheme).toLower() != DIGEST_SCHEME)) {
+        qDebug() << "DigestAuthenticator::setChallenge: not a digest challenge:" << header;
+
+        return false;
+    }
+
+    auto parameters = parseParameters(header.mid(scheme + 1));
+    auto algorithm = parameters.value(ALGORITHM_PARAMETER, MD5_ALGORITHM).toLower();
+    auto nonce = parameters.value(NONCE_PARAMETER);
+
+    if (nonce.isEmpty() || ((algorithm != MD5_ALGORITHM) && (algorithm != MD5_SESS_ALGORITHM))) {
+        qDebug() << "DigestAuthenticator::setChallenge: unsupported challenge:" << header;
+
+        return false;
+    }
+
+    m_qopAuth = false;
+    if (parameters.contains(QOP_PARAMETER)) {
+        for (const auto &qop : parameters.value(QOP_PARAMETER).split(',')) {
+            if (qop.trimmed().toLower() == AUTH_QOP)
+                m_qopAuth = true;
+        }
+        if (!m_qopAuth) {
+            qDebug() << "DigestAuthenticator::setChallenge: unsupported qop:" << header;
+
+            return false;
+        }
+    }
+
+    m_realm = parameters.value(REALM_PARAMETER);
+    m_nonce = nonce;
+    m_opaque = parameters.value(OPAQUE_PARAMETER);
+    m_sessionAlgorithm = (algorithm == MD5_SESS_ALGORITHM);
+    m_stale = (parameters.value(STALE_PARAMETER).toLower() == TRUE_VALUE);
+    m_cnonce = QUuid::createUuid().toRfc4122().toHex();
+    m_nonceCount = 0;
+    m_sessionKey = md5(m_userName + ':' + m_realm + ':' + m_password);
+    if (m_sessionAlgorithm)
+        m_sessionKey = md5(m_sessionKey + ':' + m_nonce + ':' + m_cnonce);
+    ++m_challenges;
+
+    return true;
+}
+
+bool DigestAuthenticator::hasChallenge() const
+{
+    return !m_nonce.isEmpty();
+}
+
+bool DigestAuthenticator::isStale() const
+{
+    return m_stale;
+}
+
+QByteArray DigestAuthenticator::authorization(const QByteArray &method, const QByteArray &uri)
+{
+    if (!hasChallenge())
+        return QByteArray();
+
+    auto nonceCount = QByteArray::number(++m_nonceCount, 16).rightJustified(8, '0');
+    auto requestDigest = md5(method + ':' + uri);
+    QByteArray response;
+
+    if (m_qopAuth)
+        response = md5(m_sessionKey + ':' + m_nonce + ':' + nonceCount + ':' + m_cnonce + ':'
+                       + AUTH_QOP + ':' + requestDigest);
+    else
+        response = md5(m_sessionKey + ':' + m_nonce + ':' + requestDigest);
+
+    auto result = QByteArray("Digest username=") + quoted(m_userName)
+                  + ", realm=" + quoted(m_realm)
+                  + ", nonce=" + quoted(m_nonce)
+                  + ", uri=" + quoted(uri)
+                  + ", algorithm=" + (m_sessionAlgorithm ? "MD5-sess" : "MD5")
+                  + ", response=" + quoted(response);
+
+    if (m_qopAuth)
+        result += QByteArray(", qop=") + AUTH_QOP + ", nc=" + nonceCount
+                  + ", cnonce=" + quoted(m_cnonce);
+    if (!m_opaque.isEmpty())
+        result += ", opaque=" + quoted(m_opaque);
+    ++m_authorizations;
+
+    return result;
+}
+
+quint64 DigestAuthenticator::challenges() const
+{
+    return m_challenges;
+}
+
+quint64 DigestAuthenticator::authorizations() const
+{
+    return m_authorizations;
+}
+
+} // namespace net
+} // namespace fritzmon
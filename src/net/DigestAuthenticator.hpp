@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_NET_DIGESTAUTHENTICATOR_HPP
+#define FRITZMON_NET_DIGESTAUTHENTICATOR_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+namespace fritzmon {
+namespace net {
+
+/* HTTP digest authentication (RFC 7616) which keeps the last challenge of the server.
+ *
+ * Once a challenge was received, every request is authorized up front with the cached nonce and an
+ * incremented nonce count, so it costs a single round trip.  The server only has to challenge
+ * again when the nonce became stale.  Only the ``MD5`` and ``MD5-sess`` algorithms and the ``auth``
+ * quality of protection are supported, which is what the TR-064 devices use.
+ */
+class DigestAuthenticator
+{
+public:
+    DigestAuthenticator();
+    ~DigestAuthenticator();
+
+    // drops the cached challenge, if the credentials change
+    void setCredentials(const QString &userName, const QString &password);
+    bool hasCredentials() const;
+
+    // parses a ``WWW-Authenticate`` header, returns false if it is no usable digest challenge
+    bool setChallenge(const QByteArray &header);
+    bool hasChallenge() const;
+    bool isStale() const; //< whether the last challenge only renewed the nonce
+
+    // the ``Authorization`` header for the next request, each call increments the nonce count
+    QByteArray authorization(const QByteArray &method, const QByteArray &uri);
+
+    quint64 challenges() const;
+    quint64 authorizations() const;
+
+private:
+    QByteArray m_userName;
+    QByteArray m_password;
+    QByteArray m_realm;
+    QByteArray m_nonce;
+    QByteArray m_opaque;
+    QByteArray m_cnonce;
+    QByteArray m_sessionKey; //< HA1, which only changes with the nonce for ``MD5-sess``
+    quint32 m_nonceCount;
+    bool m_qopAuth;
+    bool m_sessionAlgorithm;
+    bool m_stale;
+    quint64 m_challenges;
+    quint64 m_authorizations;
+
+    Q_DISABLE_COPY(DigestAuthenticator)
+};
+
+} // namespace net
+} // namespace fritzmon
+
+#endif // FRITZMON_NET_DIGESTAUTHENTICATOR_HPP
@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "NetworkSession.hpp"
+
+#include <QtCore/QDebug>
+#include <QtCore/QSettings>
+#include <QtCore/QTimer>
+#include <QtCore/QUrl>
+
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QSslError>
+
+#include <algorithm>
+
+namespace fritzmon {
+namespace net {
+
+static constexpr auto *HTTPS_SCHEME = "https";
+static constexpr auto HTTP_PORT = 80;
+static constexpr auto HTTPS_PORT = 443;
+static constexpr auto HTTP_UNAUTHORIZED = 401;
+static constexpr auto *AUTHORIZATION_HEADER = "Authorization";
+static constexpr auto *WWW_AUTHENTICATE_HEADER = "WWW-Authenticate";
+static constexpr auto *GET_METHOD = "GET";
+static constexpr auto *POST_METHOD = "POST";
+static constexpr auto *TLS_GROUP = "tls";
+static constexpr auto *CERTIFICATE_KEY = "certificate";
+static constexpr auto *SESSION_TICKET_KEY = "session_ticket";
+static constexpr auto *SESSION_TICKET_EXPIRY_KEY = "session_ticket_expiry";
+static constexpr auto DEFAULT_SESSION_TICKET_LIFETIME = 300; //< in s, if the server sends no hint
+
+// the reply to a request which was not sent, because the host is not reachable
+class RejectedReply : public QNetworkReply
+{
+public:
+    RejectedReply(const QNetworkRequest &request, QNetworkAccessManager::Operation operation,
+                  QObject *parent=nullptr);
+
+    void abort() override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+};
+
+RejectedReply::RejectedReply(const QNetworkRequest &request,
+                             QNetworkAccessManager::Operation operation, QObject *parent)
+  : QNetworkReply(parent)
+{
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(operation);
+    setError(QNetworkReply::TemporaryNetworkFailureError,
+             QStringLiteral("Host unreachable, the request was not sent"));
+    open(QIODevice::ReadOnly);
+    setFinished(true);
+    // like a real reply, this one finishes after the caller has returned
+    QTimer::singleShot(0, this, [this]() { emit finished(); });
+}
+
+void RejectedReply::abort()
+{}
+
+qint64 RejectedReply::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+
+    return -1;
+}
+
+static bool isConnectionFailure(QNetworkReply::NetworkError error)
+{
+    switch (error) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::OperationCanceledError: //< by the request timeout
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+        return true;
+    default:
+        // the host answered, even if with an error
+        return false;
+    }
+}
+
+// the request URI as it appears in the request line, which the digest covers
+static QByteArray requestURI(const QUrl &url)
+{
+    auto uri = url.toEncoded(QUrl::RemoveScheme | QUrl::RemoveAuthority | QUrl::RemoveFragment);
+
+    if (uri.isEmpty())
+        uri = "/";
+
+    return uri;
+}
+
+NetworkSession::NetworkSession(const QUrl &url, QObject *parent)
+  : QObject(parent),
+    m_networkAccess(),
+    m_circuitBreaker(url.host(),
+                     url.port(url.scheme() == HTTPS_SCHEME ? HTTPS_PORT : HTTP_PORT)),
+    m_authenticator(),
+    m_tlsStateKey(),
+    m_sslConfiguration(QSslConfiguration::defaultConfiguration()),
+    m_sessionTicketExpiry(),
+    m_pinnedCertificate(),
+    m_pinnedErrors(),
+    m_queue(),
+    m_maxConnections(DEFAULT_MAX_CONNECTIONS),
+    m_requestTimeout(DEFAULT_REQUEST_TIMEOUT),
+    m_inFlight(0),
+    m_peakInFlight(0),
+    m_requests(0),
+    m_handshakes(0)
+{
+    connect(&m_networkAccess, &QNetworkAccessManager::sslErrors,
+            this,             &NetworkSession::onSslErrors);
+    connect(&m_networkAccess, &QNetworkAccessManager::encrypted,
+            this,             &NetworkSession::onEncrypted);
+    connect(&m_circuitBreaker, &CircuitBreaker::stateChanged,
+            this,              &NetworkSession::onCircuitBreakerStateChanged);
+    if (url.scheme() == HTTPS_SCHEME) {
+        m_tlsStateKey = url.host() + QLatin1Char('_') + QString::number(url.port(HTTPS_PORT));
+        // the session ticket is only available with the persistence enabled
+        m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        readTlsState();
+    }
+}
+
+NetworkSession::~NetworkSession() = default;
+
+void NetworkSession::get(const QNetworkRequest &request, QObject *receiver,
+                         const ReplyCallback &finished)
+{
+    get(request, receiver, ReplyHandler{ ReplyCallback(), finished });
+}
+
+void NetworkSession::post(const QNetworkRequest &request, const QByteArray &data,
+                          QObject *receiver, const ReplyCallback &finished)
+{
+    post(request, data, receiver, ReplyHandler{ ReplyCallback(), finished });
+}
+
+void NetworkSession::get(const QNetworkRequest &request, QObject *receiver,
+                         const ReplyHandler &handler)
+{
+    enqueue({ Operation::Get, GET_METHOD, request, QByteArray(), receiver, handler, false });
+}
+
+void NetworkSession::post(const QNetworkRequest &request, const QByteArray &data,
+                          QObject *receiver, const ReplyHandler &handler)
+{
+    enqueue({ Operation::Post, POST_METHOD, request, data, receiver, handler, false });
+}
+
+void NetworkSession::sendCustomRequest(const QNetworkRequest &request, const QByteArray &verb,
+                                       QObject *receiver, const ReplyCallback &finished)
+{
+    enqueue({ Operation::Custom, verb, request, QByteArray(), receiver,
+              ReplyHandler{ ReplyCallback(), finished }, false });
+}
+
+void NetworkSession::setMaxConnections(int maxConnections)
+{
+    m_maxConnections = std::max(maxConnections, 1);
+    startRequests();
+}
+
+int NetworkSession::maxConnections() const
+{
+    return m_maxConnections;
+}
+
+void NetworkSession::setRequestTimeout(int requestTimeout)
+{
+    m_requestTimeout = requestTimeout;
+}
+
+int NetworkSession::requestTimeout() const
+{
+    return m_requestTimeout;
+}
+
+CircuitBreaker &NetworkSession::circuitBreaker()
+{
+    return m_circuitBreaker;
+}
+
+bool NetworkSession::isReachable() const
+{
+    return m_circuitBreaker.allowsRequests();
+}
+
+void NetworkSession::setCredentials(const QString &userName, const QString &password)
+{
+    m_authenticator.setCredentials(userName, password);
+}
+
+const DigestAuthenticator &NetworkSession::authenticator() const
+{
+    return m_authenticator;
+}
+
+quint64 NetworkSession::requests() const
+{
+    return m_requests;
+}
+
+quint64 NetworkSession::handshakes() const
+{
+    return m_handshakes;
+}
+
+quint64 NetworkSession::handshakesAvoided() const
+{
+    return m_requests - std::min(m_handshakes, m_requests);
+}
+
+void NetworkSession::onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors)
+{
+    for (const auto &error : errors)
+        qDebug() << "NetworkSession::onSslErrors:" << error.errorString();
+
+    // the errors of the pinned certificate are ignored before they occur, so this is another one
+    if (!m_pinnedCertificate.isNull()) {
+        qDebug() << "NetworkSession::onSslErrors: certificate does not match the pinned one,"
+                 << "remove it from the settings if the router was reset";
+
+        return;
+    }
+    if ((errors.size() == 1) && (errors[0].error() == QSslError::SelfSignedCertificate)) {
+        qDebug() << "NetworkSession::onSslErrors: self signed certificate (pinned)";
+        pinCertificate(reply->sslConfiguration().peerCertificate());
+        writeTlsState();
+        reply->ignoreSslErrors();
+    }
+}
+
+void NetworkSession::onEncrypted(QNetworkReply *reply)
+{
+    auto configuration = reply->sslConfiguration();
+    auto sessionTicket = configuration.sessionTicket();
+
+    if (sessionTicket.isEmpty() || (sessionTicket == m_sslConfiguration.sessionTicket()))
+        return;
+
+    auto lifetime = configuration.sessionTicketLifeTimeHint();
+
+    if (lifetime <= 0)
+        lifetime = DEFAULT_SESSION_TICKET_LIFETIME;
+    m_sslConfiguration.setSessionTicket(sessionTicket);
+    m_sessionTicketExpiry = QDateTime::currentDateTimeUtc().addSecs(lifetime);
+    writeTlsState();
+}
+
+void NetworkSession::onCircuitBreakerStateChanged(CircuitBreaker::State state,
+                                                  CircuitBreaker::State previous)
+{
+    switch (state) {
+    case CircuitBreaker::State::Open:
+        // nothing waiting in the queue would get through now
+        while (!m_queue.empty()) {
+            auto pending = std::move(m_queue.front());
+
+            m_queue.pop_front();
+            reject(std::move(pending));
+        }
+        emit reachableChanged(false);
+        break;
+    case CircuitBreaker::State::HalfOpen:
+    case CircuitBreaker::State::Closed:
+        // a request may close the breaker before the probe has got through
+        if (previous == CircuitBreaker::State::Open)
+            emit reachableChanged(true);
+        break;
+    }
+}
+
+void NetworkSession::enqueue(PendingRequest &&pending)
+{
+    if (!m_circuitBreaker.allowsRequests()) {
+        reject(std::move(pending));
+
+        return;
+    }
+    m_queue.emplace_back(std::move(pending));
+    startRequests();
+}
+
+void NetworkSession::reject(PendingRequest &&pending)
+{
+    if (!pending.receiver)
+        return;
+
+    auto operation = QNetworkAccessManager::CustomOperation;
+
+    switch (pending.operation) {
+    case Operation::Get:
+        operation = QNetworkAccessManager::GetOperation;
+        break;
+    case Operation::Post:
+        operation = QNetworkAccessManager::PostOperation;
+        break;
+    case Operation::Custom:
+        break;
+    }
+
+    auto *reply = new RejectedReply(pending.request, operation, this);
+    auto receiver = pending.receiver;
+    auto handler = pending.handler;
+
+    connect(reply, &QNetworkReply::finished, this, [reply, receiver, handler]() {
+        if (receiver)
+            handler.finished(reply);
+        reply->deleteLater();
+    });
+}
+
+// whether the reply is a digest challenge, which may be answered by sending the request again
+bool NetworkSession::isChallenge(QNetworkReply *reply, bool challenged) const
+{
+    return !challenged && m_authenticator.hasCredentials()
+           && (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt()
+               == HTTP_UNAUTHORIZED);
+}
+
+void NetworkSession::readTlsState()
+{
+    QSettings settings;
+
+    settings.beginGroup(TLS_GROUP);
+    settings.beginGroup(m_tlsStateKey);
+
+    auto certificates = QSslCertificate::fromData(settings.value(CERTIFICATE_KEY).toByteArray());
+    auto expiry = settings.value(SESSION_TICKET_EXPIRY_KEY).toDateTime();
+
+    if (!certificates.isEmpty())
+        pinCertificate(certificates.first());
+    if (expiry.isValid() && (expiry > QDateTime::currentDateTimeUtc())) {
+        auto sessionTicket = settings.value(SESSION_TICKET_KEY).toByteArray();
+
+        m_sslConfiguration.setSessionTicket(QByteArray::fromBase64(sessionTicket));
+        m_sessionTicketExpiry = expiry;
+    }
+    settings.endGroup();
+    settings.endGroup();
+}
+
+void NetworkSession::writeTlsState() const
+{
+    QSettings settings;
+
+    settings.beginGroup(TLS_GROUP);
+    settings.beginGroup(m_tlsStateKey);
+    if (!m_pinnedCertificate.isNull())
+        settings.setValue(CERTIFICATE_KEY, m_pinnedCertificate.toPem());
+    if (m_sessionTicketExpiry.isValid()) {
+        settings.setValue(SESSION_TICKET_KEY, m_sslConfiguration.sessionTicket().toBase64());
+        settings.setValue(SESSION_TICKET_EXPIRY_KEY, m_sessionTicketExpiry);
+    }
+    settings.endGroup();
+    settings.endGroup();
+}
+
+void NetworkSession::pinCertificate(const QSslCertificate &certificate)
+{
+    m_pinnedCertificate = certificate;
+    m_pinnedErrors = { QSslError(QSslError::SelfSignedCertificate, certificate) };
+}
+
+void NetworkSession::startRequests()
+{
+    while ((m_inFlight < m_maxConnections) && !m_queue.empty()) {
+        // nobody is waiting for the reply anymore
+        if (!m_queue.front().receiver) {
+            m_queue.pop_front();
+            continue;
+        }
+        // while half open, the others wait for the outcome of the trial request
+        if (!m_circuitBreaker.tryRequest())
+            break;
+
+        auto pending = std::move(m_queue.front());
+
+        m_queue.pop_front();
+
+        auto request = pending.request;
+
+        // saves the round trip for the challenge once the host has sent one
+        if (m_authenticator.hasChallenge())
+            request.setRawHeader(AUTHORIZATION_HEADER,
+                                 m_authenticator.authorization(pending.verb,
+                                                               requestURI(request.url())));
+
+        if (!m_tlsStateKey.isEmpty())
+            request.setSslConfiguration(m_sslConfiguration);
+
+        QNetworkReply *reply = nullptr;
+
+        switch (pending.operation) {
+        case Operation::Get:
+            reply = m_networkAccess.get(request);
+            break;
+        case Operation::Post:
+            reply = m_networkAccess.post(request, pending.data);
+            break;
+        case Operation::Custom:
+            reply = m_networkAccess.sendCustomRequest(request, pending.verb);
+            break;
+        }
+
+        auto receiver = pending.receiver;
+        auto handler = pending.handler;
+        auto challenged = pending.challenged;
+
+        ++m_requests;
+        ++m_inFlight;
+        if (request.url().scheme() == HTTPS_SCHEME) {
+            if (!m_pinnedErrors.isEmpty())
+                reply->ignoreSslErrors(m_pinnedErrors);
+            // only emitted for new connections, reused ones are already encrypted
+            connect(reply, &QNetworkReply::encrypted, this, [this]() {
+                ++m_handshakes;
+            });
+        } else if (m_inFlight > m_peakInFlight) {
+            // idle connections are reused, so only exceeding the peak opens a new one
+            m_peakInFlight = m_inFlight;
+            ++m_handshakes;
+        }
+        if (handler.started)
+            handler.started(reply);
+        if (handler.readyRead)
+            connect(reply, &QNetworkReply::readyRead, this,
+                    [this, reply, receiver, handler, challenged]() {
+                if (receiver && !isChallenge(reply, challenged))
+                    handler.readyRead(reply);
+            });
+        if (m_requestTimeout > 0)
+            QTimer::singleShot(m_requestTimeout, reply, [reply]() {
+                if (reply->isRunning())
+                    reply->abort();
+            });
+        connect(reply, &QNetworkReply::finished, this, [this, reply, pending]() {
+            --m_inFlight;
+            if (isConnectionFailure(reply->error()))
+                m_circuitBreaker.recordFailure();
+            else
+                m_circuitBreaker.recordSuccess();
+            if (pending.receiver && isChallenge(reply, pending.challenged)) {
+                auto authorized = reply->request().hasRawHeader(AUTHORIZATION_HEADER);
+
+                // a rejected authorization with a fresh nonce means wrong credentials
+                if (m_authenticator.setChallenge(reply->rawHeader(WWW_AUTHENTICATE_HEADER))
+                    && (!authorized || m_authenticator.isStale())) {
+                    auto retry = pending;
+
+                    retry.challenged = true;
+                    m_queue.emplace_front(std::move(retry));
+                    reply->deleteLater();
+                    startRequests();
+
+                    return;
+                }
+            }
+            if (pending.receiver)
+                pending.handler.finished(reply);
+            reply->deleteLater();
+            startRequests();
+        });
+    }
+}
+
+SessionPool::SessionPool()
+  : m_sessions(),
+    m_sessionCreated()
+{}
+
+SessionPool::~SessionPool() = default;
+
+std::shared_ptr<NetworkSession> SessionPool::session(const QUrl &url)
+{
+    auto key = url.scheme() + QStringLiteral("://") + url.authority();
+    auto &session = m_sessions[key];
+
+    if (!session) {
+        session = std::make_shared<NetworkSession>(url);
+        if (m_sessionCreated)
+            m_sessionCreated(session.get());
+    }
+
+    return session;
+}
+
+void SessionPool::setSessionCreated(const SessionCallback &sessionCreated)
+{
+    m_sessionCreated = sessionCreated;
+}
+
+} // namespace net
+} // namespace fritzmon
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_NET_NETWORKSESSION_HPP
+#define FRITZMON_NET_NETWORKSESSION_HPP
+
+#include "CircuitBreaker.hpp"
+#include "DigestAuthenticator.hpp"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QString>
+
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkRequest>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslConfiguration>
+#include <QtNetwork/QSslError>
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+class QNetworkReply;
+class QUrl;
+
+namespace fritzmon {
+namespace net {
+
+using ReplyCallback = std::function<void(QNetworkReply *reply)>;
+
+struct ReplyHandler
+{
+    ReplyCallback readyRead; //< optional, for consuming the data while it arrives
+    ReplyCallback finished;
+    ReplyCallback started;   //< optional, when the request leaves the queue and is sent
+};
+
+/* All requests to one host go through a single session, so the connections are kept alive and
+ * shared between discovery, description downloads and the polling.
+ *
+ * At most ``maxConnections`` requests are in flight at the same time, the others are queued.  The
+ * replies are deleted after the callback returns.
+ *
+ * Requests are aborted after ``requestTimeout``.  Connection failures are counted by the circuit
+ * breaker of the session; while it is open, requests are not sent but finish right away with a
+ * ``QNetworkReply::TemporaryNetworkFailureError``.
+ *
+ * With credentials set, requests are authorized with the cached digest challenge of the host.  A
+ * request is sent a second time only if it was challenged without carrying an authorization, or
+ * if its nonce was stale; the body of such a challenge is not passed to the handler.
+ *
+ * For HTTPS, the TLS session ticket of the host is reused by all requests and kept in the
+ * settings, so new connections resume the session instead of doing a full handshake, even after a
+ * restart.  The self-signed certificate of the router is pinned when it is seen first, afterwards
+ * only this certificate is accepted without evaluating the SSL errors again.
+ */
+class NetworkSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr auto DEFAULT_MAX_CONNECTIONS = 2;
+    static constexpr auto DEFAULT_REQUEST_TIMEOUT = 5000; //< in ms
+
+    // ``url`` names the host, which is probed by the circuit breaker
+    explicit NetworkSession(const QUrl &url, QObject *parent=nullptr);
+    ~NetworkSession();
+
+    // the callback is dropped if ``receiver`` is destroyed before the reply arrives
+    void get(const QNetworkRequest &request, QObject *receiver, const ReplyCallback &finished);
+    void post(const QNetworkRequest &request, const QByteArray &data, QObject *receiver,
+              const ReplyCallback &finished);
+    void get(const QNetworkRequest &request, QObject *receiver, const ReplyHandler &handler);
+    void post(const QNetworkRequest &request, const QByteArray &data, QObject *receiver,
+              const ReplyHandler &handler);
+    // for the methods without a body which are not known to HTTP, like the GENA ``SUBSCRIBE``
+    void sendCustomRequest(const QNetworkRequest &request, const QByteArray &verb,
+                           QObject *receiver, const ReplyCallback &finished);
+
+    void setMaxConnections(int maxConnections);
+    int maxConnections() const;
+    void setRequestTimeout(int requestTimeout);
+    int requestTimeout() const;
+
+    CircuitBreaker &circuitBreaker();
+    bool isReachable() const;
+
+    void setCredentials(const QString &userName, const QString &password);
+    const DigestAuthenticator &authenticator() const;
+
+    quint64 requests() const;
+    // TLS handshakes as reported by the replies; for plain HTTP the number of opened connections
+    // is estimated from the highest number of requests in flight
+    quint64 handshakes() const;
+    quint64 handshakesAvoided() const;
+
+Q_SIGNALS:
+    void reachableChanged(bool reachable);
+
+private:
+    enum class Operation {
+        Get,
+        Post,
+        Custom
+    };
+
+    struct PendingRequest
+    {
+        Operation operation;
+        QByteArray verb;   //< the method, also for GET and POST
+        QNetworkRequest request;
+        QByteArray data;
+        QPointer<QObject> receiver;
+        ReplyHandler handler;
+        bool challenged;   //< already sent again after an authentication challenge
+    };
+
+    Q_SLOT void onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors);
+    Q_SLOT void onEncrypted(QNetworkReply *reply);
+    Q_SLOT void onCircuitBreakerStateChanged(CircuitBreaker::State state,
+                                             CircuitBreaker::State previous);
+    void enqueue(PendingRequest &&pending);
+    void startRequests();
+    void reject(PendingRequest &&pending);
+    bool isChallenge(QNetworkReply *reply, bool challenged) const;
+    void readTlsState();
+    void writeTlsState() const;
+    void pinCertificate(const QSslCertificate &certificate);
+
+    QNetworkAccessManager m_networkAccess;
+    CircuitBreaker m_circuitBreaker;
+    DigestAuthenticator m_authenticator;
+    QString m_tlsStateKey;           //< empty for plain HTTP
+    QSslConfiguration m_sslConfiguration;
+    QDateTime m_sessionTicketExpiry;
+    QSslCertificate m_pinnedCertificate;
+    QList<QSslError> m_pinnedErrors; //< expected for the pinned certificate
+    std::deque<PendingRequest> m_queue;
+    int m_maxConnections;
+    int m_requestTimeout;
+    int m_inFlight;
+    int m_peakInFlight;
+    quint64 m_requests;
+    quint64 m_handshakes;
+
+    Q_DISABLE_COPY(NetworkSession)
+};
+
+// Hands out one session per scheme and authority
+class SessionPool
+{
+public:
+    using SessionCallback = std::function<void(NetworkSession *session)>;
+
+    SessionPool();
+    ~SessionPool();
+
+    std::shared_ptr<NetworkSession> session(const QUrl &url);
+
+    // called for every session when it is created, e.g. to configure the credentials
+    void setSessionCreated(const SessionCallback &sessionCreated);
+
+private:
+    QHash<QString, std::shared_ptr<NetworkSession>> m_sessions;
+    SessionCallback m_sessionCreated;
+
+    Q_DISABLE_COPY(SessionPool)
+};
+
+} // namespace net
+} // namespace fritzmon
+
+#endif // FRITZMON_NET_NETWORKSESSION_HPP
@@ -28,12 +28,17 @@
 #define FRITZMON_SOAP_IMESSAGEBODYHANDLER_HPP
 
 #include <QtCore/QString>
-
-class QXmlStreamReader;
+#include <QtCore/QStringRef>
 
 namespace fritzmon {
 namespace soap {
 
+/* Receives the body entries whose namespace matches the one the handler was registered for.
+ *
+ * All elements inside such an entry are passed on, regardless of their own namespace, so the
+ * unqualified arguments of a response reach the handler of the response element.  The tags and
+ * the text refer to the parser's buffer and are only valid during the call.
+ */
 class IMessageBodyHandler
 {
 public:
@@ -42,9 +47,11 @@ public:
 
     QString namespaceURI() const;
 
-    virtual bool startElement(const QString &tag, QXmlStreamReader &stream) = 0;
+    virtual bool startElement(const QStringRef &tag) = 0;
+    // The text of an element may arrive in several pieces, if the reply is split between reads
+    virtual bool characters(const QStringRef &text) = 0;
     virtual bool startMessage() = 0; //< This should reset the handlers internal state
-    virtual bool endElement(const QString &tag) = 0;
+    virtual bool endElement(const QStringRef &tag) = 0;
     virtual bool endMessage() = 0; //< This should finalize the handler, e.g. notify observers
 
 private:
@@ -26,15 +26,21 @@
 
 #include "Request.hpp"
 #include "IMessageBodyHandler.hpp"
+#include "RequestTemplate.hpp"
+
+#include "Metrics.hpp"
+
+#include "net/NetworkSession.hpp"
 
 #include <QtCore/QDebug>
+#include <QtCore/QLatin1String>
 #include <QtCore/QXmlStreamReader>
 
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkRequest>
-#include <QtNetwork/QSslError>
 
-#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace fritzmon {
 namespace soap {
@@ -45,38 +51,134 @@ static constexpr auto REQUEST_DEBUG_DUMP = true;
 static constexpr auto REQUEST_DEBUG_DUMP = false;
 #endif
 
+#if defined(SOAP_SCANNER_VALIDATION)
+static constexpr auto SCANNER_VALIDATION = true;
+#else
+static constexpr auto SCANNER_VALIDATION = false;
+#endif
+
 // static constexpr auto *SOAP_NAMESPACE_URI = "http://www.w3.org/2003/05/soap-envelope";
 static constexpr auto *SOAP_NAMESPACE_URI = "http://schemas.xmlsoap.org/soap/envelope/";
 static constexpr auto *SOAP_ROOT = "Envelope";
 static constexpr auto *SOAP_HEADER = "Header";
 static constexpr auto *SOAP_BODY = "Body";
 
-static constexpr auto *SOAPACTION_HEADER = "SOAPACTION";
-static constexpr auto *CONTENT_TYPE = "text/xml; charset=\"utf-8\"";
-static constexpr auto *ENVELOPE_BEGIN = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\"><s:Body>";
-static constexpr auto *ENVELOPE_END = "</s:Body></s:Envelope>";
+// passes the events on to ``target`` and keeps the arguments, to compare them with the scanner
+class RecordingHandler : public IMessageBodyHandler
+{
+public:
+    explicit RecordingHandler(IMessageBodyHandler *target);
 
-Request::Request(QObject *parent)
-  : QObject(parent),
-    m_networkAccess(),
-    m_messageBodyHandlers()
+    IMessageBodyHandler *target() const;
+    const std::vector<std::pair<QString, QString>> &arguments() const;
+
+    bool startElement(const QStringRef &tag) override;
+    bool characters(const QStringRef &text) override;
+    bool startMessage() override;
+    bool endElement(const QStringRef &tag) override;
+    bool endMessage() override;
+
+private:
+    IMessageBodyHandler *m_target;
+    std::vector<std::pair<QString, QString>> m_arguments;
+    int m_depth;
+};
+
+RecordingHandler::RecordingHandler(IMessageBodyHandler *target)
+  : IMessageBodyHandler(target->namespaceURI()),
+    m_target(target),
+    m_arguments(),
+    m_depth(0)
+{}
+
+IMessageBodyHandler *RecordingHandler::target() const
+{
+    return m_target;
+}
+
+const std::vector<std::pair<QString, QString>> &RecordingHandler::arguments() const
 {
-    connect(&m_networkAccess, &QNetworkAccessManager::finished, this, &Request::onRequestCompleted);
-    connect(&m_networkAccess, &QNetworkAccessManager::sslErrors, this, &Request::onSslErrors);
+    return m_arguments;
 }
 
+bool RecordingHandler::startElement(const QStringRef &tag)
+{
+    // the response element is at depth 1, its arguments below
+    if (++m_depth == 2)
+        m_arguments.emplace_back(tag.toString(), QString());
+
+    return m_target->startElement(tag);
+}
+
+bool RecordingHandler::characters(const QStringRef &text)
+{
+    if (m_depth == 2)
+        m_arguments.back().second += text;
+
+    return m_target->characters(text);
+}
+
+bool RecordingHandler::startMessage()
+{
+    m_arguments.clear();
+    m_depth = 0;
+
+    return m_target->startMessage();
+}
+
+bool RecordingHandler::endElement(const QStringRef &tag)
+{
+    --m_depth;
+
+    return m_target->endElement(tag);
+}
+
+bool RecordingHandler::endMessage()
+{
+    return m_target->endMessage();
+}
+
+Request::Request(const std::shared_ptr<net::NetworkSession> &session, QObject *parent)
+  : QObject(parent),
+    m_session(session),
+    m_messageBodyHandlers(),
+    m_reader(),
+    m_parserState(ParserState::Prolog),
+    m_messageHandler(nullptr),
+    m_entryHandler(nullptr),
+    m_bodyDepth(0),
+    m_scanner(),
+    m_scanResponse(false),
+    m_buffer(),
+    m_recorder(),
+    m_actionName(),
+    m_timer(),
+    m_sentAt(-1),
+    m_firstByteAt(-1)
+{}
+
 Request::~Request() = default;
 
 void Request::addMessageHandler(const QString &namespaceURI,
                                 const std::shared_ptr<IMessageBodyHandler> &handler)
 {
-    m_messageBodyHandlers.emplace_back(namespaceURI, handler);
+    auto key = qHash(namespaceURI);
+
+    for (auto it = m_messageBodyHandlers.find(key); it != m_messageBodyHandlers.end(); ++it) {
+        if (it.key() != key)
+            break;
+        if (it->first == namespaceURI) {
+            it->second = handler;
+
+            return;
+        }
+    }
+    m_messageBodyHandlers.insert(key, HandlerEntry(namespaceURI, handler));
 }
 
-void Request::start(const QUrl &url, const QString &action, const QString &bodyText)
+void Request::start(const RequestTemplate &requestTemplate, const QStringList &arguments)
 {
-    auto requestText = QString(ENVELOPE_BEGIN).append(bodyText).append(ENVELOPE_END).toUtf8();
-    auto request = QNetworkRequest(url);
+    auto requestText = requestTemplate.body(arguments);
 
     if (REQUEST_DEBUG_DUMP) {
         qDebug() << "Request::start: >>>>>>>>";
@@ -84,104 +186,289 @@ void Request::start(const QUrl &url, const QString &action, const QString &bodyT
         qDebug() << "Request::start: >>>>>>>>";
     }
 
-    request.setHeader(QNetworkRequest::ContentTypeHeader, CONTENT_TYPE);
-    request.setRawHeader(SOAPACTION_HEADER, action.toUtf8());
-    m_networkAccess.post(request, requestText);
+    m_reader.clear();
+    m_parserState = ParserState::Prolog;
+    m_messageHandler = nullptr;
+    m_entryHandler = nullptr;
+    m_bodyDepth = 0;
+    m_scanResponse = requestTemplate.hasResponseShape();
+    if (m_scanResponse)
+        m_scanner.setShape(requestTemplate.namespaceURI(), requestTemplate.responseName(),
+                           requestTemplate.responseArgumentNames());
+    m_buffer.clear();
+    m_recorder.reset();
+    m_actionName = requestTemplate.actionName();
+    m_sentAt = -1;
+    m_firstByteAt = -1;
+    m_timer.start();
+    m_session->post(requestTemplate.networkRequest(), requestText, this, net::ReplyHandler{
+        [this](QNetworkReply *reply) {
+            if (m_firstByteAt < 0)
+                m_firstByteAt = m_timer.nsecsElapsed();
+            if (m_scanResponse)
+                m_buffer.append(reply->readAll());
+            else
+                parseReply(reply->readAll());
+        },
+        [this](QNetworkReply *reply) { onRequestCompleted(reply); },
+        [this](QNetworkReply *) { m_sentAt = m_timer.nsecsElapsed(); }
+    });
 }
 
 void Request::onRequestCompleted(QNetworkReply *reply)
 {
     if (reply->error() != QNetworkReply::NoError)
         qDebug() << "Request::onRequestCompleted:" << reply->errorString();
-    else
-        parseReply(reply->readAll());
+    else {
+        recordLatency();
+        if (!m_scanResponse)
+            parseReply(reply->readAll());
+        else {
+            m_buffer.append(reply->readAll());
+            if (scanReply()) {
+                emit finished();
+
+                return;
+            }
+            parseReply(m_buffer);
+        }
+        if (m_parserState == ParserState::Prolog)
+            qDebug() << "Request::onRequestCompleted: empty reply";
+        else if (m_reader.error() == QXmlStreamReader::PrematureEndOfDocumentError) {
+            qDebug() << "Request::onRequestCompleted: incomplete reply";
+            fail();
+        } else if (m_parserState != ParserState::Error)
+            endMessage();
+        if (m_recorder)
+            validateScan();
+    }
 
     emit finished();
 }
 
-void Request::onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors)
+void Request::recordLatency()
 {
-    if ((errors.size() == 1) && (errors[0].error() == QSslError::SelfSignedCertificate)) {
-        qDebug() << "Request::onSslErrors: self-signed certificate (ignored)";
-        reply->ignoreSslErrors();
-    }
+    auto completeAt = m_timer.nsecsElapsed();
+
+    if (m_sentAt < 0)
+        return;
+    // a reply without a body is read completely on finishing
+    if (m_firstByteAt < 0)
+        m_firstByteAt = completeAt;
+
+    auto &latency = Metrics::instance().requestLatency(m_actionName);
+
+    latency.queued.record(m_sentAt / 1000);
+    latency.firstByte.record((m_firstByteAt - m_sentAt) / 1000);
+    latency.complete.record((completeAt - m_sentAt) / 1000);
 }
 
 void Request::parseReply(const QByteArray &data)
 {
-    QXmlStreamReader stream(data);
-    enum class ParserState {
-        Start,
-        Header,
-        Body
-    } state = ParserState::Start;
-
     if (REQUEST_DEBUG_DUMP) {
         qDebug() << "Request::parseReply: <<<<<<<<";
         qDebug() << "Request::parseReply:" << data;
         qDebug() << "Request::parseReply: <<<<<<<<";
     }
-    if (stream.atEnd()) {
-        qDebug() << "Request::parseReply: empty description document";
-
-        return;
-    }
-    for (const auto &handler : m_messageBodyHandlers)
-        std::get<1>(handler)->startMessage();
-        // TODO: how to react on errors? For now, they are simply ignored
-
-    // start reading
-    stream.readNext();
-    // read root element and "verify" schema
-    stream.readNext();
-    if ((stream.namespaceUri() != SOAP_NAMESPACE_URI) || (stream.name() != SOAP_ROOT)) {
-        qDebug() << "Request::parseReply: parse error: no SOAP envelope";
-        qDebug() << "Request::parseReply: expected" << SOAP_NAMESPACE_URI << ":"
-                 << SOAP_ROOT;
-        qDebug() << "Request::parseReply: received" << stream.namespaceUri() << ":"
-                 << stream.name();
 
-        return;
-    }
-    for (stream.readNext(); !stream.atEnd(); stream.readNext()) {
-        auto token = stream.tokenType();
-        auto tag = stream.name();
-
-        switch (state) {
-        case ParserState::Start:
-            if (token == QXmlStreamReader::StartElement) {
-                if (tag == SOAP_HEADER)
-                    state = ParserState::Header;
-                else if (tag == SOAP_BODY)
-                    state = ParserState::Body;
+    // an incomplete reply ends with a premature end error, which is recovered from by adding
+    // more data and reading on
+    m_reader.addData(data);
+    while (m_parserState != ParserState::Error) {
+        switch (m_reader.readNext()) {
+        case QXmlStreamReader::Invalid:
+            if (m_reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
+                qDebug() << "Request::parseReply: parse error:" << m_reader.errorString();
+                fail();
             }
+
+            return;
+        case QXmlStreamReader::EndDocument:
+            return;
+        case QXmlStreamReader::StartElement:
+            startElement();
+            break;
+        case QXmlStreamReader::Characters:
+            characters();
             break;
-        case ParserState::Header:
-            // ignore the header for now
-            if ((token == QXmlStreamReader::EndElement) && (tag == SOAP_HEADER))
-                state = ParserState::Start;
+        case QXmlStreamReader::EndElement:
+            endElement();
             break;
-        case ParserState::Body:
-            auto namespaceURI = stream.namespaceUri();
-
-            if ((token == QXmlStreamReader::EndElement) && (tag == SOAP_BODY))
-                state = ParserState::Start;
-            else if ((token == QXmlStreamReader::EndElement)
-                     || (token == QXmlStreamReader::StartElement))
-                for (auto &handlerPair : m_messageBodyHandlers)
-                    if (std::get<0>(handlerPair) == namespaceURI) {
-                        if (token == QXmlStreamReader::StartElement)
-                            std::get<1>(handlerPair)->startElement(tag.toString(), stream);
-                        else
-                            std::get<1>(handlerPair)->endElement(tag.toString());
-                    }
+        default:
             break;
         }
     }
-    if (stream.hasError())
-        qDebug() << "Request::parseReply: parse error:" << stream.errorString();
-    for (const auto &handler : m_messageBodyHandlers)
-        std::get<1>(handler)->endMessage();
+}
+
+void Request::startElement()
+{
+    auto tag = m_reader.name();
+
+    switch (m_parserState) {
+    case ParserState::Prolog:
+        // "verify" the schema
+        if ((m_reader.namespaceUri() != QLatin1String(SOAP_NAMESPACE_URI))
+            || (tag != QLatin1String(SOAP_ROOT))) {
+            qDebug() << "Request::parseReply: parse error: no SOAP envelope";
+            qDebug() << "Request::parseReply: expected" << SOAP_NAMESPACE_URI << ":"
+                     << SOAP_ROOT;
+            qDebug() << "Request::parseReply: received" << m_reader.namespaceUri() << ":"
+                     << tag;
+            m_parserState = ParserState::Error;
+
+            return;
+        }
+        m_parserState = ParserState::Start;
+        break;
+    case ParserState::Start:
+        if (tag == QLatin1String(SOAP_HEADER))
+            m_parserState = ParserState::Header;
+        else if (tag == QLatin1String(SOAP_BODY))
+            m_parserState = ParserState::Body;
+        break;
+    case ParserState::Body:
+        // the handler is looked up once per body entry, its children are passed on directly
+        if (m_bodyDepth++ == 0) {
+            m_entryHandler = messageHandler(m_reader.namespaceUri());
+            if (m_entryHandler && (m_entryHandler != m_messageHandler)) {
+                endMessage();
+                m_messageHandler = m_entryHandler;
+                // TODO: how to react on errors? For now, they are simply ignored
+                m_messageHandler->startMessage();
+            }
+        }
+        if (m_entryHandler)
+            m_entryHandler->startElement(tag);
+        break;
+    case ParserState::Header:
+    case ParserState::Error:
+        break;
+    }
+}
+
+void Request::endElement()
+{
+    auto tag = m_reader.name();
+
+    switch (m_parserState) {
+    case ParserState::Header:
+        // ignore the header for now
+        if (tag == QLatin1String(SOAP_HEADER))
+            m_parserState = ParserState::Start;
+        break;
+    case ParserState::Body:
+        if (m_bodyDepth == 0) {
+            m_parserState = ParserState::Start;
+            break;
+        }
+        if (m_entryHandler)
+            m_entryHandler->endElement(tag);
+        if (--m_bodyDepth == 0)
+            m_entryHandler = nullptr;
+        break;
+    case ParserState::Prolog:
+    case ParserState::Start:
+    case ParserState::Error:
+        break;
+    }
+}
+
+void Request::characters()
+{
+    if ((m_parserState == ParserState::Body) && m_entryHandler)
+        m_entryHandler->characters(m_reader.text());
+}
+
+void Request::endMessage()
+{
+    if (!m_messageHandler)
+        return;
+    m_messageHandler->endMessage();
+    m_messageHandler = nullptr;
+}
+
+// the message is dropped without finishing it, so its handler does not deliver partial arguments
+void Request::fail()
+{
+    m_messageHandler = nullptr;
+    m_entryHandler = nullptr;
+    m_parserState = ParserState::Error;
+}
+
+// delivers a reply of the expected shape from the scanner, without parsing it
+bool Request::scanReply()
+{
+    if (!m_scanner.scan(m_buffer)) {
+        if (REQUEST_DEBUG_DUMP)
+            qDebug() << "Request::scanReply: unexpected reply to" << m_actionName;
+
+        return false;
+    }
+
+    auto *handler = messageHandler(QStringRef(&m_scanner.namespaceURI()));
+
+    if (!handler)
+        return false;
+    if (SCANNER_VALIDATION) {
+        // the reply is parsed anyway, and the recorder compares what the handler receives
+        m_recorder = std::make_unique<RecordingHandler>(handler);
+
+        return false;
+    }
+
+    auto responseName = QStringRef(&m_scanner.responseName());
+    const auto &argumentNames = m_scanner.argumentNames();
+
+    // the same events as the parser would dispatch
+    handler->startMessage();
+    handler->startElement(responseName);
+    for (auto i = 0; i < argumentNames.size(); ++i) {
+        auto name = QStringRef(&argumentNames[i]);
+        auto value = m_scanner.value(i);
+
+        handler->startElement(name);
+        if (!value.isEmpty())
+            handler->characters(value);
+        handler->endElement(name);
+    }
+    handler->endElement(responseName);
+    handler->endMessage();
+
+    return true;
+}
+
+void Request::validateScan()
+{
+    const auto &arguments = m_recorder->arguments();
+    const auto &argumentNames = m_scanner.argumentNames();
+    auto matches = (static_cast<int>(arguments.size()) == argumentNames.size());
+
+    for (auto i = 0; matches && (i < argumentNames.size()); ++i)
+        matches = (arguments[i].first == argumentNames[i])
+                  && (arguments[i].second == m_scanner.value(i));
+    if (!matches)
+        qDebug() << "Request::validateScan: the scanner disagrees with the parser on"
+                 << m_actionName;
+    m_recorder.reset();
+}
+
+IMessageBodyHandler *Request::messageHandler(const QStringRef &namespaceURI) const
+{
+    auto key = qHash(namespaceURI);
+
+    for (auto it = m_messageBodyHandlers.constFind(key); it != m_messageBodyHandlers.cend(); ++it) {
+        if (it.key() != key)
+            break;
+        if (it->first != namespaceURI)
+            continue;
+        // while validating the scanner, the handler is wrapped by the recorder
+        if (m_recorder && (m_recorder->target() == it->second.get()))
+            return m_recorder.get();
+
+        return it->second.get();
+    }
+
+    return nullptr;
 }
 
 } // namespace soap
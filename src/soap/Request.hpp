@@ -27,46 +27,90 @@
 #ifndef FRITZMON_SOAP_REQUEST_HPP
 #define FRITZMON_SOAP_REQUEST_HPP
 
-#include <QtCore/QList>
-#include <QtCore/QObject>
+#include "ResponseScanner.hpp"
 
-#include <QtNetwork/QNetworkAccessManager>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMultiHash>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QXmlStreamReader>
 
 #include <memory>
 #include <utility>
-#include <string>
-#include <vector>
 
 class QNetworkReply;
-class QSslError;
 
 namespace fritzmon {
+
+namespace net {
+
+class NetworkSession;
+
+} // namespace net
+
 namespace soap {
 
 class IMessageBodyHandler;
+class RecordingHandler;
+class RequestTemplate;
 
 class Request : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit Request(QObject *parent=nullptr);
+    explicit Request(const std::shared_ptr<net::NetworkSession> &session,
+                     QObject *parent=nullptr);
     ~Request();
 
+    // replaces the handler registered before for the same namespace
     void addMessageHandler(const QString &namespaceURI,
                            const std::shared_ptr<IMessageBodyHandler> &handler);
-    void start(const QUrl &url, const QString &action, const QString &bodyText);
+    void start(const RequestTemplate &requestTemplate, const QStringList &arguments);
 
 Q_SIGNALS:
     void finished();
 
 private:
-    Q_SLOT void onRequestCompleted(QNetworkReply *reply);
-    Q_SLOT void onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors);
+    void onRequestCompleted(QNetworkReply *reply);
     void parseReply(const QByteArray &data);
-
-    QNetworkAccessManager m_networkAccess;
-    std::vector<std::pair<QString, std::shared_ptr<IMessageBodyHandler>>> m_messageBodyHandlers;
+    void startElement();
+    void endElement();
+    void characters();
+    void endMessage();
+    void fail();
+    bool scanReply();
+    void validateScan();
+    IMessageBodyHandler *messageHandler(const QStringRef &namespaceURI) const;
+    void recordLatency();
+
+    using HandlerEntry = std::pair<QString, std::shared_ptr<IMessageBodyHandler>>;
+
+    std::shared_ptr<net::NetworkSession> m_session;
+    // keyed by the hash of the namespace, so the parser's QStringRef is looked up without a copy
+    QMultiHash<uint, HandlerEntry> m_messageBodyHandlers;
+    // the reply is parsed while it is received
+    QXmlStreamReader m_reader;
+    enum class ParserState {
+        Prolog,
+        Start,
+        Header,
+        Body,
+        Error
+    } m_parserState;
+    IMessageBodyHandler *m_messageHandler; //< which has started the current message
+    IMessageBodyHandler *m_entryHandler;   //< of the current body entry, if any
+    int m_bodyDepth;                       //< of the current element below the body
+    // replies of a known shape are buffered and scanned, the parser is the fallback
+    ResponseScanner m_scanner;
+    bool m_scanResponse;
+    QByteArray m_buffer;
+    std::unique_ptr<RecordingHandler> m_recorder; //< for validating the scanner
+    QString m_actionName; //< of the current call, for recording its latency
+    QElapsedTimer m_timer;
+    // timestamps of the current call in ns since ``start``, -1 if not reached yet
+    qint64 m_sentAt;
+    qint64 m_firstByteAt;
 
     Q_DISABLE_COPY(Request)
 };
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "RequestTemplate.hpp"
+
+#include <QtCore/QUrl>
+
+namespace fritzmon {
+namespace soap {
+
+static constexpr auto *SOAPACTION_HEADER = "SOAPACTION";
+static constexpr auto *CONTENT_TYPE = "text/xml; charset=\"utf-8\"";
+static constexpr auto *ENVELOPE_BEGIN = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?><s:Envelope xmlns:s=\"http://www.w3.org/2003/05/soap-envelope\"><s:Body>";
+static constexpr auto *ENVELOPE_END = "</s:Body></s:Envelope>";
+static constexpr auto *ACTION_PREFIX = "u:";
+static constexpr auto *RESPONSE_SUFFIX = "Response";
+
+RequestTemplate::RequestTemplate()
+  : m_actionName(),
+    m_namespaceURI(),
+    m_responseName(),
+    m_request(),
+    m_argumentNames(),
+    m_responseArgumentNames(),
+    m_responseShape(false),
+    m_segments(1),
+    m_segmentsSize(0)
+{}
+
+RequestTemplate::RequestTemplate(const QUrl &url, const QString &namespaceURI,
+                                 const QString &actionName, const QStringList &argumentNames,
+                                 bool qualifiedArguments)
+  : m_actionName(actionName),
+    m_namespaceURI(namespaceURI),
+    m_responseName(actionName + RESPONSE_SUFFIX),
+    m_request(url),
+    m_argumentNames(argumentNames),
+    m_responseArgumentNames(),
+    m_responseShape(false),
+    m_segments(),
+    m_segmentsSize(0)
+{
+    auto segment = QString(ENVELOPE_BEGIN) + '<' + ACTION_PREFIX + actionName + " xmlns:u=\""
+                   + namespaceURI.toHtmlEscaped() + "\">";
+
+    for (const auto &name : argumentNames) {
+        auto tag = qualifiedArguments ? ACTION_PREFIX + name : name;
+
+        segment += '<' + tag + '>';
+        m_segments.push_back(segment.toUtf8());
+        segment = "</" + tag + '>';
+    }
+    segment += QString("</") + ACTION_PREFIX + actionName + '>' + ENVELOPE_END;
+    m_segments.push_back(segment.toUtf8());
+    for (const auto &bytes : m_segments)
+        m_segmentsSize += bytes.size();
+
+    m_request.setHeader(QNetworkRequest::ContentTypeHeader, CONTENT_TYPE);
+    m_request.setRawHeader(SOAPACTION_HEADER, (namespaceURI + '#' + actionName).toUtf8());
+}
+
+const QString &RequestTemplate::actionName() const
+{
+    return m_actionName;
+}
+
+const QString &RequestTemplate::namespaceURI() const
+{
+    return m_namespaceURI;
+}
+
+const QString &RequestTemplate::responseName() const
+{
+    return m_responseName;
+}
+
+const QNetworkRequest &RequestTemplate::networkRequest() const
+{
+    return m_request;
+}
+
+const QStringList &RequestTemplate::argumentNames() const
+{
+    return m_argumentNames;
+}
+
+void RequestTemplate::setResponseArgumentNames(const QStringList &responseArgumentNames)
+{
+    m_responseArgumentNames = responseArgumentNames;
+    m_responseShape = true;
+}
+
+const QStringList &RequestTemplate::responseArgumentNames() const
+{
+    return m_responseArgumentNames;
+}
+
+bool RequestTemplate::hasResponseShape() const
+{
+    return m_responseShape;
+}
+
+QByteArray RequestTemplate::body(const QStringList &arguments) const
+{
+    if (m_segments.size() == 1)
+        return m_segments.front();
+
+    auto values = std::vector<QByteArray>();
+    auto size = m_segmentsSize;
+
+    values.reserve(m_segments.size() - 1);
+    for (auto i = 0u; i < m_segments.size() - 1; ++i) {
+        values.push_back((static_cast<int>(i) < arguments.size())
+                         ? arguments[i].toHtmlEscaped().toUtf8() : QByteArray());
+        size += values.back().size();
+    }
+
+    auto data = QByteArray();
+
+    data.reserve(size);
+    for (auto i = 0u; i < values.size(); ++i)
+        data.append(m_segments[i]).append(values[i]);
+    data.append(m_segments.back());
+
+    return data;
+}
+
+} // namespace soap
+} // namespace fritzmon
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_SOAP_REQUESTTEMPLATE_HPP
+#define FRITZMON_SOAP_REQUESTTEMPLATE_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include <QtNetwork/QNetworkRequest>
+
+#include <vector>
+
+class QUrl;
+
+namespace fritzmon {
+namespace soap {
+
+/* A request for one action, serialized once.
+ *
+ * The envelope is kept as the UTF-8 segments between the argument values, so a request is built
+ * by escaping the values and joining the segments.  Without arguments, the body is shared and not
+ * copied at all.
+ */
+class RequestTemplate
+{
+public:
+    RequestTemplate();
+    // ``qualifiedArguments`` puts the arguments into the namespace of the action as well
+    RequestTemplate(const QUrl &url, const QString &namespaceURI, const QString &actionName,
+                    const QStringList &argumentNames, bool qualifiedArguments=false);
+
+    const QString &actionName() const;
+    const QString &namespaceURI() const;
+    const QString &responseName() const;
+    const QNetworkRequest &networkRequest() const;
+    const QStringList &argumentNames() const;
+    // with the output arguments known, the responses are scanned instead of parsed if possible
+    void setResponseArgumentNames(const QStringList &responseArgumentNames);
+    const QStringList &responseArgumentNames() const;
+    bool hasResponseShape() const;
+    // ``arguments`` are in the order of ``argumentNames``, missing values are left empty
+    QByteArray body(const QStringList &arguments) const;
+
+private:
+    QString m_actionName;
+    QString m_namespaceURI;
+    QString m_responseName;
+    QNetworkRequest m_request;
+    QStringList m_argumentNames;
+    QStringList m_responseArgumentNames;
+    bool m_responseShape;
+    std::vector<QByteArray> m_segments; //< one more than there are arguments
+    int m_segmentsSize;
+};
+
+} // namespace soap
+} // namespace fritzmon
+
+#endif // FRITZMON_SOAP_REQUESTTEMPLATE_HPP
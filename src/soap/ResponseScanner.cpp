@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ResponseScanner.hpp"
+
+#include <QtCore/QLatin1String>
+
+namespace fritzmon {
+namespace soap {
+
+static constexpr auto *SOAP_NAMESPACE_URI = "http://schemas.xmlsoap.org/soap/envelope/";
+static constexpr auto *SOAP_ROOT = "Envelope";
+static constexpr auto *SOAP_BODY = "Body";
+static constexpr auto *XMLNS_ATTRIBUTE = "xmlns";
+static constexpr auto *XMLNS_PREFIX = "xmlns:";
+
+static bool isSpace(QChar c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+static bool isBlank(const QStringRef &text)
+{
+    for (auto c : text)
+        if (!isSpace(c))
+            return false;
+
+    return true;
+}
+
+ResponseScanner::ResponseScanner()
+  : m_namespaceURI(),
+    m_responseName(),
+    m_argumentNames(),
+    m_text(),
+    m_pos(0),
+    m_values()
+{}
+
+ResponseScanner::~ResponseScanner() = default;
+
+void ResponseScanner::setShape(const QString &namespaceURI, const QString &responseName,
+                               const QStringList &argumentNames)
+{
+    m_namespaceURI = namespaceURI;
+    m_responseName = responseName;
+    m_argumentNames = argumentNames;
+}
+
+const QString &ResponseScanner::namespaceURI() const
+{
+    return m_namespaceURI;
+}
+
+const QString &ResponseScanner::responseName() const
+{
+    return m_responseName;
+}
+
+const QStringList &ResponseScanner::argumentNames() const
+{
+    return m_argumentNames;
+}
+
+bool ResponseScanner::scan(const QByteArray &reply)
+{
+    m_text = QString::fromUtf8(reply);
+    m_pos = 0;
+    m_values.clear();
+
+    // the XML declaration
+    skipSpace();
+    if (m_text.midRef(m_pos, 2) == QLatin1String("<?")) {
+        auto end = m_text.indexOf(QLatin1String("?>"), m_pos);
+
+        if (end < 0)
+            return false;
+        m_pos = end + 2;
+    }
+
+    Tag envelope;
+    Tag body;
+    Tag response;
+
+    if (!readStartTag(&envelope) || envelope.empty
+        || (envelope.localName != QLatin1String(SOAP_ROOT))
+        || (namespaceDeclaration(envelope) != QLatin1String(SOAP_NAMESPACE_URI)))
+        return false;
+    // a header is not expected in a response
+    if (!readStartTag(&body) || body.empty || (body.localName != QLatin1String(SOAP_BODY))
+        || (body.prefix != envelope.prefix))
+        return false;
+    if (!readStartTag(&response) || (response.localName != m_responseName)
+        || (namespaceDeclaration(response) != m_namespaceURI))
+        return false;
+    if (response.empty)
+        return m_argumentNames.isEmpty() && readEndTag(body.name) && readEndTag(envelope.name);
+
+    for (const auto &name : m_argumentNames) {
+        Tag argument;
+        auto start = 0;
+        auto length = 0;
+
+        if (!readStartTag(&argument) || !argument.prefix.isEmpty()
+            || (argument.localName != name) || !isBlank(argument.attributes))
+            return false;
+        start = m_pos;
+        if (!argument.empty && (!readText(&length) || !readEndTag(argument.name)))
+            return false;
+        m_values.emplace_back(start, length);
+    }
+    if (!readEndTag(response.name) || !readEndTag(body.name) || !readEndTag(envelope.name))
+        return false;
+    skipSpace();
+
+    return m_pos == m_text.size();
+}
+
+QStringRef ResponseScanner::value(int index) const
+{
+    const auto &value = m_values[index];
+
+    return m_text.midRef(value.first, value.second);
+}
+
+void ResponseScanner::skipSpace()
+{
+    while ((m_pos < m_text.size()) && isSpace(m_text[m_pos]))
+        ++m_pos;
+}
+
+bool ResponseScanner::readStartTag(Tag *tag)
+{
+    skipSpace();
+    if ((m_pos >= m_text.size()) || (m_text[m_pos] != '<'))
+        return false;
+
+    auto start = ++m_pos;
+    auto colon = -1;
+
+    while ((m_pos < m_text.size()) && !isSpace(m_text[m_pos]) && (m_text[m_pos] != '>')
+           && (m_text[m_pos] != '/')) {
+        auto c = m_text[m_pos];
+
+        // comments, CDATA, processing instructions and end tags
+        if ((c == '!') || (c == '?'))
+            return false;
+        if ((c == ':') && (colon < 0))
+            colon = m_pos;
+        ++m_pos;
+    }
+    if (m_pos == start)
+        return false;
+    tag->name = m_text.midRef(start, m_pos - start);
+    tag->prefix = m_text.midRef(start, (colon < 0) ? 0 : colon - start);
+    tag->localName = (colon < 0) ? tag->name : m_text.midRef(colon + 1, m_pos - colon - 1);
+
+    auto attributes = m_pos;
+    auto quote = QChar();
+
+    for (; m_pos < m_text.size(); ++m_pos) {
+        auto c = m_text[m_pos];
+
+        if (!quote.isNull()) {
+            if (c == quote)
+                quote = QChar();
+        } else if ((c == '"') || (c == '\''))
+            quote = c;
+        else if (c == '>')
+            break;
+    }
+    if (m_pos >= m_text.size())
+        return false;
+    tag->empty = (m_pos > attributes) && (m_text[m_pos - 1] == '/');
+    tag->attributes = m_text.midRef(attributes, m_pos - attributes - (tag->empty ? 1 : 0));
+    ++m_pos;
+
+    return true;
+}
+
+bool ResponseScanner::readEndTag(const QStringRef &name)
+{
+    skipSpace();
+    if ((m_text.midRef(m_pos, 2) != QLatin1String("</"))
+        || (m_text.midRef(m_pos + 2, name.size()) != name))
+        return false;
+    m_pos += 2 + name.size();
+    skipSpace();
+    if ((m_pos >= m_text.size()) || (m_text[m_pos] != '>'))
+        return false;
+    ++m_pos;
+
+    return true;
+}
+
+bool ResponseScanner::readText(int *length)
+{
+    auto end = m_text.indexOf('<', m_pos);
+
+    if (end < 0)
+        return false;
+    // entity and character references would have to be resolved
+    if (m_text.midRef(m_pos, end - m_pos).contains('&'))
+        return false;
+    *length = end - m_pos;
+    m_pos = end;
+
+    return true;
+}
+
+// the namespace which the tag declares for its own prefix, or a null reference
+QStringRef ResponseScanner::namespaceDeclaration(const Tag &tag) const
+{
+    auto pos = tag.attributes.position();
+    auto end = pos + tag.attributes.size();
+
+    while (pos < end) {
+        while ((pos < end) && isSpace(m_text[pos]))
+            ++pos;
+
+        auto nameStart = pos;
+
+        while ((pos < end) && (m_text[pos] != '=') && !isSpace(m_text[pos]))
+            ++pos;
+
+        auto name = m_text.midRef(nameStart, pos - nameStart);
+
+        while ((pos < end) && (isSpace(m_text[pos]) || (m_text[pos] == '=')))
+            ++pos;
+        if ((pos >= end) || ((m_text[pos] != '"') && (m_text[pos] != '\'')))
+            return QStringRef();
+
+        auto quote = m_text[pos];
+        auto valueStart = ++pos;
+
+        while ((pos < end) && (m_text[pos] != quote))
+            ++pos;
+
+        auto value = m_text.midRef(valueStart, pos - valueStart);
+
+        auto xmlnsPrefix = QLatin1String(XMLNS_PREFIX);
+
+        ++pos;
+        if (tag.prefix.isEmpty() ? (name == QLatin1String(XMLNS_ATTRIBUTE))
+                                 : (name.startsWith(xmlnsPrefix)
+                                    && (m_text.midRef(name.position() + xmlnsPrefix.size(),
+                                                      name.size() - xmlnsPrefix.size())
+                                        == tag.prefix)))
+            return value;
+    }
+
+    return QStringRef();
+}
+
+} // namespace soap
+} // namespace fritzmon
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_SOAP_RESPONSESCANNER_HPP
+#define FRITZMON_SOAP_RESPONSESCANNER_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QStringRef>
+
+#include <utility>
+#include <vector>
+
+namespace fritzmon {
+namespace soap {
+
+/* Extracts the arguments of a response with a known shape without a full XML parse.
+ *
+ * The expected shape is an envelope with a body which contains only the response element, whose
+ * namespace is declared on itself, and its arguments as text-only elements in the given order.
+ * Anything else, like a header, a fault, comments, CDATA or entity references, makes ``scan``
+ * fail, and the reply has to be parsed by ``Request`` as usual.
+ */
+class ResponseScanner
+{
+public:
+    ResponseScanner();
+    ~ResponseScanner();
+
+    void setShape(const QString &namespaceURI, const QString &responseName,
+                  const QStringList &argumentNames);
+    const QString &namespaceURI() const;
+    const QString &responseName() const;
+    const QStringList &argumentNames() const;
+
+    bool scan(const QByteArray &reply);
+    // of the argument at ``index`` of ``argumentNames``, valid until the next scan
+    QStringRef value(int index) const;
+
+private:
+    struct Tag
+    {
+        QStringRef name;       //< qualified
+        QStringRef prefix;
+        QStringRef localName;
+        QStringRef attributes;
+        bool empty;            //< ``<tag/>``
+    };
+
+    void skipSpace();
+    bool readStartTag(Tag *tag);
+    bool readEndTag(const QStringRef &name);
+    bool readText(int *length);
+    QStringRef namespaceDeclaration(const Tag &tag) const;
+
+    QString m_namespaceURI;
+    QString m_responseName;
+    QStringList m_argumentNames;
+    QString m_text;                         //< the decoded reply
+    int m_pos;
+    std::vector<std::pair<int, int>> m_values; //< position and length in the text
+};
+
+} // namespace soap
+} // namespace fritzmon
+
+#endif // FRITZMON_SOAP_RESPONSESCANNER_HPP
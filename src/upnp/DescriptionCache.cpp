@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DescriptionCache.hpp"
+
+#include "net/NetworkSession.hpp"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+namespace fritzmon {
+namespace upnp {
+namespace internal {
+
+static constexpr auto *CACHE_DIRECTORY = "descriptions";
+static constexpr auto *CACHE_FILE_SUFFIX = ".cache";
+static constexpr auto CACHE_FILE_VERSION = 1u;
+static constexpr auto *ETAG_HEADER = "ETag";
+static constexpr auto *LAST_MODIFIED_HEADER = "Last-Modified";
+static constexpr auto *IF_NONE_MATCH_HEADER = "If-None-Match";
+static constexpr auto *IF_MODIFIED_SINCE_HEADER = "If-Modified-Since";
+static constexpr auto HTTP_OK = 200;
+static constexpr auto HTTP_NOT_MODIFIED = 304;
+
+static QByteArray entryKey(const QUrl &url, const QString &identity)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    hash.addData(identity.toUtf8());
+    hash.addData("\n");
+    hash.addData(url.toEncoded());
+
+    return hash.result().toHex();
+}
+
+static QString entryPath(const QByteArray &key)
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QLatin1Char('/')
+           + QLatin1String(CACHE_DIRECTORY) + QLatin1Char('/') + QString::fromLatin1(key)
+           + QLatin1String(CACHE_FILE_SUFFIX);
+}
+
+DescriptionCache &DescriptionCache::instance()
+{
+    static DescriptionCache cache;
+
+    return cache;
+}
+
+DescriptionCache::DescriptionCache()
+  : QObject(),
+    m_entries(),
+    m_hits(0),
+    m_misses(0),
+    m_notModified(0)
+{}
+
+QByteArray DescriptionCache::document(const QUrl &url, const QString &identity)
+{
+    auto *cached = entry(entryKey(url, identity));
+
+    if (!cached) {
+        ++m_misses;
+
+        return QByteArray();
+    }
+    ++m_hits;
+
+    return cached->document;
+}
+
+void DescriptionCache::store(const QUrl &url, const QString &identity, QNetworkReply *reply,
+                             const QByteArray &document)
+{
+    if (document.isEmpty()
+            || (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != HTTP_OK))
+        return;
+
+    auto key = entryKey(url, identity);
+    auto &stored = m_entries[key];
+
+    stored.entityTag = reply->rawHeader(ETAG_HEADER);
+    stored.lastModified = reply->rawHeader(LAST_MODIFIED_HEADER);
+    stored.document = document;
+    // it has just been downloaded, so there is no need to revalidate it on this run
+    stored.validated.start();
+    writeEntry(key, url, identity, stored);
+}
+
+void DescriptionCache::revalidate(const std::shared_ptr<net::NetworkSession> &session,
+                                  const QUrl &url, const QString &identity)
+{
+    auto *cached = entry(entryKey(url, identity));
+
+    if (!cached)
+        return;
+    if (cached->validated.isValid() && !cached->validated.hasExpired(REVALIDATION_INTERVAL))
+        return;
+    // also keeps the devices which are built again from the cache from sending a second request
+    cached->validated.start();
+
+    auto request = QNetworkRequest(url);
+
+    // without validators, the router sends the document and it is compared with the cached copy
+    if (!cached->entityTag.isEmpty())
+        request.setRawHeader(IF_NONE_MATCH_HEADER, cached->entityTag);
+    if (!cached->lastModified.isEmpty())
+        request.setRawHeader(IF_MODIFIED_SINCE_HEADER, cached->lastModified);
+    session->get(request, this, [this, url, identity](QNetworkReply *reply) {
+        onRevalidated(reply, url, identity);
+    });
+}
+
+quint64 DescriptionCache::hits() const
+{
+    return m_hits;
+}
+
+quint64 DescriptionCache::misses() const
+{
+    return m_misses;
+}
+
+quint64 DescriptionCache::notModified() const
+{
+    return m_notModified;
+}
+
+void DescriptionCache::onRevalidated(QNetworkReply *reply, const QUrl &url,
+                                     const QString &identity)
+{
+    auto key = entryKey(url, identity);
+    auto *cached = entry(key);
+
+    if (!cached)
+        return;
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "DescriptionCache::onRevalidated: network error:" << reply->errorString();
+        // tried again the next time the document is served
+        cached->validated.invalidate();
+
+        return;
+    }
+
+    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (status == HTTP_NOT_MODIFIED) {
+        ++m_notModified;
+
+        return;
+    }
+    if (status != HTTP_OK) {
+        qDebug() << "DescriptionCache::onRevalidated: unexpected status" << status << "for" << url;
+
+        return;
+    }
+
+    auto document = reply->readAll();
+    auto entityTag = reply->rawHeader(ETAG_HEADER);
+    auto lastModified = reply->rawHeader(LAST_MODIFIED_HEADER);
+    auto changed = document != cached->document;
+
+    if (!changed && (entityTag == cached->entityTag) && (lastModified == cached->lastModified))
+        return;
+    cached->entityTag = entityTag;
+    cached->lastModified = lastModified;
+    cached->document = document;
+    writeEntry(key, url, identity, *cached);
+    if (changed) {
+        qDebug() << "DescriptionCache::onRevalidated: description changed:" << url;
+        emit documentChanged(url, identity);
+    }
+}
+
+DescriptionCache::Entry *DescriptionCache::entry(const QByteArray &key)
+{
+    auto cached = m_entries.find(key);
+
+    if (cached != m_entries.end())
+        return &cached.value();
+
+    auto stored = Entry();
+
+    if (!readEntry(key, &stored))
+        return nullptr;
+
+    return &m_entries.insert(key, stored).value();
+}
+
+bool DescriptionCache::readEntry(const QByteArray &key, Entry *entry) const
+{
+    QFile file(entryPath(key));
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    auto version = quint32(0);
+    auto url = QString();
+    auto identity = QString();
+
+    stream >> version >> url >> identity >> entry->entityTag >> entry->lastModified
+           >> entry->document;
+    if ((stream.status() != QDataStream::Ok) || (version != CACHE_FILE_VERSION)
+            || entry->document.isEmpty()) {
+        qDebug() << "DescriptionCache: ignoring invalid cache file" << file.fileName();
+
+        return false;
+    }
+
+    return true;
+}
+
+void DescriptionCache::writeEntry(const QByteArray &key, const QUrl &url,
+                                  const QString &identity, const Entry &entry) const
+{
+    auto path = entryPath(key);
+
+    if (!QDir().mkpath(QFileInfo(path).path())) {
+        qDebug() << "DescriptionCache: failed to create the cache directory for" << path;
+
+        return;
+    }
+
+    QSaveFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "DescriptionCache: failed to write" << path;
+
+        return;
+    }
+
+    QDataStream stream(&file);
+
+    // the URL and identity are not read back, they only tell what the file contains
+    stream << quint32(CACHE_FILE_VERSION) << url.toString() << identity << entry.entityTag
+           << entry.lastModified << entry.document;
+    if (!file.commit())
+        qDebug() << "DescriptionCache: failed to write" << path;
+}
+
+} // namespace internal
+} // namespace upnp
+} // namespace fritzmon
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_UPNP_DESCRIPTIONCACHE_HPP
+#define FRITZMON_UPNP_DESCRIPTIONCACHE_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+
+#include <memory>
+
+class QNetworkReply;
+
+namespace fritzmon {
+
+namespace net {
+
+class NetworkSession;
+
+} // namespace net
+
+namespace upnp {
+namespace internal {
+
+/* Keeps the device and service descriptions on disk, so the devices can be built from the cached
+ * copies right away on start instead of waiting for the downloads.
+ *
+ * The documents are keyed by their URL and an identity, which is empty for the device
+ * descriptions and names the device and its firmware for the service descriptions.  A served
+ * document is revalidated in the background with a conditional request; if the router sends a
+ * different document, the cached copy is replaced and ``documentChanged`` is emitted, so the
+ * devices can be built again.
+ */
+class DescriptionCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr auto REVALIDATION_INTERVAL = 60000; //< in ms, per document
+
+    static DescriptionCache &instance();
+
+    // returns an empty document if there is no cached copy
+    QByteArray document(const QUrl &url, const QString &identity=QString());
+    // stores a document downloaded without a cached copy, along with the validators of ``reply``
+    void store(const QUrl &url, const QString &identity, QNetworkReply *reply,
+               const QByteArray &document);
+    // does nothing if the document has been validated during the last ``REVALIDATION_INTERVAL``
+    void revalidate(const std::shared_ptr<net::NetworkSession> &session, const QUrl &url,
+                    const QString &identity=QString());
+
+    quint64 hits() const;
+    quint64 misses() const;
+    quint64 notModified() const; //< revalidations answered without a document
+
+Q_SIGNALS:
+    void documentChanged(const QUrl &url, const QString &identity);
+
+private:
+    struct Entry
+    {
+        QByteArray entityTag;    //< ``ETag`` of the cached document
+        QByteArray lastModified; //< ``Last-Modified`` of the cached document
+        QByteArray document;
+        QElapsedTimer validated; //< invalid until the document was checked with the router
+    };
+
+    DescriptionCache();
+
+    void onRevalidated(QNetworkReply *reply, const QUrl &url, const QString &identity);
+    Entry *entry(const QByteArray &key);
+    bool readEntry(const QByteArray &key, Entry *entry) const;
+    void writeEntry(const QByteArray &key, const QUrl &url, const QString &identity,
+                    const Entry &entry) const;
+
+    QHash<QByteArray, Entry> m_entries; //< keyed by entryKey(), read from disk on first use
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_notModified;
+
+    Q_DISABLE_COPY(DescriptionCache)
+};
+
+} // namespace internal
+} // namespace upnp
+} // namespace fritzmon
+
+#endif // FRITZMON_UPNP_DESCRIPTIONCACHE_HPP
@@ -40,7 +40,9 @@ namespace internal {
 
 DeviceBuilder::DeviceBuilder(QObject *parent)
   : QObject(parent),
-    m_instance(new Device())
+    m_instance(new Device()),
+    m_readyServices(),
+    m_complete(false)
 {}
 
 DeviceBuilder::~DeviceBuilder() = default;
@@ -52,6 +54,9 @@ DeviceBuilder &DeviceBuilder::addChild(std::unique_ptr<DeviceBuilder> child)
     auto result = connect(m_subDeviceBuilders.back().get(), &DeviceBuilder::finished,
                           this,                            &DeviceBuilder::onDeviceBuilderFinished);
     Q_ASSERT(result);
+    result = connect(m_subDeviceBuilders.back().get(), &DeviceBuilder::serviceReady,
+                     this,                            &DeviceBuilder::onServiceReady);
+    Q_ASSERT(result);
     Q_UNUSED(result);
 
     return *this;
@@ -159,6 +164,17 @@ DeviceBuilder &DeviceBuilder::iconURL(const QString &url)
     return *this;
 }
 
+QString DeviceBuilder::identity() const
+{
+    // the model number carries the firmware version, so an update does not use stale descriptions
+    return m_instance->m_uniqueDeviceName + QLatin1Char('/') + m_instance->m_modelNumber;
+}
+
+QString DeviceBuilder::uniqueDeviceName() const
+{
+    return m_instance->m_uniqueDeviceName;
+}
+
 std::unique_ptr<Device> DeviceBuilder::create()
 {
     auto ptr = std::unique_ptr<Device>();
@@ -168,14 +184,27 @@ std::unique_ptr<Device> DeviceBuilder::create()
     return ptr;
 }
 
+void DeviceBuilder::complete()
+{
+    auto readyServices = std::vector<Service *>();
+
+    m_complete = true;
+    readyServices.swap(m_readyServices);
+    for (auto *service : readyServices)
+        emit serviceReady(service);
+    checkFinished();
+}
+
 void DeviceBuilder::onServiceDetected()
 {
     auto *sender = qobject_cast<ServiceBuilder *>(QObject::sender());
     auto serviceBuilder = removeSmartpointerFromVector(m_serviceBuilders, sender);
 
-    if (serviceBuilder)
+    if (serviceBuilder) {
         m_instance->m_services.push_back(serviceBuilder->create());
-    else
+        // the service keeps its address when the device is handed over
+        onServiceReady(m_instance->m_services.back().get());
+    } else
         qDebug() << "DeviceBuilder::onServiceDetected: service not in builder pool";
     checkFinished();
 }
@@ -192,9 +221,17 @@ void DeviceBuilder::onDeviceBuilderFinished()
     checkFinished();
 }
 
+void DeviceBuilder::onServiceReady(Service *service)
+{
+    if (m_complete)
+        emit serviceReady(service);
+    else
+        m_readyServices.push_back(service);
+}
+
 void DeviceBuilder::checkFinished()
 {
-    if ((m_subDeviceBuilders.size() == 0) && (m_serviceBuilders.size() == 0))
+    if (m_complete && (m_subDeviceBuilders.size() == 0) && (m_serviceBuilders.size() == 0))
         emit finished();
 }
 
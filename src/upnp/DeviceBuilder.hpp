@@ -38,6 +38,7 @@ namespace fritzmon {
 namespace upnp {
 
 class Device;
+class Service;
 
 namespace internal {
 
@@ -52,7 +53,8 @@ public:
     ~DeviceBuilder();
 
     DeviceBuilder &addChild(std::unique_ptr<DeviceBuilder> addChild);
-    // Calls ``builder->startDetection()``, so ``scpdURL`` *must* be set
+    // Calls ``builder->startDetection()``, so ``scpdURL`` *must* be set, even if the description
+    // is loaded lazily
     DeviceBuilder &addService(std::unique_ptr<ServiceBuilder> builder);
     DeviceBuilder &description(const QString &description);
     DeviceBuilder &friendlyName(const QString &name);
@@ -69,21 +71,35 @@ public:
     DeviceBuilder &uniqueDeviceName(const QString &udn);
     DeviceBuilder &upc(const QString &upc);
     DeviceBuilder &iconURL(const QString &url);
+    // The description is parsed while the services are detected, so ``finished`` is not emitted
+    // before all services and children have been added
+    void complete();
 
+    // the UDN and model number as parsed so far, which key the cached service descriptions
+    QString identity() const;
+    QString uniqueDeviceName() const;
     std::unique_ptr<Device> create();
 
 Q_SIGNALS:
     void finished();
+    /* Also for the services of the children, the service is owned by the device under
+     * construction.  The services which are ready before the builder is complete are held back
+     * until then, so they are not emitted before the builder has been handed over.
+     */
+    void serviceReady(Service *service);
 
 private:
     Q_SLOT void onServiceDetected();
     Q_SLOT void onDeviceBuilderFinished();
+    Q_SLOT void onServiceReady(Service *service);
     std::unique_ptr<ServiceBuilder> removeServiceBuilderFromPool(ServiceBuilder *serviceBuilder);
     void checkFinished();
 
     std::vector<std::unique_ptr<ServiceBuilder>> m_serviceBuilders;
     std::vector<std::unique_ptr<DeviceBuilder>> m_subDeviceBuilders;
     std::unique_ptr<Device> m_instance;
+    std::vector<Service *> m_readyServices; //< until the builder is complete
+    bool m_complete;
 
     Q_DISABLE_COPY(DeviceBuilder)
 };
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DeviceDescriptionParser.hpp"
+
+#include "DeviceBuilder.hpp"
+#include "ServiceBuilder.hpp"
+
+#include "net/NetworkSession.hpp"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDebug>
+
+namespace fritzmon {
+namespace upnp {
+namespace internal {
+
+static constexpr auto DESCRIPTION_NAMESPACE_URI = "urn:schemas-upnp-org:device-1-0";
+static constexpr auto ROOT_TAG = "root";
+static constexpr auto DEVICE_TAG = "device";
+static constexpr auto DEVICETYPE_TAG = "deviceType";
+static constexpr auto FRIENDLYNAME_TAG = "friendlyName";
+static constexpr auto MANUFACTURER_TAG = "manufacturer";
+static constexpr auto MANUFACTURERURL_TAG = "manufacturerURL";
+static constexpr auto MODELDESCRIPTION_TAG = "modelDescription";
+static constexpr auto MODELNAME_TAG = "modelName";
+static constexpr auto MODELNUMBER_TAG = "modelNumber";
+static constexpr auto MODELURL_TAG = "modelURL";
+static constexpr auto SERIALNUMBER_TAG = "serialNumber";
+static constexpr auto UDN_TAG = "UDN";
+static constexpr auto UPC_TAG = "upc";
+static constexpr auto SERVICE_TAG = "service";
+static constexpr auto SERVICETYPE_TAG = "serviceType";
+static constexpr auto SERVICEID_TAG = "serviceId";
+static constexpr auto SCPDURL_TAG = "SCPDURL";
+static constexpr auto CONTROLURL_TAG = "controlURL";
+static constexpr auto EVENTSUBURL_TAG = "eventSubURL";
+
+DeviceDescriptionParser::DeviceDescriptionParser(const QUrl &baseURL,
+                                                 const std::shared_ptr<net::NetworkSession> &session,
+                                                 const RootDeviceCallback &rootDeviceParsed,
+                                                 bool lazyServices)
+  : m_state(ParserState::Prolog),
+    m_reader(),
+    m_text(),
+    m_baseURL(baseURL),
+    m_session(session),
+    m_rootDeviceParsed(rootDeviceParsed),
+    m_lazyServices(lazyServices),
+    m_deviceStack(),
+    m_service()
+{}
+
+DeviceDescriptionParser::~DeviceDescriptionParser() = default;
+
+void DeviceDescriptionParser::addData(const QByteArray &data)
+{
+    m_reader.addData(data);
+    readTokens();
+}
+
+bool DeviceDescriptionParser::finish()
+{
+    if (m_state == ParserState::Prolog) {
+        qDebug() << "DeviceDescriptionParser: empty description document";
+
+        return false;
+    }
+    if (m_reader.error() == QXmlStreamReader::PrematureEndOfDocumentError) {
+        qDebug() << "DeviceDescriptionParser: incomplete description document";
+
+        return false;
+    }
+
+    return m_state != ParserState::Error;
+}
+
+void DeviceDescriptionParser::readTokens()
+{
+    // an incomplete document ends with a premature end error, which is recovered from by adding
+    // more data and reading on
+    while (m_state != ParserState::Error) {
+        switch (m_reader.readNext()) {
+        case QXmlStreamReader::Invalid:
+            if (m_reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
+                qDebug() << "DeviceDescriptionParser: parse error:" << m_reader.errorString();
+                m_state = ParserState::Error;
+            }
+
+            return;
+        case QXmlStreamReader::EndDocument:
+            return;
+        case QXmlStreamReader::StartElement:
+            m_text.clear();
+            startElement();
+            break;
+        case QXmlStreamReader::Characters:
+            m_text += m_reader.text();
+            break;
+        case QXmlStreamReader::EndElement:
+            endElement();
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void DeviceDescriptionParser::startElement()
+{
+    // Don't check for the element namespace, just assume things are right for now.  This
+    // behaviour may change if there are description documents with mixed xml schemas.
+    auto tagName = m_reader.name();
+
+    switch (m_state) {
+    case ParserState::Prolog:
+        // "verify" the schema
+        if (m_reader.namespaceUri() != DESCRIPTION_NAMESPACE_URI) {
+            qDebug() << "DeviceDescriptionParser: parse error: wrong root element namespace"
+                     << m_reader.namespaceUri();
+            m_state = ParserState::Error;
+        } else if (tagName != ROOT_TAG) {
+            qDebug() << "DeviceDescriptionParser: parse error: wrong root element name"
+                     << tagName;
+            m_state = ParserState::Error;
+        } else
+            m_state = ParserState::TopLevelElement;
+        break;
+    case ParserState::TopLevelElement:
+        if (tagName == DEVICE_TAG) {
+            m_deviceStack.emplace_back(new DeviceBuilder());
+            m_state = ParserState::Device;
+        }
+        break;
+    case ParserState::Device:
+        if (tagName == SERVICE_TAG) {
+            m_service.reset(new ServiceBuilder(m_session));
+            // the UDN and model number precede the service list in the description
+            m_service->deviceIdentity(m_deviceStack.back()->identity())
+                      .lazyDescription(m_lazyServices);
+            m_state = ParserState::Service;
+        } else if (tagName == DEVICE_TAG)
+            m_deviceStack.emplace_back(new DeviceBuilder());
+        break;
+    case ParserState::Service:
+    case ParserState::Error:
+        break;
+    }
+}
+
+void DeviceDescriptionParser::endElement()
+{
+    auto tagName = m_reader.name();
+
+    switch (m_state) {
+    case ParserState::Device: {
+        auto &device = m_deviceStack.back();
+
+        if (tagName == DEVICETYPE_TAG)
+            device->type(m_text);
+        else if (tagName == FRIENDLYNAME_TAG)
+            device->friendlyName(m_text);
+        else if (tagName == MANUFACTURER_TAG)
+            device->manufacturerName(m_text);
+        else if (tagName == MANUFACTURERURL_TAG)
+            device->manufacturerURL(m_text);
+        else if (tagName == MODELDESCRIPTION_TAG)
+            device->description(m_text);
+        else if (tagName == MODELNAME_TAG)
+            device->modelName(m_text);
+        else if (tagName == MODELNUMBER_TAG)
+            device->modelNumber(m_text);
+        else if (tagName == MODELURL_TAG)
+            device->modelURL(m_text);
+        else if (tagName == SERIALNUMBER_TAG)
+            device->serialNumber(m_text);
+        else if (tagName == UDN_TAG)
+            device->uniqueDeviceName(m_text);
+        else if (tagName == UPC_TAG)
+            device->upc(m_text);
+        else if (tagName == DEVICE_TAG) {
+            auto prototype = std::unique_ptr<DeviceBuilder>();
+
+            m_deviceStack.back().swap(prototype);
+
+            auto *builder = prototype.get();
+
+            m_deviceStack.pop_back();
+            if (m_deviceStack.empty()) {
+                m_rootDeviceParsed(std::move(prototype));
+                m_state = ParserState::TopLevelElement;
+            } else
+                m_deviceStack.back()->addChild(std::move(prototype));
+            // the builder may finish right away, so this must come after it has been handed over
+            builder->complete();
+        }
+        break;
+    }
+    case ParserState::Service:
+        if (tagName == SERVICETYPE_TAG)
+            m_service->type(m_text);
+        else if (tagName == SERVICEID_TAG)
+            m_service->id(m_text);
+        else if (tagName == SCPDURL_TAG)
+            m_service->scpdURL(resolveURL(m_text));
+        else if (tagName == CONTROLURL_TAG)
+            m_service->controlURL(resolveURL(m_text));
+        else if (tagName == EVENTSUBURL_TAG)
+            m_service->eventSubURL(resolveURL(m_text));
+        else if (tagName == SERVICE_TAG) {
+            auto builder = std::unique_ptr<ServiceBuilder>();
+
+            // starts loading the service description while the rest of the document is parsed
+            m_service.swap(builder);
+            m_deviceStack.back()->addService(std::move(builder));
+            m_state = ParserState::Device;
+        } else
+            qDebug() << "Service: unhandled tag:" << tagName;
+        break;
+    case ParserState::Prolog:
+    case ParserState::TopLevelElement:
+    case ParserState::Error:
+        break;
+    }
+}
+
+QUrl DeviceDescriptionParser::resolveURL(const QString &path) const
+{
+    auto url = QUrl(path);
+
+    url.setScheme(m_baseURL.scheme());
+    url.setAuthority(m_baseURL.authority());
+
+    return url;
+}
+
+} // namespace internal
+} // namespace upnp
+} // namespace fritzmon
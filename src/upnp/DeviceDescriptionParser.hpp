@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UPNP_INTERNAL_DEVICEDESCRIPTIONPARSER_HPP
+#define UPNP_INTERNAL_DEVICEDESCRIPTIONPARSER_HPP
+
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+#include <QtCore/QXmlStreamReader>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+class QByteArray;
+
+namespace fritzmon {
+
+namespace net {
+
+class NetworkSession;
+
+} // namespace net
+
+namespace upnp {
+namespace internal {
+
+class DeviceBuilder;
+class ServiceBuilder;
+
+using RootDeviceCallback = std::function<void(std::unique_ptr<DeviceBuilder> device)>;
+
+/* Parses a device description while it is downloaded.
+ *
+ * The service descriptions are requested as soon as the service element is complete, unless
+ * ``lazyServices`` is set, and every root device is handed to ``rootDeviceParsed`` once its
+ * element is closed.
+ */
+class DeviceDescriptionParser
+{
+public:
+    DeviceDescriptionParser(const QUrl &baseURL,
+                            const std::shared_ptr<net::NetworkSession> &session,
+                            const RootDeviceCallback &rootDeviceParsed,
+                            bool lazyServices=false);
+    ~DeviceDescriptionParser();
+
+    void addData(const QByteArray &data);
+    // returns false if the document was invalid or incomplete
+    bool finish();
+
+private:
+    void readTokens();
+    void startElement();
+    void endElement();
+    QUrl resolveURL(const QString &path) const;
+
+    enum class ParserState {
+        Prolog,
+        TopLevelElement,
+        Device,
+        Service,
+        Error
+    } m_state;
+    QXmlStreamReader m_reader;
+    QString m_text; //< character data of the current element
+    QUrl m_baseURL;
+    std::shared_ptr<net::NetworkSession> m_session;
+    RootDeviceCallback m_rootDeviceParsed;
+    bool m_lazyServices;
+    std::vector<std::unique_ptr<DeviceBuilder>> m_deviceStack;
+    std::unique_ptr<ServiceBuilder> m_service;
+
+    Q_DISABLE_COPY(DeviceDescriptionParser)
+};
+
+} // namespace internal
+} // namespace upnp
+} // namespace fritzmon
+
+#endif // UPNP_INTERNAL_DEVICEDESCRIPTIONPARSER_HPP
@@ -26,19 +26,19 @@
 
 #include "upnp/DeviceFinder.hpp"
 
+#include "upnp/DescriptionCache.hpp"
 #include "upnp/Device.hpp"
 #include "upnp/DeviceBuilder.hpp"
-#include "upnp/Service.hpp"
-#include "upnp/ServiceBuilder.hpp"
+#include "upnp/DeviceDescriptionParser.hpp"
+
+#include "net/NetworkSession.hpp"
 
 #include "util.hpp"
 
 #include <QtCore/QDebug>
-#include <QtCore/QXmlStreamReader>
 
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkRequest>
-#include <QtNetwork/QSslError>
 
 #include <algorithm>
 #include <memory>
@@ -49,47 +49,56 @@ namespace upnp {
 
 using namespace internal;
 
-static constexpr auto DESCRIPTION_NAMESPACE_URI = "urn:schemas-upnp-org:device-1-0";
-static constexpr auto ROOT_TAG = "root";
-static constexpr auto DEVICE_TAG = "device";
-static constexpr auto DEVICETYPE_TAG = "deviceType";
-static constexpr auto FRIENDLYNAME_TAG = "friendlyName";
-static constexpr auto MANUFACTURER_TAG = "manufacturer";
-static constexpr auto MANUFACTURERURL_TAG = "manufacturerURL";
-static constexpr auto MODELDESCRIPTION_TAG = "modelDescription";
-static constexpr auto MODELNAME_TAG = "modelName";
-static constexpr auto MODELNUMBER_TAG = "modelNumber";
-static constexpr auto MODELURL_TAG = "modelURL";
-static constexpr auto SERIALNUMBER_TAG = "serialNumber";
-static constexpr auto UDN_TAG = "udn";
-static constexpr auto UPC_TAG = "upc";
-static constexpr auto SERVICE_TAG = "service";
-static constexpr auto SERVICETYPE_TAG = "serviceType";
-static constexpr auto SERVICEID_TAG = "serviceId";
-static constexpr auto SCPDURL_TAG = "SCPDURL";
-static constexpr auto CONTROLURL_TAG = "controlURL";
-static constexpr auto EVENTSUBURL_TAG = "eventSubURL";
-
-DeviceFinder::DeviceFinder(QObject *parent)
+static constexpr auto *IGD_DEVICE_TYPE = "urn:schemas-upnp-org:device:InternetGatewayDevice:1";
+static constexpr auto *USN_SEPARATOR = "::";
+
+DeviceFinder::DeviceFinder(net::SessionPool &sessions, QObject *parent)
   : QObject(parent),
-    m_networkAccess(),
+    m_sessions(sessions),
+    m_session(),
+    m_parser(),
     m_devices(),
     m_baseURL(),
-    m_searching(false)
+    m_descriptionURL(),
+    m_document(),
+    m_searching(false),
+    m_refreshPending(false),
+    m_lazyServiceDescriptions(false),
+    m_discovery(),
+    m_knownLocations(),
+    m_pendingLocations()
 {
-    connect(&m_networkAccess, &QNetworkAccessManager::finished,
-            this,             &DeviceFinder::deviceDescriptionReceived);
-    connect(&m_networkAccess, &QNetworkAccessManager::sslErrors,
-            this,             &DeviceFinder::onSslErrors);
+    connect(&m_discovery, &SsdpDiscovery::deviceFound, this, &DeviceFinder::onLocationFound);
+    connect(&m_discovery, &SsdpDiscovery::deviceLost, this, &DeviceFinder::onLocationLost);
+    connect(&m_discovery, &SsdpDiscovery::searchFinished, this, [this]() {
+        checkSearchComplete();
+    });
+    connect(&DescriptionCache::instance(), &DescriptionCache::documentChanged,
+            this,                          &DeviceFinder::onDocumentChanged);
 }
 
 DeviceFinder::~DeviceFinder() = default;
 
-void DeviceFinder::cancelFind()
+void DeviceFinder::startFind(const QString &searchTarget)
 {
-    if (!m_searching)
+    auto target = searchTarget.isEmpty() ? QString(IGD_DEVICE_TYPE) : searchTarget;
+
+    if (m_searching) {
+        qDebug() << "DeviceFinder: already searching";
+
         return;
-    m_baseURL.clear();
+    }
+
+    removeDevices();
+    m_searching = true;
+    m_session.reset();
+    m_knownLocations.clear();
+    m_pendingLocations.clear();
+    m_discovery.listen(target);
+    m_discovery.search(target);
+    // the cached devices are only reported again if their location changes
+    for (const auto &location : m_discovery.locations())
+        onLocationFound(QString(), location);
 }
 
 void DeviceFinder::findDevice(const QUrl &descriptionDocumentURL)
@@ -100,10 +109,36 @@ void DeviceFinder::findDevice(const QUrl &descriptionDocumentURL)
         return;
     }
 
+    // a new search replaces the devices found before, e.g. after the router restarted
+    removeDevices();
+    m_searching = true;
+    m_knownLocations.clear();
+    m_knownLocations.insert(descriptionDocumentURL);
+    m_pendingLocations.clear();
+    fetchDescription(descriptionDocumentURL);
+}
+
+void DeviceFinder::cancelFind()
+{
+    if (!m_searching)
+        return;
     m_baseURL.clear();
-    m_baseURL.setScheme(descriptionDocumentURL.scheme());
-    m_baseURL.setAuthority(descriptionDocumentURL.authority());
-    m_networkAccess.get(QNetworkRequest(descriptionDocumentURL));
+    m_pendingLocations.clear();
+}
+
+SsdpDiscovery &DeviceFinder::discovery()
+{
+    return m_discovery;
+}
+
+void DeviceFinder::setLazyServiceDescriptions(bool lazy)
+{
+    m_lazyServiceDescriptions = lazy;
+}
+
+bool DeviceFinder::lazyServiceDescriptions() const
+{
+    return m_lazyServiceDescriptions;
 }
 
 const std::vector<std::unique_ptr<Device> > &DeviceFinder::devices() const
@@ -116,16 +151,101 @@ bool DeviceFinder::searching() const
     return m_searching;
 }
 
+std::shared_ptr<net::NetworkSession> DeviceFinder::session() const
+{
+    return m_session;
+}
+
+void DeviceFinder::fetchDescription(const QUrl &descriptionDocumentURL)
+{
+    m_baseURL.clear();
+    m_baseURL.setScheme(descriptionDocumentURL.scheme());
+    m_baseURL.setAuthority(descriptionDocumentURL.authority());
+    m_session = m_sessions.session(descriptionDocumentURL);
+    m_descriptionURL = descriptionDocumentURL;
+
+    auto &cache = DescriptionCache::instance();
+    auto cached = cache.document(descriptionDocumentURL);
+
+    if (!cached.isEmpty()) {
+        createParser();
+        m_parser->addData(cached);
+
+        auto valid = m_parser->finish();
+
+        m_parser.reset();
+        if (valid) {
+            cache.revalidate(m_session, descriptionDocumentURL);
+            fetchNextDescription();
+            checkSearchComplete();
+
+            return;
+        }
+        // the root device is only handed over once it is complete, so nothing has been built yet
+        qDebug() << "DeviceFinder::fetchDescription: invalid cached description of"
+                 << descriptionDocumentURL;
+    }
+    createParser();
+    m_document.clear();
+    m_session->get(QNetworkRequest(descriptionDocumentURL), this, net::ReplyHandler{
+        [this](QNetworkReply *reply) {
+            auto data = reply->readAll();
+
+            m_document += data;
+            m_parser->addData(data);
+        },
+        [this](QNetworkReply *reply) { deviceDescriptionReceived(reply); }
+    });
+}
+
+void DeviceFinder::fetchNextDescription()
+{
+    // the description parser handles one document at a time
+    if (m_parser || m_pendingLocations.empty())
+        return;
+
+    auto location = m_pendingLocations.front();
+
+    m_pendingLocations.pop_front();
+    fetchDescription(location);
+}
+
+void DeviceFinder::createParser()
+{
+    m_parser.reset(new DeviceDescriptionParser(m_baseURL, m_session,
+                                               [this](std::unique_ptr<DeviceBuilder> device) {
+        m_deviceBuilders.emplace_back(std::move(device));
+
+        auto *builder = m_deviceBuilders.back().get();
+        auto result = connect(builder, &DeviceBuilder::finished,
+                              this,    &DeviceFinder::onDeviceFinished);
+        Q_ASSERT(result);
+        result = connect(builder, &DeviceBuilder::serviceReady,
+                         this,    [this, builder](Service *service) {
+            emit serviceReady(builder->uniqueDeviceName(), service);
+        });
+        Q_ASSERT(result);
+        Q_UNUSED(result);
+    }, m_lazyServiceDescriptions));
+}
+
 void DeviceFinder::deviceDescriptionReceived(QNetworkReply *reply)
 {
-    if (reply->error() != QNetworkReply::NoError) {
+    if (reply->error() != QNetworkReply::NoError)
         qDebug() << "DeviceFinder::deviceDescriptionReceived: network error:"
                  << reply->errorString();
+    else {
+        auto data = reply->readAll();
 
-        return;
+        m_document += data;
+        m_parser->addData(data);
+        if (m_parser->finish())
+            DescriptionCache::instance().store(m_descriptionURL, QString(), reply, m_document);
     }
-
-    parseDeviceDescription(reply->readAll());
+    m_parser.reset();
+    m_document.clear();
+    fetchNextDescription();
+    checkSearchComplete();
 }
 
 void DeviceFinder::onDeviceFinished()
@@ -140,164 +260,90 @@ void DeviceFinder::onDeviceFinished()
     } else
         qDebug() << "DeviceFinder::onDeviceFinished: device not in builder pool";
 
-    // If no devices are under construction (typically waiting for their service descriptions), then
-    // inform the clients the search is completed
-    if (m_deviceBuilders.empty()) {
+    checkSearchComplete();
+}
+
+void DeviceFinder::checkSearchComplete()
+{
+    // If the description is parsed and no devices are under construction (typically waiting for
+    // their service descriptions), then inform the clients the search is completed
+    if (m_searching && !m_discovery.isSearching() && !m_parser && m_pendingLocations.empty()
+        && m_deviceBuilders.empty()) {
+        if (m_refreshPending) {
+            refreshDevices();
+
+            return;
+        }
         m_searching = false;
         emit searchComplete();
     }
 }
 
-void DeviceFinder::onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors)
+void DeviceFinder::onLocationFound(const QString &usn, const QUrl &location)
 {
-    for (const auto &error : errors)
-        qDebug() << "DeviceFinder::onSslErrors:" << error.errorString();
+    Q_UNUSED(usn);
 
-    if ((errors.size() == 1) && (errors[0].error() == QSslError::SelfSignedCertificate)) {
-        qDebug() << "DeviceFinder::onSslErrors: self signed certificate (ignored)";
-        reply->ignoreSslErrors();
-    }
+    // a device is announced under several USNs, but has only one description
+    if (m_knownLocations.contains(location))
+        return;
+    m_knownLocations.insert(location);
+    m_pendingLocations.push_back(location);
+    m_searching = true;
+    fetchNextDescription();
 }
 
-void DeviceFinder::parseDeviceDescription(const QByteArray &data)
+void DeviceFinder::onLocationLost(const QString &usn, const QUrl &location)
 {
-    enum class ParserState {
-        TopLevelElement,
-        Device,
-        Service
-    } state = ParserState::TopLevelElement;
-    QXmlStreamReader reader(data);
-    std::vector<std::unique_ptr<DeviceBuilder>> deviceStack;
-    std::unique_ptr<ServiceBuilder> service;
-
-    if (reader.atEnd()) {
-        qDebug() << "DeviceFinder: empty description document";
-
+    auto udn = usn.section(USN_SEPARATOR, 0, 0);
+    auto device = std::find_if(std::begin(m_devices), std::end(m_devices),
+                               [&udn](const std::unique_ptr<Device> &candidate) {
+        return candidate->uniqueDeviceName() == udn;
+    });
+
+    m_knownLocations.remove(location);
+    if (device == std::end(m_devices))
         return;
-    }
-    // start reading
-    reader.readNext();
-    // read root element and "verify" schema
-    reader.readNext();
-    if (reader.namespaceUri() != DESCRIPTION_NAMESPACE_URI) {
-        qDebug() << "DeviceFinder: parse error: wrong root element namespace"
-                 << reader.namespaceUri();
+    emit deviceRemoved(udn);
+    m_devices.erase(device);
+}
 
-        return;
-    }
-    if (reader.name() != ROOT_TAG) {
-        qDebug() << "DeviceFinder: parse error: wrong root element name" << reader.name();
+void DeviceFinder::onDocumentChanged(const QUrl &url)
+{
+    // the cache is shared, so only the descriptions of the hosts found here are of interest
+    auto known = std::any_of(m_knownLocations.cbegin(), m_knownLocations.cend(),
+                             [&url](const QUrl &location) {
+        return location.authority() == url.authority();
+    });
 
+    if (!known)
         return;
-    }
-    // parse the description
-    for (reader.readNext(); !reader.atEnd(); reader.readNext()) {
-        // Don't check for the element namespace, just assume things are right for now.  This
-        // behaviour may change if there are description documents with mixed xml schemas.
-
-        const auto &tokenType = reader.tokenType();
-        const auto &tagName = reader.name();
-
-        switch (state) {
-        case ParserState::TopLevelElement:
-            if ((tokenType == QXmlStreamReader::StartElement)
-                    && (tagName == DEVICE_TAG)) {
-                deviceStack.emplace_back(new DeviceBuilder());
-                state = ParserState::Device;
-            }
-            break;
-        case ParserState::Device:
-            if (tokenType == QXmlStreamReader::StartElement) {
-                auto &device = deviceStack.back();
-
-                if (tagName == DEVICETYPE_TAG)
-                    device->type(reader.readElementText());
-                if (tagName == FRIENDLYNAME_TAG)
-                    device->friendlyName(reader.readElementText());
-                else if (tagName == MANUFACTURER_TAG)
-                    device->manufacturerName(reader.readElementText());
-                else if (tagName == MANUFACTURERURL_TAG)
-                    device->manufacturerURL(reader.readElementText());
-                else if (tagName == MODELDESCRIPTION_TAG)
-                    device->description(reader.readElementText());
-                else if (tagName == MODELNAME_TAG)
-                    device->modelName(reader.readElementText());
-                else if (tagName == MODELNUMBER_TAG)
-                    device->modelNumber(reader.readElementText());
-                else if (tagName == MODELURL_TAG)
-                    device->modelURL(reader.readElementText());
-                else if (tagName == SERIALNUMBER_TAG)
-                    device->serialNumber(reader.readElementText());
-                else if (tagName == UDN_TAG)
-                    device->uniqueDeviceName(reader.readElementText());
-                else if (tagName == UPC_TAG)
-                    device->upc(reader.readElementText());
-                else if (tagName == SERVICE_TAG) {
-                    service.reset(new ServiceBuilder());
-                    state = ParserState::Service;
-                } else if (tagName == DEVICE_TAG)
-                    deviceStack.emplace_back(new DeviceBuilder());
-            } else if (tokenType == QXmlStreamReader::EndElement) {
-                if (tagName == DEVICE_TAG) {
-                    auto prototype = std::unique_ptr<DeviceBuilder>();
-
-                    deviceStack.back().swap(prototype);
-                    deviceStack.pop_back();
-                    if (deviceStack.size() == 0) {
-                        m_deviceBuilders.emplace_back(std::move(prototype));
-
-                        auto result = connect(m_deviceBuilders.back().get(),
-                                              &DeviceBuilder::finished,
-                                              this, &DeviceFinder::onDeviceFinished);
-                        Q_ASSERT(result);
-                        Q_UNUSED(result);
-                        state = ParserState::TopLevelElement;
-                    } else
-                        deviceStack.back()->addChild(std::move(prototype));
-                }
-            }
-            break;
-        case ParserState::Service:
-            if (tokenType == QXmlStreamReader::StartElement) {
-                if (tagName == SERVICETYPE_TAG)
-                    service->type(reader.readElementText());
-                else if (tagName == SERVICEID_TAG)
-                    service->id(reader.readElementText());
-                else if (tagName == SCPDURL_TAG) {
-                    auto url = QUrl(reader.readElementText());
-
-                    url.setScheme(m_baseURL.scheme());
-                    url.setAuthority(m_baseURL.authority());
-                    service->scpdURL(url);
-                } else if (tagName == CONTROLURL_TAG) {
-                    auto url = QUrl(reader.readElementText());
-
-                    url.setScheme(m_baseURL.scheme());
-                    url.setAuthority(m_baseURL.authority());
-                    service->controlURL(url);
-                } else if (tagName == EVENTSUBURL_TAG) {
-                    auto url = QUrl(reader.readElementText());
-
-                    url.setScheme(m_baseURL.scheme());
-                    url.setAuthority(m_baseURL.authority());
-                    service->eventSubURL(url);
-                } else
-                    qDebug() << "Service: unhandled tag:" << reader.name();
-            } else if ((tokenType == QXmlStreamReader::EndElement) && (tagName == SERVICE_TAG)) {
-                auto builder = std::unique_ptr<ServiceBuilder>();
-
-                service.swap(builder);
-                deviceStack.back()->addService(std::move(builder));
-                state = ParserState::Device;
-            }
-            break;
-        }
-    }
-    if (reader.hasError()) {
-        qDebug() << "DeviceFinder: parse error: " << reader.errorString();
+    // the devices under construction may have used the stale description as well
+    if (m_searching) {
+        m_refreshPending = true;
 
         return;
     }
+    refreshDevices();
+}
+
+void DeviceFinder::refreshDevices()
+{
+    qDebug() << "DeviceFinder::refreshDevices: descriptions changed, building the devices again";
+    m_refreshPending = false;
+    removeDevices();
+    m_searching = true;
+    m_pendingLocations.assign(m_knownLocations.cbegin(), m_knownLocations.cend());
+    fetchNextDescription();
+    checkSearchComplete();
+}
+
+void DeviceFinder::removeDevices()
+{
+    auto devices = std::vector<std::unique_ptr<Device>>();
+
+    devices.swap(m_devices);
+    for (const auto &device : devices)
+        emit deviceRemoved(device->uniqueDeviceName());
 }
 
 } // namespace upnp
@@ -27,24 +27,38 @@
 #ifndef UPNP_DEVICEFINDER_HPP
 #define UPNP_DEVICEFINDER_HPP
 
+#include "SsdpDiscovery.hpp"
+
+#include <QtCore/QByteArray>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QString>
 #include <QtCore/QUrl>
 
-#include <QtNetwork/QNetworkAccessManager>
-
+#include <deque>
 #include <memory>
 #include <vector>
 
 class QNetworkReply;
 
 namespace fritzmon {
+
+namespace net {
+
+class NetworkSession;
+class SessionPool;
+
+} // namespace net
+
 namespace upnp {
 
 class Device;
+class Service;
 
 namespace internal {
 
 class DeviceBuilder;
+class DeviceDescriptionParser;
 
 } // namespace internal
 
@@ -53,39 +67,74 @@ class DeviceFinder : public QObject
     Q_OBJECT
 
 public:
-    DeviceFinder(QObject *parent=nullptr);
+    // the devices and their services share the sessions of ``sessions``
+    DeviceFinder(net::SessionPool &sessions, QObject *parent=nullptr);
     ~DeviceFinder();
 
-    /* Strict UPNP would provide the following method::
+    /* Finds the devices of ``searchTarget`` with SSDP, the internet gateway devices by default.
      *
-     *     void startFind();
+     * The description documents of all locations found are fetched one after the other, also of
+     * the devices which announce themselves after the search.
+     */
+    void startFind(const QString &searchTarget=QString());
+    /* The TR-064 interface of the FritzBox is not advertised, so its URL has to be given instead.
      *
-     * This method is not provided in this implementation, since the FritzBox implementation of
-     * TR-064 does not advertise its UPNP capabilities.  Instead, the method ``findDevice`` is
-     * provided, which takes the device URL as parameter.
+     * Cached descriptions are used right away and revalidated in the background; if one of them
+     * has changed, the devices are removed and built again from the new descriptions.
      */
-    void cancelFind();
     void findDevice(const QUrl &descriptionDocumentURL);
+    void cancelFind();
+
+    SsdpDiscovery &discovery();
+
+    // the services of the devices found next load their descriptions on first use
+    void setLazyServiceDescriptions(bool lazy);
+    bool lazyServiceDescriptions() const;
 
     const std::vector<std::unique_ptr<Device> > &devices() const;
     bool searching() const;
+    // of the location fetched last, nullptr if the current search has not found one yet
+    std::shared_ptr<net::NetworkSession> session() const;
 
 Q_SIGNALS:
+    /* Emitted as soon as the description of a service is complete, before its device is added.
+     * The service is destroyed along with its root device; with lazy service descriptions, it is
+     * ready before its description has been loaded.  The UDN is the one of the root device, which
+     * is passed to deviceRemoved when the service is destroyed.
+     */
+    void serviceReady(const QString &udn, Service *service);
     void deviceAdded(Device *device);
+    // emitted before the device is destroyed
     void deviceRemoved(const QString &udn);
     void searchComplete();
 
 private:
-    Q_SLOT void deviceDescriptionReceived(QNetworkReply *reply);
+    void fetchDescription(const QUrl &descriptionDocumentURL);
+    void fetchNextDescription();
+    void createParser();
+    void deviceDescriptionReceived(QNetworkReply *reply);
     Q_SLOT void onDeviceFinished();
-    Q_SLOT void onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors);
-    void parseDeviceDescription(const QByteArray &data);
-
-    QNetworkAccessManager m_networkAccess;
+    Q_SLOT void onLocationFound(const QString &usn, const QUrl &location);
+    Q_SLOT void onLocationLost(const QString &usn, const QUrl &location);
+    Q_SLOT void onDocumentChanged(const QUrl &url);
+    void refreshDevices();
+    void checkSearchComplete();
+    void removeDevices();
+
+    net::SessionPool &m_sessions;
+    std::shared_ptr<net::NetworkSession> m_session;
+    std::unique_ptr<internal::DeviceDescriptionParser> m_parser; //< only while searching
     std::vector<std::unique_ptr<internal::DeviceBuilder>> m_deviceBuilders;
     std::vector<std::unique_ptr<Device>> m_devices;
     QUrl m_baseURL;
+    QUrl m_descriptionURL;   //< of the document being parsed
+    QByteArray m_document;   //< as downloaded so far, for the description cache
     bool m_searching;
+    bool m_refreshPending;   //< a cached description changed while searching
+    bool m_lazyServiceDescriptions;
+    SsdpDiscovery m_discovery;
+    QSet<QUrl> m_knownLocations;       //< of the devices found, fetched again on a refresh
+    std::deque<QUrl> m_pendingLocations; //< waiting for their description to be fetched
 
     Q_DISABLE_COPY(DeviceFinder)
 };
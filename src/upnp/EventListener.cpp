@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "EventListener.hpp"
+
+#include <QtCore/QDebug>
+#include <QtCore/QList>
+#include <QtCore/QTimer>
+#include <QtCore/QXmlStreamReader>
+
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QNetworkInterface>
+#include <QtNetwork/QTcpSocket>
+
+namespace fritzmon {
+namespace upnp {
+
+static constexpr auto *EVENT_PATH_PREFIX = "/event/";
+static constexpr auto *HTTP_SCHEME = "http";
+static constexpr auto *NOTIFY_METHOD = "NOTIFY";
+static constexpr auto *HEADER_END = "\r\n\r\n";
+static constexpr auto *LINE_END = "\r\n";
+// the field names are compared in lower case
+static constexpr auto *CONTENT_LENGTH_FIELD = "content-length";
+static constexpr auto *NT_FIELD = "nt";
+static constexpr auto *NTS_FIELD = "nts";
+static constexpr auto *SEQ_FIELD = "seq";
+static constexpr auto *SID_FIELD = "sid";
+static constexpr auto *UPNP_EVENT = "upnp:event";
+static constexpr auto *UPNP_PROPCHANGE = "upnp:propchange";
+static constexpr auto *EVENT_NAMESPACE_URI = "urn:schemas-upnp-org:event-1-0";
+static constexpr auto *PROPERTYSET_TAG = "propertyset";
+static constexpr auto *PROPERTY_TAG = "property";
+static constexpr auto MAX_REQUEST_SIZE = 64 * 1024;
+static constexpr auto REQUEST_TIMEOUT = 5000; //< in ms
+
+static QHash<QByteArray, QByteArray> parseFields(const QList<QByteArray> &lines)
+{
+    QHash<QByteArray, QByteArray> fields;
+
+    for (const auto &line : lines) {
+        auto colon = line.indexOf(':');
+
+        if (colon > 0)
+            fields.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+    }
+
+    return fields;
+}
+
+EventListener &EventListener::instance()
+{
+    static EventListener listener;
+
+    return listener;
+}
+
+EventListener::EventListener()
+  : QObject(),
+    m_server(),
+    m_subscribers(),
+    m_buffers(),
+    m_nextPath(0),
+    m_notifications(0)
+{
+    connect(&m_server, &QTcpServer::newConnection, this, &EventListener::onNewConnection);
+}
+
+QString EventListener::addSubscriber(QObject *receiver, const EventCallback &callback)
+{
+    if (!m_server.isListening() && !m_server.listen(QHostAddress::Any)) {
+        qDebug() << "EventListener::addSubscriber: failed to listen:" << m_server.errorString();
+
+        return QString();
+    }
+
+    auto path = EVENT_PATH_PREFIX + QString::number(m_nextPath++);
+
+    m_subscribers.insert(path, Subscriber{ receiver, callback });
+
+    return path;
+}
+
+void EventListener::removeSubscriber(const QString &path)
+{
+    m_subscribers.remove(path);
+    if (m_subscribers.isEmpty())
+        m_server.close();
+}
+
+QUrl EventListener::callbackURL(const QUrl &publisherURL, const QString &path) const
+{
+    auto publisher = QHostAddress(publisherURL.host());
+    auto address = QHostAddress();
+
+    for (const auto &networkInterface : QNetworkInterface::allInterfaces()) {
+        if (!(networkInterface.flags() & QNetworkInterface::IsUp))
+            continue;
+        for (const auto &entry : networkInterface.addressEntries()) {
+            auto ip = entry.ip();
+
+            if (ip.protocol() != QAbstractSocket::IPv4Protocol)
+                continue;
+            if (!publisher.isNull() && publisher.isInSubnet(ip, entry.prefixLength())) {
+                address = ip;
+                break;
+            }
+            // for host names, the first external address is the best guess
+            if (address.isNull() && !ip.isLoopback())
+                address = ip;
+        }
+    }
+
+    auto url = QUrl();
+
+    url.setScheme(HTTP_SCHEME);
+    url.setHost(address.toString());
+    url.setPort(m_server.serverPort());
+    url.setPath(path);
+
+    return url;
+}
+
+quint64 EventListener::notifications() const
+{
+    return m_notifications;
+}
+
+void EventListener::onNewConnection()
+{
+    while (auto *socket = m_server.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_buffers.remove(socket);
+            socket->deleteLater();
+        });
+        // publishers which do not finish their request are not waited for
+        QTimer::singleShot(REQUEST_TIMEOUT, socket, [socket]() { socket->abort(); });
+    }
+}
+
+void EventListener::onReadyRead(QTcpSocket *socket)
+{
+    auto &buffer = m_buffers[socket];
+
+    buffer.append(socket->readAll());
+    if (buffer.size() > MAX_REQUEST_SIZE) {
+        respond(socket, 413, "Request Entity Too Large");
+        m_buffers.remove(socket);
+
+        return;
+    }
+
+    auto headerEnd = buffer.indexOf(HEADER_END);
+
+    if (headerEnd < 0)
+        return;
+
+    auto lines = buffer.left(headerEnd).split('\n');
+    auto requestLine = lines.takeFirst().trimmed();
+    auto fields = parseFields(lines);
+    auto lengthValid = false;
+    auto contentLength = fields.value(CONTENT_LENGTH_FIELD).toInt(&lengthValid);
+    auto bodyStart = headerEnd + static_cast<int>(qstrlen(HEADER_END));
+
+    // chunked notifications are not supported
+    if (!lengthValid || (contentLength < 0)) {
+        respond(socket, 411, "Length Required");
+        m_buffers.remove(socket);
+
+        return;
+    }
+    if (buffer.size() < bodyStart + contentLength)
+        return;
+
+    auto body = buffer.mid(bodyStart, contentLength);
+
+    m_buffers.remove(socket);
+    handleRequest(socket, requestLine, fields, body);
+}
+
+void EventListener::handleRequest(QTcpSocket *socket, const QByteArray &requestLine,
+                                  const QHash<QByteArray, QByteArray> &fields,
+                                  const QByteArray &body)
+{
+    auto parts = requestLine.split(' ');
+
+    if ((parts.size() != 3) || (parts[0] != NOTIFY_METHOD)) {
+        respond(socket, 405, "Method Not Allowed");
+
+        return;
+    }
+
+    auto nt = fields.value(NT_FIELD);
+    auto nts = fields.value(NTS_FIELD);
+    auto sid = fields.value(SID_FIELD);
+
+    if (nt.isEmpty() || nts.isEmpty() || sid.isEmpty()) {
+        respond(socket, 400, "Bad Request");
+
+        return;
+    }
+
+    auto subscriber = m_subscribers.constFind(QString::fromUtf8(parts[1]));
+
+    if ((nt != UPNP_EVENT) || (nts != UPNP_PROPCHANGE) || (subscriber == m_subscribers.cend())
+        || !subscriber->receiver) {
+        respond(socket, 412, "Precondition Failed");
+
+        return;
+    }
+
+    auto seqValid = false;
+    auto seq = fields.value(SEQ_FIELD).toUInt(&seqValid);
+    auto properties = QVariantMap();
+
+    if (!seqValid || !parsePropertySet(body, &properties)) {
+        qDebug() << "EventListener::handleRequest: invalid notification for" << parts[1];
+        respond(socket, 400, "Bad Request");
+
+        return;
+    }
+
+    // the subscriber may remove itself from the callback
+    auto callback = subscriber->callback;
+
+    ++m_notifications;
+    if (callback(QString::fromUtf8(sid), seq, properties))
+        respond(socket, 200, "OK");
+    else
+        respond(socket, 412, "Precondition Failed");
+}
+
+void EventListener::respond(QTcpSocket *socket, int status, const char *reason)
+{
+    socket->write("HTTP/1.1 " + QByteArray::number(status) + ' ' + reason + LINE_END
+                  + "Content-Length: 0" + LINE_END + "Connection: close" + HEADER_END);
+    socket->disconnectFromHost();
+}
+
+bool EventListener::parsePropertySet(const QByteArray &body, QVariantMap *properties)
+{
+    QXmlStreamReader reader(body);
+
+    if (!reader.readNextStartElement() || (reader.name() != PROPERTYSET_TAG)
+        || (reader.namespaceUri() != EVENT_NAMESPACE_URI))
+        return false;
+    while (reader.readNextStartElement()) {
+        if ((reader.name() != PROPERTY_TAG) || (reader.namespaceUri() != EVENT_NAMESPACE_URI)) {
+            reader.skipCurrentElement();
+            continue;
+        }
+        // the variables are not qualified
+        while (reader.readNextStartElement()) {
+            auto name = reader.name().toString();
+
+            properties->insert(name, reader.readElementText());
+        }
+    }
+
+    return !reader.hasError();
+}
+
+} // namespace upnp
+} // namespace fritzmon
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_UPNP_EVENTLISTENER_HPP
+#define FRITZMON_UPNP_EVENTLISTENER_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+#include <QtCore/QVariantMap>
+
+#include <QtNetwork/QTcpServer>
+
+#include <functional>
+
+class QTcpSocket;
+
+namespace fritzmon {
+namespace upnp {
+
+/* A minimal HTTP server, which receives the GENA event notifications of the subscribed services.
+ *
+ * Every subscriber gets its own callback path.  The property set of a ``NOTIFY`` request is
+ * passed to the subscriber of its path, which decides whether the event is accepted; otherwise
+ * the publisher is answered with ``412 Precondition Failed``.  The server listens on an
+ * arbitrary port once the first subscriber is added.
+ */
+class EventListener : public QObject
+{
+    Q_OBJECT
+
+public:
+    // ``properties`` contains the values by state variable name, returns false for unknown SIDs
+    using EventCallback = std::function<bool(const QString &sid, quint32 seq,
+                                             const QVariantMap &properties)>;
+
+    static EventListener &instance();
+
+    // returns the callback path, or an empty string if the server could not be started
+    QString addSubscriber(QObject *receiver, const EventCallback &callback);
+    void removeSubscriber(const QString &path);
+
+    // the URL of ``path`` on the local address which is in the network of ``publisherURL``
+    QUrl callbackURL(const QUrl &publisherURL, const QString &path) const;
+
+    quint64 notifications() const;
+
+private:
+    struct Subscriber
+    {
+        QPointer<QObject> receiver;
+        EventCallback callback;
+    };
+
+    EventListener();
+
+    Q_SLOT void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+    void handleRequest(QTcpSocket *socket, const QByteArray &requestLine,
+                       const QHash<QByteArray, QByteArray> &fields, const QByteArray &body);
+    static void respond(QTcpSocket *socket, int status, const char *reason);
+    static bool parsePropertySet(const QByteArray &body, QVariantMap *properties);
+
+    QTcpServer m_server;
+    QHash<QString, Subscriber> m_subscribers; //< by callback path
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    quint32 m_nextPath;
+    quint64 m_notifications;
+
+    Q_DISABLE_COPY(EventListener)
+};
+
+} // namespace upnp
+} // namespace fritzmon
+
+#endif // FRITZMON_UPNP_EVENTLISTENER_HPP
@@ -26,27 +26,70 @@
 
 #include "Service.hpp"
 
+#include "ActionDecoder.hpp"
+#include "DescriptionCache.hpp"
+#include "EventListener.hpp"
+#include "ServiceDescriptionParser.hpp"
 #include "StateVariable.hpp"
 
+#include "net/NetworkSession.hpp"
 #include "soap/IMessageBodyHandler.hpp"
 #include "soap/Request.hpp"
 
-#include <QtCore/QXmlStreamReader>
-#include <QtCore/QXmlStreamWriter>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
 
 #include <algorithm>
 #include <functional>
+#include <limits>
 
 namespace fritzmon {
 namespace upnp {
 
 using MessageFinishedCallback = std::function<void(const QVariantMap&, const QVariant &)>;
+using ArgumentCallback = std::function<void(const QString &name, const QString &value)>;
 
 static constexpr auto *UPNP_CONTROL_NAMESPACE_URI = "urn:schemas-upnp-org:control-1-0";
 static constexpr auto *QUERY_STATE_VARIABLE_TAG = "QueryStateVariable";
 static constexpr auto *RESPONSE_SUFFIX = "Response";
 static constexpr auto *VAR_NAME_TAG = "varName";
-static constexpr auto *WAN_COMMON_INTERFACE_CONFIG_NAMESPACE_URI = "urn:schemas-upnp-org:service:WANCommonInterfaceConfig:1";
+static constexpr auto *RETURN_TAG = "return"; //< the value of a queried state variable
+static constexpr auto DEFAULT_MAX_IN_FLIGHT = 2; //< matches the connection limit of the session
+static constexpr auto MAX_QUEUED_INVOCATIONS = 16u;
+static constexpr auto *SUBSCRIBE_METHOD = "SUBSCRIBE";
+static constexpr auto *UNSUBSCRIBE_METHOD = "UNSUBSCRIBE";
+static constexpr auto *CALLBACK_HEADER = "CALLBACK";
+static constexpr auto *NT_HEADER = "NT";
+static constexpr auto *SID_HEADER = "SID";
+static constexpr auto *TIMEOUT_HEADER = "TIMEOUT";
+static constexpr auto *UPNP_EVENT = "upnp:event";
+static constexpr auto *TIMEOUT_PREFIX = "Second-";
+
+// the granted duration of a subscription in s, 0 if it is infinite or invalid
+static int parseTimeout(const QByteArray &value)
+{
+    auto prefix = QByteArray(TIMEOUT_PREFIX);
+
+    if (!value.startsWith(prefix))
+        return 0;
+
+    return std::max(value.mid(prefix.size()).toInt(), 0);
+}
+
+// the input arguments in the order of the service description
+static QStringList orderedArguments(const soap::RequestTemplate &requestTemplate,
+                                    const QVariantMap &inputArguments)
+{
+    auto arguments = QStringList();
+
+    for (const auto &argumentName : requestTemplate.argumentNames())
+        arguments << inputArguments.value(argumentName).toString();
+
+    return arguments;
+}
 
 class UpnpResponseHandler : public soap::IMessageBodyHandler
 {
@@ -54,51 +97,85 @@ public:
     UpnpResponseHandler(const QString &namespaceURI,
                                 const MessageFinishedCallback &finishedCallback);
 
-    bool startElement(const QString &tag, QXmlStreamReader &stream) override;
+    bool startElement(const QStringRef &tag) override;
+    bool characters(const QStringRef &text) override;
     bool startMessage() override;
-    bool endElement(const QString &tag) override;
+    bool endElement(const QStringRef &tag) override;
     bool endMessage() override;
 
+    // the arguments of the next messages go to ``decoder`` instead of the map, if it is set
+    void setDecoder(ActionDecoder *decoder);
+    // receives every argument, also those passed to the decoder
+    void setArgumentCallback(const ArgumentCallback &argumentCallback);
+
 private:
     MessageFinishedCallback m_finishedCallback;
+    ArgumentCallback m_argumentCallback;
+    ActionDecoder *m_decoder;
     QVariantMap m_outputArguments;
+    // the buffers keep their capacity between the arguments and messages
+    QString m_argumentName; //< of the argument whose value is currently read
+    QString m_argumentValue;
     enum class ParserState {
         Root,
         Envelope,
     } m_parserState;
-
-    // used to suppress more than one finalizations, if the handler is installed multiple times
-    bool m_finalized;
 };
 
 UpnpResponseHandler::UpnpResponseHandler(const QString &namespaceURI,
                                          const MessageFinishedCallback &finishedCallback)
   : soap::IMessageBodyHandler(namespaceURI),
-    m_finishedCallback(finishedCallback)
+    m_finishedCallback(finishedCallback),
+    m_argumentCallback(),
+    m_decoder(nullptr),
+    m_outputArguments(),
+    m_argumentName(),
+    m_argumentValue(),
+    m_parserState(ParserState::Root)
 {}
 
-bool UpnpResponseHandler::startElement(const QString &tag, QXmlStreamReader &stream)
+bool UpnpResponseHandler::startElement(const QStringRef &tag)
 {
-    if ((m_parserState == ParserState::Root) && tag.endsWith(RESPONSE_SUFFIX))
+    if ((m_parserState == ParserState::Root) && tag.endsWith(QLatin1String(RESPONSE_SUFFIX)))
         m_parserState = ParserState::Envelope;
-    else
-        m_outputArguments[tag] = stream.readElementText();
+    else {
+        m_argumentName.resize(0);
+        m_argumentName.append(tag);
+        m_argumentValue.resize(0);
+    }
+
+    return true;
+}
+
+bool UpnpResponseHandler::characters(const QStringRef &text)
+{
+    if (!m_argumentName.isEmpty())
+        m_argumentValue += text;
 
     return true;
 }
 
 bool UpnpResponseHandler::startMessage()
 {
-    m_finalized = false;
     m_parserState = ParserState::Root;
     m_outputArguments.clear();
+    m_argumentName.resize(0);
 
     return true;
 }
 
-bool UpnpResponseHandler::endElement(const QString &tag)
+bool UpnpResponseHandler::endElement(const QStringRef &tag)
 {
-    if ((m_parserState == ParserState::Envelope) && tag.endsWith(RESPONSE_SUFFIX))
+    if (!m_argumentName.isEmpty() && (tag == m_argumentName)) {
+        if (!m_decoder)
+            m_outputArguments[m_argumentName] = m_argumentValue;
+        else if (!m_decoder->decodeArgument(m_argumentName, m_argumentValue))
+            qDebug() << "UpnpResponseHandler: failed to decode" << tag << m_argumentValue;
+        if (m_argumentCallback)
+            m_argumentCallback(m_argumentName, m_argumentValue);
+        m_argumentName.resize(0);
+    } else if ((m_parserState == ParserState::Envelope)
+               && tag.endsWith(QLatin1String(RESPONSE_SUFFIX)))
         m_parserState = ParserState::Root;
 
     return true;
@@ -106,14 +183,35 @@ bool UpnpResponseHandler::endElement(const QString &tag)
 
 bool UpnpResponseHandler::endMessage()
 {
-    if (!m_finalized) {
-        m_finishedCallback(m_outputArguments, QVariant());
-        m_finalized = true;
-    }
+    m_finishedCallback(m_outputArguments, QVariant());
+
     return true;
 }
 
-Service::Service(QObject *parent)
+void UpnpResponseHandler::setDecoder(ActionDecoder *decoder)
+{
+    m_decoder = decoder;
+}
+
+void UpnpResponseHandler::setArgumentCallback(const ArgumentCallback &argumentCallback)
+{
+    m_argumentCallback = argumentCallback;
+}
+
+Service::ActionHandle::ActionHandle()
+  : m_index(-1)
+{}
+
+Service::ActionHandle::ActionHandle(int index)
+  : m_index(index)
+{}
+
+bool Service::ActionHandle::isValid() const
+{
+    return m_index >= 0;
+}
+
+Service::Service(const std::shared_ptr<net::NetworkSession> &session, QObject *parent)
   : QObject(parent),
     m_actions(),
     m_type(),
@@ -121,65 +219,259 @@ Service::Service(QObject *parent)
     m_scpdURL(),
     m_controlURL(),
     m_eventSubURL(),
-    m_request(std::make_unique<soap::Request>()),
-    m_invokationPending(false)
+    m_deviceIdentity(),
+    m_session(session),
+    m_descriptionState(DescriptionState::NotLoaded),
+    m_parser(),
+    m_document(),
+    m_deferred(),
+    m_actionIndex(),
+    m_stateVariableIndex(),
+    m_actionEntries(),
+    m_queryStateVariableTemplate(),
+    m_queue(),
+    m_slots(),
+    m_nextInvocationId(1),
+    m_maxInFlight(DEFAULT_MAX_IN_FLIGHT),
+    m_eventPath(),
+    m_sid(),
+    m_eventKey(0),
+    m_subscriptionTimeout(DEFAULT_SUBSCRIPTION_TIMEOUT),
+    m_renewTimer()
 {
-    auto handler = std::make_shared<UpnpResponseHandler>(WAN_COMMON_INTERFACE_CONFIG_NAMESPACE_URI,
-                                                         std::bind(&Service::onActionFinished,
-                                                                   this,
-                                                                   std::placeholders::_1,
-                                                                   std::placeholders::_2));
+    m_renewTimer.setSingleShot(true);
+    connect(&m_renewTimer, &QTimer::timeout, this, &Service::renewSubscription);
+}
 
-    m_request->addMessageHandler(WAN_COMMON_INTERFACE_CONFIG_NAMESPACE_URI, handler);
-    m_request->addMessageHandler("", handler);
+Service::~Service()
+{
+    unsubscribe();
 }
 
-Service::~Service() = default;
+Service::InvokeActionResult Service::invokeAction(const QString &name,
+                                                  const QVariantMap &inputArguments,
+                                                  const ActionCallback &finished,
+                                                  const FailureCallback &failed,
+                                                  quint64 *invocationId)
+{
+    if (m_descriptionState != DescriptionState::Loaded)
+        return defer({ 0, name, false, inputArguments, QStringList(), nullptr, finished, failed },
+                     invocationId);
+
+    return invokeAction(resolveAction(name), inputArguments, finished, failed, invocationId);
+}
 
-Service::InvokeActionResult Service::invokeAction(const QString &name, const QVariantMap &inputArguments)
+Service::InvokeActionResult Service::invokeAction(const QString &name,
+                                                  const QStringList &arguments,
+                                                  const std::shared_ptr<ActionDecoder> &decoder,
+                                                  const ActionCallback &finished,
+                                                  const FailureCallback &failed,
+                                                  quint64 *invocationId)
 {
-    if (m_invokationPending)
-        return InvokeActionResult::PendingAction;
+    if (m_descriptionState != DescriptionState::Loaded)
+        return defer({ 0, name, true, QVariantMap(), arguments, decoder, finished, failed },
+                     invocationId);
+
+    return invokeAction(resolveAction(name), arguments, decoder, finished, failed, invocationId);
+}
 
-    if (!std::any_of(std::cbegin(m_actions), std::cend(m_actions), [&name](const Action &action) {
-            return action.name() == name;
-        }))
+Service::InvokeActionResult Service::invokeAction(ActionHandle action,
+                                                  const QVariantMap &inputArguments,
+                                                  const ActionCallback &finished,
+                                                  const FailureCallback &failed,
+                                                  quint64 *invocationId)
+{
+    auto *actionTemplate = requestTemplate(action);
+
+    if (!actionTemplate)
         return InvokeActionResult::InvalidAction;
 
-    m_invokationPending = true;
+    auto arguments = orderedArguments(*actionTemplate, inputArguments);
+
+    if (!coerceArguments(action.m_index, arguments))
+        return InvokeActionResult::InvalidArgument;
 
-    const auto end = std::cend(inputArguments);
-    auto soapAction = m_type + "#" + name;
-    auto soapBody = QByteArray();
-    QXmlStreamWriter stream(&soapBody);
+    return enqueue({ 0, actionTemplate, action.m_index, arguments, nullptr, finished,
+                     failed }, invocationId);
+}
+
+Service::InvokeActionResult Service::invokeAction(ActionHandle action,
+                                                  const QStringList &arguments,
+                                                  const std::shared_ptr<ActionDecoder> &decoder,
+                                                  const ActionCallback &finished,
+                                                  const FailureCallback &failed,
+                                                  quint64 *invocationId)
+{
+    auto *actionTemplate = requestTemplate(action);
 
-    stream.writeStartElement(m_type, name);
-    if (!inputArguments.empty())
-        for (auto i = std::cbegin(inputArguments); i != end; ++i)
-            stream.writeTextElement(QString(), i.key(), i.value().toString());
-    stream.writeEndElement();
+    if (!actionTemplate)
+        return InvokeActionResult::InvalidAction;
+    if (arguments.size() != actionTemplate->argumentNames().size())
+        return InvokeActionResult::InvocationFailed;
 
-    m_request->start(m_controlURL, soapAction, soapBody);
+    auto coercedArguments = arguments;
 
-    return InvokeActionResult::Success;
+    if (!coerceArguments(action.m_index, coercedArguments))
+        return InvokeActionResult::InvalidArgument;
+
+    return enqueue({ 0, actionTemplate, action.m_index, coercedArguments, decoder, finished,
+                     failed }, invocationId);
 }
 
 void Service::queryStateVariable(const QString &name, QVariant &value)
 {
-    Q_UNUSED(value);
+    auto index = m_stateVariableIndex.value(name, -1);
+
+    value = (index < 0) ? QVariant() : m_stateVariables[index].value();
+    if (m_queryStateVariableTemplate.argumentNames().isEmpty()) {
+        // the reply is matched by the namespace and the local names, whatever its prefixes
+        m_queryStateVariableTemplate = soap::RequestTemplate(m_controlURL,
+                                                             UPNP_CONTROL_NAMESPACE_URI,
+                                                             QUERY_STATE_VARIABLE_TAG,
+                                                             QStringList() << VAR_NAME_TAG, true);
+        m_queryStateVariableTemplate.setResponseArgumentNames(QStringList() << RETURN_TAG);
+    }
+    // the queries are internal, so they are not reported as actions of the users
+    enqueue({ 0, &m_queryStateVariableTemplate, -1, QStringList() << name, nullptr,
+              [this, index](const QVariantMap &outputArguments, const QVariant &) {
+        if ((index >= 0) && outputArguments.contains(RETURN_TAG))
+            updateStateVariable(index, outputArguments.value(RETURN_TAG));
+    }, [name]() {
+        qDebug() << "Service::queryStateVariable: failed to query" << name;
+    } }, nullptr);
+}
+
+QVariant Service::stateVariableValue(const QString &name) const
+{
+    auto *variable = findStateVariable(name);
+
+    return variable ? variable->value() : QVariant();
+}
+
+Service::ActionHandle Service::resolveAction(const QString &name) const
+{
+    return ActionHandle(m_actionIndex.value(name, -1));
+}
+
+const Action *Service::findAction(const QString &name) const
+{
+    auto index = m_actionIndex.value(name, -1);
+
+    return (index < 0) ? nullptr : &m_actions[index];
+}
+
+const StateVariable *Service::findStateVariable(const QString &name) const
+{
+    auto index = m_stateVariableIndex.value(name, -1);
+
+    return (index < 0) ? nullptr : &m_stateVariables[index];
+}
+
+const StateVariable *Service::relatedStateVariable(ActionHandle action,
+                                                   const QString &argumentName) const
+{
+    if (!action.isValid() || (action.m_index >= static_cast<int>(m_actionEntries.size())))
+        return nullptr;
+
+    auto index = m_actionEntries[action.m_index].relatedStateVariables.value(argumentName, -1);
+
+    return (index < 0) ? nullptr : &m_stateVariables[index];
+}
+
+void Service::loadDescription()
+{
+    if (m_descriptionState != DescriptionState::NotLoaded)
+        return;
+    Q_ASSERT(!m_scpdURL.isEmpty());
+    m_descriptionState = DescriptionState::Loading;
+
+    auto &cache = internal::DescriptionCache::instance();
+    auto cached = cache.document(m_scpdURL, m_deviceIdentity);
 
-    auto soapAction = QString(UPNP_CONTROL_NAMESPACE_URI) + "#" + QUERY_STATE_VARIABLE_TAG;
-    auto data = QByteArray();
-    QXmlStreamWriter stream(&data);
+    if (!cached.isEmpty() && parseCachedDescription(cached)) {
+        cache.revalidate(m_session, m_scpdURL, m_deviceIdentity);
+        // the signals are always emitted from the event loop, so callers can connect afterwards
+        QTimer::singleShot(0, this, [this]() { finishDescription(true); });
 
-    stream.writeStartElement(UPNP_CONTROL_NAMESPACE_URI, QUERY_STATE_VARIABLE_TAG);
-    stream.writeStartElement(UPNP_CONTROL_NAMESPACE_URI, VAR_NAME_TAG);
-    stream.writeCharacters(name);
-    stream.writeEndElement();
-    stream.writeEndElement();
+        return;
+    }
+
+    // the actions and state variables are filled in while the description is downloaded
+    m_parser.reset(new internal::ServiceDescriptionParser(m_actions, m_stateVariables));
+    m_document.clear();
+    m_session->get(QNetworkRequest(m_scpdURL), this, net::ReplyHandler{
+        [this](QNetworkReply *reply) {
+            auto data = reply->readAll();
+
+            m_document += data;
+            m_parser->addData(data);
+        },
+        [this](QNetworkReply *reply) { onDescriptionReceived(reply); }
+    });
+}
 
-    qDebug() << "Service::queryStateVariable: " << data;
-    m_request->start(m_controlURL, soapAction, data);
+bool Service::isDescriptionLoaded() const
+{
+    return m_descriptionState == DescriptionState::Loaded;
+}
+
+void Service::subscribe(int timeout)
+{
+    if (m_eventSubURL.isEmpty()) {
+        qDebug() << "Service::subscribe:" << m_type << "has no event URL";
+        emit subscriptionFailed();
+
+        return;
+    }
+
+    // a new subscription replaces the current one
+    unsubscribe();
+    m_eventPath = EventListener::instance().addSubscriber(this,
+            [this](const QString &sid, quint32 seq, const QVariantMap &properties) {
+        return onEvent(sid, seq, properties);
+    });
+    if (m_eventPath.isEmpty()) {
+        emit subscriptionFailed();
+
+        return;
+    }
+    m_subscriptionTimeout = timeout;
+    m_eventKey = 0;
+    sendSubscribe(false);
+}
+
+void Service::unsubscribe()
+{
+    m_renewTimer.stop();
+    if (!m_sid.isEmpty()) {
+        auto request = QNetworkRequest(m_eventSubURL);
+
+        request.setRawHeader(SID_HEADER, m_sid.toUtf8());
+        // the session receives the reply, so the request is sent even if the service is destroyed
+        m_session->sendCustomRequest(request, UNSUBSCRIBE_METHOD, m_session.get(),
+                                     [](QNetworkReply *) {});
+        m_sid.clear();
+    }
+    if (!m_eventPath.isEmpty()) {
+        EventListener::instance().removeSubscriber(m_eventPath);
+        m_eventPath.clear();
+    }
+}
+
+bool Service::isSubscribed() const
+{
+    return !m_sid.isEmpty();
+}
+
+void Service::setMaxInFlight(int maxInFlight)
+{
+    m_maxInFlight = std::max(maxInFlight, 1);
+    dispatch();
+}
+
+int Service::maxInFlight() const
+{
+    return m_maxInFlight;
 }
 
 QString Service::id() const
@@ -202,11 +494,403 @@ const std::vector<StateVariable> &Service::stateVariables() const
     return m_stateVariables;
 }
 
-void Service::onActionFinished(const QVariantMap &outputArguments, const QVariant &returnValue)
+bool Service::parseCachedDescription(const QByteArray &document)
+{
+    internal::ServiceDescriptionParser parser(m_actions, m_stateVariables);
+
+    parser.addData(document);
+    if (parser.finish())
+        return true;
+    // the description is downloaded instead, so the parsed part is dropped
+    qDebug() << "Service: invalid cached description of" << m_scpdURL;
+    m_actions.clear();
+    m_stateVariables.clear();
+
+    return false;
+}
+
+void Service::onDescriptionReceived(QNetworkReply *reply)
+{
+    auto loaded = false;
+
+    if (reply->error() != QNetworkReply::NoError)
+        qDebug() << "Service::onDescriptionReceived: network error:" << reply->errorString();
+    else {
+        auto data = reply->readAll();
+
+        m_document += data;
+        m_parser->addData(data);
+        loaded = m_parser->finish();
+        if (loaded)
+            internal::DescriptionCache::instance().store(m_scpdURL, m_deviceIdentity, reply,
+                                                         m_document);
+    }
+    m_parser.reset();
+    m_document.clear();
+    finishDescription(loaded);
+}
+
+void Service::finishDescription(bool loaded)
+{
+    if (!loaded) {
+        m_actions.clear();
+        m_stateVariables.clear();
+    }
+    m_descriptionState = loaded ? DescriptionState::Loaded : DescriptionState::NotLoaded;
+    if (loaded)
+        buildIndexes();
+
+    auto deferred = std::deque<DeferredInvocation>();
+
+    deferred.swap(m_deferred);
+    for (auto &invocation : deferred) {
+        auto action = loaded ? resolveAction(invocation.actionName) : ActionHandle();
+        auto *actionTemplate = requestTemplate(action);
+
+        if (!actionTemplate || (invocation.ordered && (invocation.arguments.size()
+                                        != actionTemplate->argumentNames().size()))) {
+            qDebug() << "Service::finishDescription: failed to invoke" << invocation.actionName;
+            if (invocation.failed)
+                invocation.failed();
+            emit actionFailed(invocation.id);
+            continue;
+        }
+
+        auto arguments = invocation.ordered
+                ? invocation.arguments
+                : orderedArguments(*actionTemplate, invocation.inputArguments);
+
+        if (!coerceArguments(action.m_index, arguments)) {
+            if (invocation.failed)
+                invocation.failed();
+            emit actionFailed(invocation.id);
+            continue;
+        }
+
+        m_queue.push_back({ invocation.id, actionTemplate, action.m_index, arguments,
+                            invocation.decoder, invocation.finished, invocation.failed });
+    }
+    dispatch();
+    if (loaded)
+        emit descriptionLoaded();
+    else
+        emit descriptionFailed();
+}
+
+Service::InvokeActionResult Service::defer(DeferredInvocation &&invocation,
+                                           quint64 *invocationId)
+{
+    if (m_deferred.size() + m_queue.size() >= MAX_QUEUED_INVOCATIONS)
+        return InvokeActionResult::PendingAction;
+    invocation.id = m_nextInvocationId++;
+    if (invocationId)
+        *invocationId = invocation.id;
+    m_deferred.push_back(std::move(invocation));
+    loadDescription();
+
+    return InvokeActionResult::Success;
+}
+
+void Service::buildIndexes()
+{
+    m_actionIndex.clear();
+    m_actionIndex.reserve(static_cast<int>(m_actions.size()));
+    m_stateVariableIndex.clear();
+    m_stateVariableIndex.reserve(static_cast<int>(m_stateVariables.size()));
+    for (auto i = 0u; i < m_stateVariables.size(); ++i)
+        m_stateVariableIndex.insert(m_stateVariables[i].name(), static_cast<int>(i));
+    m_actionEntries.clear();
+    m_actionEntries.resize(m_actions.size());
+    for (auto i = 0u; i < m_actions.size(); ++i) {
+        auto &entry = m_actionEntries[i];
+
+        m_actionIndex.insert(m_actions[i].name(), static_cast<int>(i));
+        for (const auto &argument : m_actions[i].arguments()) {
+            auto variable = m_stateVariableIndex.value(argument.stateVariable(), -1);
+
+            if (variable < 0)
+                qDebug() << "Service::buildIndexes: unknown state variable"
+                         << argument.stateVariable() << "of" << m_actions[i].name();
+            else
+                entry.relatedStateVariables.insert(argument.name(), variable);
+            if (argument.direction() == Argument::Direction::In)
+                entry.inputVariables.push_back(variable);
+        }
+    }
+}
+
+bool Service::coerceArguments(int action, QStringList &arguments) const
+{
+    const auto &inputVariables = m_actionEntries[action].inputVariables;
+
+    for (auto i = 0; i < arguments.size(); ++i) {
+        auto index = inputVariables[i];
+
+        if (index < 0)
+            continue;
+
+        const auto &variable = m_stateVariables[index];
+        auto coerced = QString();
+
+        if (arguments[i].isNull() && variable.defaultValue().isValid())
+            arguments[i] = variable.defaultValue().toString();
+        if (!variable.validate(arguments[i], &coerced)) {
+            qDebug() << "Service::coerceArguments: invalid value" << arguments[i] << "for"
+                     << variable.name() << "of" << m_actions[action].name();
+
+            return false;
+        }
+        arguments[i] = coerced;
+    }
+
+    return true;
+}
+
+const soap::RequestTemplate *Service::requestTemplate(ActionHandle action)
+{
+    if (!action.isValid() || (action.m_index >= static_cast<int>(m_actionEntries.size())))
+        return nullptr;
+
+    auto &entry = m_actionEntries[action.m_index];
+
+    if (entry.requestTemplate)
+        return entry.requestTemplate.get();
+
+    const auto &description = m_actions[action.m_index];
+    auto argumentNames = QStringList();
+    auto responseArgumentNames = QStringList();
+
+    // the arguments are sent and returned in the order of the service description
+    for (const auto &argument : description.arguments()) {
+        if (argument.direction() == Argument::Direction::In)
+            argumentNames << argument.name();
+        else
+            responseArgumentNames << argument.name();
+    }
+    entry.requestTemplate.reset(new soap::RequestTemplate(m_controlURL, m_type,
+                                                          description.name(), argumentNames));
+    entry.requestTemplate->setResponseArgumentNames(responseArgumentNames);
+
+    return entry.requestTemplate.get();
+}
+
+Service::InvokeActionResult Service::enqueue(Invocation &&invocation, quint64 *invocationId)
+{
+    if (m_queue.size() >= MAX_QUEUED_INVOCATIONS)
+        return InvokeActionResult::PendingAction;
+    invocation.id = m_nextInvocationId++;
+    if (invocationId)
+        *invocationId = invocation.id;
+    m_queue.push_back(std::move(invocation));
+    dispatch();
+
+    return InvokeActionResult::Success;
+}
+
+void Service::dispatch()
+{
+    while (!m_queue.empty()) {
+        auto *slot = idleSlot();
+
+        if (!slot)
+            return;
+        slot->invocation = std::move(m_queue.front());
+        slot->busy = true;
+        m_queue.pop_front();
+        slot->handler->setDecoder(slot->invocation.decoder.get());
+        slot->request->start(*slot->invocation.requestTemplate, slot->invocation.arguments);
+    }
+}
+
+Service::RequestSlot *Service::idleSlot()
+{
+    auto busy = std::count_if(std::cbegin(m_slots), std::cend(m_slots),
+                              [](const std::unique_ptr<RequestSlot> &slot) {
+        return slot->busy;
+    });
+
+    if (busy >= m_maxInFlight)
+        return nullptr;
+    for (auto &slot : m_slots)
+        if (!slot->busy)
+            return slot.get();
+
+    auto *slot = new RequestSlot{ std::make_unique<soap::Request>(m_session), nullptr,
+                                  Invocation(), false };
+
+    // the response element is qualified with the service type, its arguments are not
+    slot->handler = std::make_shared<UpnpResponseHandler>(
+                m_type,
+                [this, slot](const QVariantMap &outputArguments, const QVariant &returnValue) {
+        onActionFinished(slot, outputArguments, returnValue);
+    });
+    slot->handler->setArgumentCallback([this, slot](const QString &name, const QString &value) {
+        onOutputArgument(slot, name, value);
+    });
+    m_slots.emplace_back(slot);
+    slot->request->addMessageHandler(m_type, slot->handler);
+    // the response to a query is qualified with the control namespace instead
+    slot->request->addMessageHandler(UPNP_CONTROL_NAMESPACE_URI, slot->handler);
+    connect(slot->request.get(), &soap::Request::finished, this, [this, slot]() {
+        onRequestFinished(slot);
+    });
+
+    return slot;
+}
+
+void Service::onActionFinished(RequestSlot *slot, const QVariantMap &outputArguments,
+                               const QVariant &returnValue)
+{
+    if (!slot->busy)
+        return;
+
+    // the slot is released when the request has finished completely
+    auto invocation = std::move(slot->invocation);
+
+    slot->invocation = Invocation();
+    if (invocation.finished)
+        invocation.finished(outputArguments, returnValue);
+    if (invocation.action >= 0)
+        emit actionInvoked(invocation.id, outputArguments, returnValue);
+}
+
+void Service::onRequestFinished(RequestSlot *slot)
+{
+    if (!slot->busy)
+        return;
+    if (slot->invocation.id != 0) {
+        auto invocation = std::move(slot->invocation);
+
+        slot->invocation = Invocation();
+        qDebug() << "Service::onRequestFinished: no reply to invocation" << invocation.id;
+        if (invocation.failed)
+            invocation.failed();
+        if (invocation.action >= 0)
+            emit actionFailed(invocation.id);
+    }
+    slot->busy = false;
+    dispatch();
+}
+
+void Service::onOutputArgument(RequestSlot *slot, const QString &name, const QString &value)
+{
+    if (!slot->busy)
+        return;
+
+    const auto &invocation = slot->invocation;
+
+    // the value of a query is updated by its own callback
+    if (invocation.action >= 0) {
+        auto index = m_actionEntries[invocation.action].relatedStateVariables.value(name, -1);
+
+        if (index >= 0)
+            updateStateVariable(index, value);
+    }
+}
+
+void Service::updateStateVariable(int index, const QVariant &value)
 {
-    m_invokationPending = false;
+    auto &variable = m_stateVariables[index];
 
-    emit actionInvoked(outputArguments, returnValue);
+    if (variable.setValue(value, QDateTime::currentDateTimeUtc()))
+        emit stateVariableChanged(variable.name(), value);
+}
+
+void Service::sendSubscribe(bool renewal)
+{
+    auto request = QNetworkRequest(m_eventSubURL);
+    auto eventPath = m_eventPath;
+
+    if (renewal)
+        request.setRawHeader(SID_HEADER, m_sid.toUtf8());
+    else {
+        auto callbackURL = EventListener::instance().callbackURL(m_eventSubURL, m_eventPath);
+
+        request.setRawHeader(CALLBACK_HEADER, '<' + callbackURL.toEncoded() + '>');
+        request.setRawHeader(NT_HEADER, UPNP_EVENT);
+    }
+    request.setRawHeader(TIMEOUT_HEADER,
+                         TIMEOUT_PREFIX + QByteArray::number(m_subscriptionTimeout));
+    m_session->sendCustomRequest(request, SUBSCRIBE_METHOD, this,
+                                 [this, renewal, eventPath](QNetworkReply *reply) {
+        // the reply to a subscription which has been replaced in the meantime
+        if (eventPath != m_eventPath)
+            return;
+        onSubscribeFinished(reply, renewal);
+    });
+}
+
+void Service::onSubscribeFinished(QNetworkReply *reply, bool renewal)
+{
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "Service::onSubscribeFinished:" << m_type << reply->errorString();
+        m_sid.clear();
+        // the publisher may have dropped the subscription, so a new one is tried once
+        if (renewal) {
+            m_eventKey = 0;
+            sendSubscribe(false);
+
+            return;
+        }
+        EventListener::instance().removeSubscriber(m_eventPath);
+        m_eventPath.clear();
+        emit subscriptionFailed();
+
+        return;
+    }
+
+    auto sid = QString::fromUtf8(reply->rawHeader(SID_HEADER));
+    auto timeout = parseTimeout(reply->rawHeader(TIMEOUT_HEADER));
+
+    if (!renewal) {
+        if (sid.isEmpty()) {
+            qDebug() << "Service::onSubscribeFinished: no SID received for" << m_type;
+            EventListener::instance().removeSubscriber(m_eventPath);
+            m_eventPath.clear();
+            emit subscriptionFailed();
+
+            return;
+        }
+        m_sid = sid;
+    }
+    // renewed halfway through, so a late renewal does not lose events
+    if (timeout > 0)
+        m_renewTimer.start(timeout * 1000 / 2);
+    else
+        m_renewTimer.stop();
+    if (!renewal)
+        emit subscribed();
+}
+
+void Service::renewSubscription()
+{
+    if (!m_sid.isEmpty())
+        sendSubscribe(true);
+}
+
+bool Service::onEvent(const QString &sid, quint32 seq, const QVariantMap &properties)
+{
+    // the initial event may arrive before the reply to the subscription
+    if (!m_sid.isEmpty() && (sid != m_sid))
+        return false;
+    if (seq != m_eventKey) {
+        qDebug() << "Service::onEvent: missed events of" << m_type << "subscribing again";
+        // only a new subscription delivers all evented variables again
+        QTimer::singleShot(0, this, [this]() { subscribe(m_subscriptionTimeout); });
+    }
+    // the key wraps around to 1, as 0 is reserved for the initial event
+    m_eventKey = (seq == std::numeric_limits<quint32>::max()) ? 1 : seq + 1;
+    for (auto it = properties.cbegin(); it != properties.cend(); ++it) {
+        auto index = m_stateVariableIndex.value(it.key(), -1);
+
+        // the description may not be loaded yet, then every event is passed on
+        if (index < 0)
+            emit stateVariableChanged(it.key(), it.value());
+        else
+            updateStateVariable(index, it.value());
+    }
+
+    return true;
 }
 
 } // namespace upnp
@@ -29,16 +29,32 @@
 
 #include <upnp/Action.hpp>
 
+#include <soap/RequestTemplate.hpp>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
 #include <QtCore/QUrl>
 #include <QtCore/QVariantMap>
 
+#include <deque>
+#include <functional>
 #include <memory>
 #include <vector>
 
+class QNetworkReply;
+
 namespace fritzmon {
 
+namespace net {
+
+class NetworkSession;
+
+} // namespace net
+
 namespace soap {
 
 class Request;
@@ -47,11 +63,14 @@ class Request;
 
 namespace upnp {
 
+class ActionDecoder;
 class StateVariable;
+class UpnpResponseHandler;
 
 namespace internal {
 
 class ServiceBuilder;
+class ServiceDescriptionParser;
 
 } // namespace internal
 
@@ -60,18 +79,116 @@ class Service : public QObject
     Q_OBJECT
 
 public:
+    static constexpr auto DEFAULT_SUBSCRIPTION_TIMEOUT = 1800; //< in s
+
     enum class InvokeActionResult {
         Success,
-        PendingAction,    //< There is already an invocation pending
+        PendingAction,    //< Too many invocations are pending already
         InvocationFailed, //< The invocation failed
-        InvalidAction     //< no such action available from this service
+        InvalidAction,    //< no such action available from this service
+        InvalidArgument   //< an argument violates the type or constraints of its state variable
+    };
+
+    using ActionCallback = std::function<void(const QVariantMap &outputArguments,
+                                              const QVariant &returnValue)>;
+    using FailureCallback = std::function<void()>;
+
+    // an action resolved once, which is then invoked without looking up its name
+    class ActionHandle
+    {
+    public:
+        ActionHandle();
+
+        bool isValid() const;
+
+    private:
+        explicit ActionHandle(int index);
+
+        int m_index; //< into the actions of the service which resolved it
+
+        friend class Service;
     };
 
-    explicit Service(QObject *parent=nullptr);
+    explicit Service(const std::shared_ptr<net::NetworkSession> &session,
+                     QObject *parent=nullptr);
     ~Service();
 
-    InvokeActionResult invokeAction(const QString &name, const QVariantMap &inputArguments);
+    /* Queues the invocation and sends it as soon as one of the ``maxInFlight`` requests is free.
+     *
+     * ``finished`` is called with the reply of this invocation only, ``failed`` whenever
+     * ``actionFailed`` is emitted for it.  ``invocationId`` receives the id which is passed to
+     * ``actionInvoked`` or ``actionFailed``.
+     *
+     * The arguments are checked against the state variables of the description before anything
+     * is sent, and coerced to the form the router expects.  Missing arguments take the default
+     * value of their state variable, if it has one.
+     *
+     * If the service description has not been loaded yet, it is loaded first and the invocation
+     * is held back until then; an unknown action or an invalid argument is then reported with
+     * ``actionFailed``.
+     */
+    InvokeActionResult invokeAction(const QString &name, const QVariantMap &inputArguments,
+                                    const ActionCallback &finished=ActionCallback(),
+                                    const FailureCallback &failed=FailureCallback(),
+                                    quint64 *invocationId=nullptr);
+    /* Used by the generated stubs: the input arguments are given in the order of the service
+     * description and the output arguments are passed to ``decoder`` instead of being collected
+     * in the map, which is empty for these invocations.  Null strings count as missing.
+     */
+    InvokeActionResult invokeAction(const QString &name, const QStringList &arguments,
+                                    const std::shared_ptr<ActionDecoder> &decoder,
+                                    const ActionCallback &finished,
+                                    const FailureCallback &failed=FailureCallback(),
+                                    quint64 *invocationId=nullptr);
+    /* Invoke the action without looking up its name, ``action`` must have been resolved by this
+     * service.
+     */
+    InvokeActionResult invokeAction(ActionHandle action, const QVariantMap &inputArguments,
+                                    const ActionCallback &finished=ActionCallback(),
+                                    const FailureCallback &failed=FailureCallback(),
+                                    quint64 *invocationId=nullptr);
+    InvokeActionResult invokeAction(ActionHandle action, const QStringList &arguments,
+                                    const std::shared_ptr<ActionDecoder> &decoder,
+                                    const ActionCallback &finished,
+                                    const FailureCallback &failed=FailureCallback(),
+                                    quint64 *invocationId=nullptr);
+    /* ``value`` receives the cached value right away, which is invalid if it is not known yet.
+     * The variable is queried from the router nonetheless, and a changed value is emitted with
+     * ``stateVariableChanged``.
+     */
     void queryStateVariable(const QString &name, QVariant &value);
+    /* The last value learned from the output arguments of the actions, the events or the queries,
+     * invalid if it is not known yet.  The time it was learned is kept by the state variable.
+     */
+    QVariant stateVariableValue(const QString &name) const;
+
+    // the handle is invalid for unknown actions and while the description is not loaded
+    ActionHandle resolveAction(const QString &name) const;
+    // return nullptr for unknown names and while the description is not loaded
+    const Action *findAction(const QString &name) const;
+    const StateVariable *findStateVariable(const QString &name) const;
+    const StateVariable *relatedStateVariable(ActionHandle action,
+                                              const QString &argumentName) const;
+
+    /* Loads the actions and state variables from the service description, from the cache if
+     * possible.  Emits ``descriptionLoaded`` or ``descriptionFailed`` from the event loop; after
+     * a failure, the next call or invocation tries again.  Does nothing while the description is
+     * loading or once it has been loaded.
+     */
+    void loadDescription();
+    bool isDescriptionLoaded() const;
+
+    /* Subscribes to the events of the service, its evented state variables are then emitted
+     * with ``stateVariableChanged`` instead of having to be polled.  The subscription is renewed
+     * before ``timeout`` (in s) expires, until ``unsubscribe`` is called or the service is
+     * destroyed.
+     */
+    void subscribe(int timeout=DEFAULT_SUBSCRIPTION_TIMEOUT);
+    void unsubscribe();
+    bool isSubscribed() const;
+
+    void setMaxInFlight(int maxInFlight);
+    int maxInFlight() const;
 
     QString id() const;
     QString serviceTypeIdentifier() const;
@@ -80,13 +197,84 @@ public:
     const std::vector<StateVariable> &stateVariables() const;
 
 Q_SIGNALS:
-    void actionInvoked(const QVariantMap &outputArguments, const QVariant &returnValue);
+    void descriptionLoaded();
+    void descriptionFailed();
+    void actionInvoked(quint64 invocationId, const QVariantMap &outputArguments,
+                       const QVariant &returnValue);
+    void actionFailed(quint64 invocationId); //< no valid reply was received
+    void subscribed();
+    void subscriptionFailed(); //< also when a renewal failed and the subscription is lost
     void serviceInstanceDied();
+    // only if the value differs from the cached one; variables not in the description always
     void stateVariableChanged(const QString &name, const QVariant &value);
 
 private:
-    /* Q_SLOT */ void onActionFinished(const QVariantMap &outputArguments,
+    struct Invocation
+    {
+        quint64 id;
+        const soap::RequestTemplate *requestTemplate; //< owned by the service
+        int action; //< index into ``m_actions``, -1 for the queries, which are not emitted
+        QStringList arguments;
+        std::shared_ptr<ActionDecoder> decoder;
+        ActionCallback finished;
+        FailureCallback failed;
+    };
+
+    // an invocation waiting for the service description, by name
+    struct DeferredInvocation
+    {
+        quint64 id;
+        QString actionName;
+        bool ordered;               //< the arguments are given in the order of the description
+        QVariantMap inputArguments; //< unless ``ordered``
+        QStringList arguments;      //< if ``ordered``
+        std::shared_ptr<ActionDecoder> decoder;
+        ActionCallback finished;
+        FailureCallback failed;
+    };
+
+    enum class DescriptionState {
+        NotLoaded,
+        Loading,
+        Loaded
+    };
+
+    // built when the description has been loaded, in the order of ``m_actions``
+    struct ActionEntry
+    {
+        QHash<QString, int> relatedStateVariables; //< argument name -> ``m_stateVariables`` index
+        std::vector<int> inputVariables; //< of the input arguments in order, -1 if unknown
+        std::unique_ptr<soap::RequestTemplate> requestTemplate; //< created on first invocation
+    };
+
+    // a request is reused for the following invocations once its reply has been handled
+    struct RequestSlot
+    {
+        std::unique_ptr<soap::Request> request;
+        std::shared_ptr<UpnpResponseHandler> handler;
+        Invocation invocation;
+        bool busy;
+    };
+
+    bool parseCachedDescription(const QByteArray &document);
+    void onDescriptionReceived(QNetworkReply *reply);
+    void finishDescription(bool loaded);
+    void buildIndexes();
+    bool coerceArguments(int action, QStringList &arguments) const;
+    InvokeActionResult defer(DeferredInvocation &&invocation, quint64 *invocationId);
+    const soap::RequestTemplate *requestTemplate(ActionHandle action);
+    InvokeActionResult enqueue(Invocation &&invocation, quint64 *invocationId);
+    void dispatch();
+    RequestSlot *idleSlot();
+    /* Q_SLOT */ void onActionFinished(RequestSlot *slot, const QVariantMap &outputArguments,
                                        const QVariant &returnValue);
+    /* Q_SLOT */ void onRequestFinished(RequestSlot *slot);
+    void onOutputArgument(RequestSlot *slot, const QString &name, const QString &value);
+    void updateStateVariable(int index, const QVariant &value);
+    void sendSubscribe(bool renewal);
+    /* Q_SLOT */ void onSubscribeFinished(QNetworkReply *reply, bool renewal);
+    Q_SLOT void renewSubscription();
+    bool onEvent(const QString &sid, quint32 seq, const QVariantMap &properties);
 
     std::vector<Action> m_actions;
     std::vector<StateVariable> m_stateVariables;
@@ -95,8 +283,26 @@ private:
     QUrl m_scpdURL;
     QUrl m_controlURL;
     QUrl m_eventSubURL;
-    std::unique_ptr<soap::Request> m_request;
-    bool m_invokationPending;
+    QString m_deviceIdentity; //< keys the cached description
+    std::shared_ptr<net::NetworkSession> m_session;
+    DescriptionState m_descriptionState;
+    std::unique_ptr<internal::ServiceDescriptionParser> m_parser; //< only while downloading
+    QByteArray m_document;    //< as downloaded so far, for the description cache
+    std::deque<DeferredInvocation> m_deferred;
+    QHash<QString, int> m_actionIndex;        //< name -> ``m_actions`` index
+    QHash<QString, int> m_stateVariableIndex; //< name -> ``m_stateVariables`` index
+    std::vector<ActionEntry> m_actionEntries;
+    soap::RequestTemplate m_queryStateVariableTemplate;
+    std::deque<Invocation> m_queue;
+    std::vector<std::unique_ptr<RequestSlot>> m_slots; //< created on demand
+    quint64 m_nextInvocationId;
+    int m_maxInFlight;
+    // GENA subscription
+    QString m_eventPath;   //< of the callback, empty while not subscribed
+    QString m_sid;         //< empty until the publisher has answered
+    quint32 m_eventKey;    //< expected with the next event
+    int m_subscriptionTimeout;
+    QTimer m_renewTimer;
 
     friend class internal::ServiceBuilder;
     Q_DISABLE_COPY(Service)
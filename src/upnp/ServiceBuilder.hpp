@@ -27,18 +27,21 @@
 #ifndef UPNP_INTERNAL_SERVICEBUILDER_HPP
 #define UPNP_INTERNAL_SERVICEBUILDER_HPP
 
-#include <QtCore/QList>
 #include <QtCore/QObject>
 #include <QtCore/QString>
 
-#include <QtNetwork/QNetworkAccessManager>
-
 #include <memory>
 
-class QNetworkReply;
 class QUrl;
 
 namespace fritzmon {
+
+namespace net {
+
+class NetworkSession;
+
+} // namespace net
+
 namespace upnp {
 
 class Service;
@@ -50,7 +53,7 @@ class ServiceBuilder : public QObject
     Q_OBJECT
 
 public:
-    ServiceBuilder(QObject *parent=nullptr);
+    ServiceBuilder(const std::shared_ptr<net::NetworkSession> &session, QObject *parent=nullptr);
     ~ServiceBuilder();
 
     ServiceBuilder &type(const QString &serviceType);
@@ -58,7 +61,12 @@ public:
     ServiceBuilder &scpdURL(const QUrl &scpdURL);
     ServiceBuilder &controlURL(const QUrl &controlURL);
     ServiceBuilder &eventSubURL(const QUrl &eventURL);
+    // names the device and its firmware, the cached service description is only used for these
+    ServiceBuilder &deviceIdentity(const QString &identity);
+    // the service is finished without its description, which it loads on first use
+    ServiceBuilder &lazyDescription(bool lazy);
 
+    // ``finished`` is emitted from the event loop, also if the description was cached
     void startDetection();
     std::unique_ptr<Service> create();
 
@@ -66,12 +74,8 @@ Q_SIGNALS:
     void finished();
 
 private:
-    Q_SLOT void onSslErrors(QNetworkReply *reply, const QList<QSslError> &errors);
-    Q_SLOT void serviceDescriptionReceived(QNetworkReply *reply);
-    void parseServiceDescription(const QByteArray &data);
-
-    QNetworkAccessManager m_networkAccess;
     std::unique_ptr<Service> m_instance;
+    bool m_lazyDescription;
 
     Q_DISABLE_COPY(ServiceBuilder)
 };
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ServiceDescriptionParser.hpp"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDebug>
+
+namespace fritzmon {
+namespace upnp {
+namespace internal {
+
+static constexpr auto DESCRIPTION_NAMESPACE_URI = "urn:schemas-upnp-org:service-1-0";
+static constexpr auto ROOT_TAG = "scpd";
+static constexpr auto ACTION_TAG = "action";
+static constexpr auto NAME_TAG = "name";
+static constexpr auto ARGUMENT_TAG = "argument";
+static constexpr auto DIRECTION_TAG = "direction";
+static constexpr auto DIRECTION_IN = "in";
+static constexpr auto DIRECTION_OUT = "out";
+static constexpr auto RELATEDSTATEVARIABLE_TAG = "relatedStateVariable";
+static constexpr auto *STATE_VARIABLE = "stateVariable";
+static constexpr auto *DATA_TYPE = "dataType";
+static constexpr auto *VALUE_UINT1 = "ui1";
+static constexpr auto *VALUE_UINT2 = "ui2";
+static constexpr auto *VALUE_UINT4 = "ui4";
+static constexpr auto *VALUE_INT1 = "i1";
+static constexpr auto *VALUE_INT2 = "i2";
+static constexpr auto *VALUE_INT4 = "i4";
+static constexpr auto *VALUE_INT = "int";
+static constexpr auto *VALUE_REAL4 = "r4";
+static constexpr auto *VALUE_REAL8 = "r8";
+static constexpr auto *VALUE_NUMBER = "number";
+static constexpr auto *VALUE_FIXED_14_4 = "fixed.14.4";
+static constexpr auto *VALUE_FLOAT = "float";
+static constexpr auto *VALUE_CHAR = "char";
+static constexpr auto *VALUE_STRING = "string";
+static constexpr auto *VALUE_DATE = "date";
+static constexpr auto *VALUE_DATETIME = "datetime";
+static constexpr auto *VALUE_DATETIME_TZ = "datetime.tz";
+static constexpr auto *VALUE_TIME = "time";
+static constexpr auto *VALUE_TIME_TZ = "time.tz";
+static constexpr auto *VALUE_BOOLEAN = "boolean";
+static constexpr auto *VALUE_BIN_BASE64 = "bin.base64";
+static constexpr auto *VALUE_BIN_HEX = "bin.hex";
+static constexpr auto *VALUE_URI = "uri";
+static constexpr auto *VALUE_UUID = "uuid";
+static constexpr auto *ALLOWED_VALUE = "allowedValue";
+static constexpr auto *DEFAULT_VALUE = "defaultValue";
+static constexpr auto *ALLOWED_VALUE_RANGE = "allowedValueRange";
+static constexpr auto *VALUE_MINIMUM = "minimum";
+static constexpr auto *VALUE_MAXIMUM = "maximum";
+static constexpr auto *VALUE_STEP = "step";
+
+static bool parseDataType(const QString &value, StateVariable::Type &type)
+{
+    if (value == VALUE_UINT1)
+        type = StateVariable::Type::Uint1;
+    else if (value == VALUE_UINT2)
+        type = StateVariable::Type::Uint2;
+    else if (value == VALUE_UINT4)
+        type = StateVariable::Type::Uint4;
+    else if (value == VALUE_INT1)
+        type = StateVariable::Type::Int1;
+    else if (value == VALUE_INT2)
+        type = StateVariable::Type::Int2;
+    else if (value == VALUE_INT4)
+        type = StateVariable::Type::Int4;
+    else if (value == VALUE_INT)
+        type = StateVariable::Type::Int;
+    else if (value == VALUE_REAL4)
+        type = StateVariable::Type::Real4;
+    else if (value == VALUE_REAL8)
+        type = StateVariable::Type::Real8;
+    else if (value == VALUE_NUMBER)
+        type = StateVariable::Type::Number;
+    else if (value == VALUE_FIXED_14_4)
+        type = StateVariable::Type::Fixed_14_4;
+    else if (value == VALUE_FLOAT)
+        type = StateVariable::Type::Float;
+    else if (value == VALUE_CHAR)
+        type = StateVariable::Type::Char;
+    else if (value == VALUE_STRING)
+        type = StateVariable::Type::String;
+    else if (value == VALUE_DATE)
+        type = StateVariable::Type::Date;
+    else if (value == VALUE_DATETIME)
+        type = StateVariable::Type::Datetime;
+    else if (value == VALUE_DATETIME_TZ)
+        type = StateVariable::Type::Datetime_tz;
+    else if (value == VALUE_TIME)
+        type = StateVariable::Type::Time;
+    else if (value == VALUE_TIME_TZ)
+        type = StateVariable::Type::Time_tz;
+    else if (value == VALUE_BOOLEAN)
+        type = StateVariable::Type::Boolean;
+    else if (value == VALUE_BIN_BASE64)
+        type = StateVariable::Type::Bin_Base64;
+    else if (value == VALUE_BIN_HEX)
+        type = StateVariable::Type::Bin_Hex;
+    else if (value == VALUE_URI)
+        type = StateVariable::Type::Uri;
+    else if (value == VALUE_UUID)
+        type = StateVariable::Type::Uuid;
+    else
+        return false;
+
+    return true;
+}
+
+ServiceDescriptionParser::ServiceDescriptionParser(std::vector<Action> &actions,
+                                                   std::vector<StateVariable> &stateVariables)
+  : m_state(ParserState::Prolog),
+    m_reader(),
+    m_text(),
+    m_actions(actions),
+    m_stateVariables(stateVariables),
+    m_argumentDirection(Argument::Direction::In),
+    m_variableType(StateVariable::Type::String),
+    m_defaultValue(),
+    m_allowedValues(),
+    m_minimum(),
+    m_maximum(),
+    m_step()
+{}
+
+void ServiceDescriptionParser::addData(const QByteArray &data)
+{
+    m_reader.addData(data);
+    readTokens();
+}
+
+bool ServiceDescriptionParser::finish()
+{
+    if (m_state == ParserState::Prolog) {
+        qDebug() << "ServiceDescriptionParser: empty description document";
+
+        return false;
+    }
+    if (m_reader.error() == QXmlStreamReader::PrematureEndOfDocumentError) {
+        qDebug() << "ServiceDescriptionParser: incomplete description document";
+
+        return false;
+    }
+
+    return m_state != ParserState::Error;
+}
+
+void ServiceDescriptionParser::readTokens()
+{
+    // an incomplete document ends with a premature end error, which is recovered from by adding
+    // more data and reading on
+    while (m_state != ParserState::Error) {
+        switch (m_reader.readNext()) {
+        case QXmlStreamReader::Invalid:
+            if (m_reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
+                qDebug() << "ServiceDescriptionParser: parse error:" << m_reader.errorString();
+                m_state = ParserState::Error;
+            }
+
+            return;
+        case QXmlStreamReader::EndDocument:
+            return;
+        case QXmlStreamReader::StartElement:
+            m_text.clear();
+            startElement();
+            break;
+        case QXmlStreamReader::Characters:
+            m_text += m_reader.text();
+            break;
+        case QXmlStreamReader::EndElement:
+            endElement();
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void ServiceDescriptionParser::startElement()
+{
+    // Don't check for the element namespace, just assume things are right for now.  This
+    // behaviour may change if there are description documents with mixed xml schemas.
+    auto tagName = m_reader.name();
+
+    switch (m_state) {
+    case ParserState::Prolog:
+        // "verify" the schema
+        if (m_reader.namespaceUri() != DESCRIPTION_NAMESPACE_URI) {
+            qDebug() << "ServiceDescriptionParser: parse error: wrong root element namespace"
+                     << m_reader.namespaceUri();
+            m_state = ParserState::Error;
+        } else if (tagName != ROOT_TAG) {
+            qDebug() << "ServiceDescriptionParser: parse error: wrong root element name"
+                     << tagName;
+            m_state = ParserState::Error;
+        } else
+            m_state = ParserState::TopLevelElement;
+        break;
+    case ParserState::TopLevelElement:
+        if (tagName == ACTION_TAG)
+            m_state = ParserState::Action;
+        else if (tagName == STATE_VARIABLE)
+            m_state = ParserState::StateVariable;
+        break;
+    case ParserState::Action:
+        if (tagName == ARGUMENT_TAG)
+            m_state = ParserState::Argument;
+        break;
+    case ParserState::StateVariable:
+    case ParserState::Argument:
+    case ParserState::Error:
+        break;
+    }
+}
+
+void ServiceDescriptionParser::endElement()
+{
+    auto tagName = m_reader.name();
+
+    switch (m_state) {
+    case ParserState::Action:
+        if (tagName == NAME_TAG)
+            m_actionName = m_text;
+        else if (tagName == ACTION_TAG) {
+            m_actions.emplace_back(m_actionName, m_actionArguments);
+            m_actionName.clear();
+            m_actionArguments.clear();
+            m_state = ParserState::TopLevelElement;
+        }
+        break;
+    case ParserState::Argument:
+        if (tagName == NAME_TAG)
+            m_argumentName = m_text;
+        else if (tagName == RELATEDSTATEVARIABLE_TAG)
+            m_argumentStateVariable = m_text;
+        else if (tagName == DIRECTION_TAG) {
+            if (m_text == DIRECTION_IN)
+                m_argumentDirection = Argument::Direction::In;
+            else if (m_text == DIRECTION_OUT)
+                m_argumentDirection = Argument::Direction::Out;
+        } else if (tagName == ARGUMENT_TAG) {
+            m_actionArguments.emplace_back(m_argumentName, m_argumentStateVariable,
+                                           m_argumentDirection);
+            m_argumentName.clear();
+            m_argumentStateVariable.clear();
+            m_state = ParserState::Action;
+        }
+        break;
+    case ParserState::StateVariable:
+        if (tagName == NAME_TAG)
+            m_variableName = m_text;
+        else if (tagName == DATA_TYPE) {
+            if (!parseDataType(m_text, m_variableType))
+                qDebug() << "ServiceDescriptionParser: invalid data type" << m_text;
+        } else if (tagName == ALLOWED_VALUE)
+            m_allowedValues << m_text;
+        else if (tagName == DEFAULT_VALUE)
+            m_defaultValue = m_text;
+        else if (tagName == VALUE_MINIMUM)
+            m_minimum = m_text.trimmed();
+        else if (tagName == VALUE_MAXIMUM)
+            m_maximum = m_text.trimmed();
+        else if (tagName == VALUE_STEP)
+            m_step = m_text.trimmed();
+        else if (tagName == ALLOWED_VALUE_RANGE) {
+            // the step is optional, but a range is only used if it is complete
+            if (!m_minimum.isValid() || !m_maximum.isValid()) {
+                qDebug() << "ServiceDescriptionParser: incomplete value range of" << m_variableName;
+                m_minimum.clear();
+                m_maximum.clear();
+                m_step.clear();
+            }
+        } else if (tagName == STATE_VARIABLE) {
+            m_stateVariables.emplace_back(m_variableName, m_variableType, QVariant());
+
+            auto &variable = m_stateVariables.back();
+
+            variable.setDefaultValue(m_defaultValue);
+            variable.setAllowedValues(m_allowedValues);
+            variable.setAllowedValueRange(m_minimum, m_maximum, m_step);
+            m_defaultValue.clear();
+            m_allowedValues.clear();
+            m_minimum.clear();
+            m_maximum.clear();
+            m_step.clear();
+            m_state = ParserState::TopLevelElement;
+        }
+        break;
+    case ParserState::Prolog:
+    case ParserState::TopLevelElement:
+    case ParserState::Error:
+        break;
+    }
+}
+
+} // namespace internal
+} // namespace upnp
+} // namespace fritzmon
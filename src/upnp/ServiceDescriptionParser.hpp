@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UPNP_INTERNAL_SERVICEDESCRIPTIONPARSER_HPP
+#define UPNP_INTERNAL_SERVICEDESCRIPTIONPARSER_HPP
+
+#include "upnp/Action.hpp"
+#include "upnp/StateVariable.hpp"
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVariant>
+#include <QtCore/QXmlStreamReader>
+
+#include <vector>
+
+class QByteArray;
+
+namespace fritzmon {
+namespace upnp {
+namespace internal {
+
+/* Parses a service description (SCPD) while it is downloaded.
+ *
+ * The data is passed in with ``addData`` as it arrives; actions and state variables are appended
+ * to the given vectors as soon as their elements are complete.
+ */
+class ServiceDescriptionParser
+{
+public:
+    ServiceDescriptionParser(std::vector<Action> &actions,
+                             std::vector<StateVariable> &stateVariables);
+
+    void addData(const QByteArray &data);
+    // returns false if the document was invalid or incomplete
+    bool finish();
+
+private:
+    void readTokens();
+    void startElement();
+    void endElement();
+
+    enum class ParserState {
+        Prolog,
+        TopLevelElement,
+        Action,
+        Argument,
+        StateVariable,
+        Error
+    } m_state;
+    QXmlStreamReader m_reader;
+    QString m_text; //< character data of the current element
+    std::vector<Action> &m_actions;
+    std::vector<StateVariable> &m_stateVariables;
+
+    QString m_actionName;
+    std::vector<Argument> m_actionArguments;
+    QString m_argumentName;
+    QString m_argumentStateVariable;
+    Argument::Direction m_argumentDirection;
+    QString m_variableName;
+    StateVariable::Type m_variableType;
+    QVariant m_defaultValue;
+    QStringList m_allowedValues;
+    QVariant m_minimum;
+    QVariant m_maximum;
+    QVariant m_step;
+
+    Q_DISABLE_COPY(ServiceDescriptionParser)
+};
+
+} // namespace internal
+} // namespace upnp
+} // namespace fritzmon
+
+#endif // UPNP_INTERNAL_SERVICEDESCRIPTIONPARSER_HPP
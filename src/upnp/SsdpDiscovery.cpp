@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SsdpDiscovery.hpp"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QStringList>
+
+#include <algorithm>
+
+namespace fritzmon {
+namespace upnp {
+
+static constexpr auto *MULTICAST_ADDRESS = "239.255.255.250";
+static constexpr auto MULTICAST_PORT = 1900;
+static constexpr auto MULTICAST_TTL = 2; //< recommended by the UDA
+static constexpr auto SEARCH_REPEAT = 2; //< as UDP may drop the request
+static constexpr auto DEFAULT_MAX_AGE = 1800; //< in s, if a device does not send one
+static constexpr auto EXPIRY_INTERVAL = 10000; //< in ms
+static constexpr auto *LINE_END = "\r\n";
+static constexpr auto *RESPONSE_LINE = "HTTP/1.1 200 OK";
+static constexpr auto *NOTIFY_LINE = "NOTIFY * HTTP/1.1";
+static constexpr auto *SSDP_ALL = "ssdp:all";
+static constexpr auto *SSDP_ALIVE = "ssdp:alive";
+static constexpr auto *SSDP_BYEBYE = "ssdp:byebye";
+static constexpr auto *MAX_AGE_DIRECTIVE = "max-age";
+// the field names are compared in lower case
+static constexpr auto *CACHE_CONTROL_FIELD = "cache-control";
+static constexpr auto *LOCATION_FIELD = "location";
+static constexpr auto *NT_FIELD = "nt";
+static constexpr auto *NTS_FIELD = "nts";
+static constexpr auto *ST_FIELD = "st";
+static constexpr auto *USN_FIELD = "usn";
+
+static QHash<QByteArray, QByteArray> parseFields(const QList<QByteArray> &lines)
+{
+    QHash<QByteArray, QByteArray> fields;
+
+    for (const auto &line : lines) {
+        auto colon = line.indexOf(':');
+
+        if (colon > 0)
+            fields.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+    }
+
+    return fields;
+}
+
+// the max-age directive of a CACHE-CONTROL field, in s
+static int parseMaxAge(const QByteArray &cacheControl)
+{
+    for (const auto &directive : cacheControl.split(',')) {
+        auto equals = directive.indexOf('=');
+
+        if ((equals > 0) && (directive.left(equals).trimmed().toLower() == MAX_AGE_DIRECTIVE)) {
+            auto valid = false;
+            auto maxAge = directive.mid(equals + 1).trimmed().toInt(&valid);
+
+            if (valid && (maxAge > 0))
+                return maxAge;
+        }
+    }
+
+    return DEFAULT_MAX_AGE;
+}
+
+SsdpDiscovery::SsdpDiscovery(QObject *parent)
+  : QObject(parent),
+    m_searchSocket(),
+    m_notifySocket(),
+    m_groupAddress(QString(MULTICAST_ADDRESS)),
+    m_groupPort(MULTICAST_PORT),
+    m_searchTarget(),
+    m_searchTimer(),
+    m_expiryTimer(),
+    m_cache(),
+    m_duplicates(0)
+{
+    m_searchTimer.setSingleShot(true);
+    connect(&m_searchTimer, &QTimer::timeout, this, &SsdpDiscovery::onSearchTimeout);
+    connect(&m_expiryTimer, &QTimer::timeout, this, &SsdpDiscovery::expireEntries);
+    // the responses to a search are unicast, the announcements multicast
+    connect(&m_searchSocket, &QUdpSocket::readyRead, this, &SsdpDiscovery::onReadyRead);
+    connect(&m_notifySocket, &QUdpSocket::readyRead, this, &SsdpDiscovery::onReadyRead);
+}
+
+SsdpDiscovery::~SsdpDiscovery() = default;
+
+void SsdpDiscovery::setGroup(const QHostAddress &address, quint16 port)
+{
+    m_groupAddress = address;
+    m_groupPort = port;
+}
+
+void SsdpDiscovery::search(const QString &searchTarget, int mx)
+{
+    if (m_searchSocket.state() != QAbstractSocket::BoundState) {
+        if (!m_searchSocket.bind(QHostAddress(QHostAddress::AnyIPv4), 0)) {
+            qDebug() << "SsdpDiscovery::search: failed to bind:" << m_searchSocket.errorString();
+            emit searchFinished();
+
+            return;
+        }
+        m_searchSocket.setSocketOption(QAbstractSocket::MulticastTtlOption, MULTICAST_TTL);
+    }
+
+    auto host = m_groupAddress.toString() + ':' + QString::number(m_groupPort);
+    auto request = QByteArray("M-SEARCH * HTTP/1.1") + LINE_END
+                   + "HOST: " + host.toUtf8() + LINE_END
+                   + "MAN: \"ssdp:discover\"" + LINE_END
+                   + "MX: " + QByteArray::number(mx) + LINE_END
+                   + "ST: " + searchTarget.toUtf8() + LINE_END
+                   + LINE_END;
+
+    m_searchTarget = searchTarget;
+    for (auto i = 0; i < SEARCH_REPEAT; ++i)
+        m_searchSocket.writeDatagram(request, m_groupAddress, m_groupPort);
+    // the devices answer within mx seconds, one more allows for the network
+    m_searchTimer.start((mx + 1) * 1000);
+}
+
+bool SsdpDiscovery::isSearching() const
+{
+    return m_searchTimer.isActive();
+}
+
+bool SsdpDiscovery::listen(const QString &searchTarget)
+{
+    m_searchTarget = searchTarget;
+    if (m_notifySocket.state() == QAbstractSocket::BoundState)
+        return true;
+    if (!m_notifySocket.bind(QHostAddress(QHostAddress::AnyIPv4), m_groupPort,
+                             QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
+        qDebug() << "SsdpDiscovery::listen: failed to bind:" << m_notifySocket.errorString();
+
+        return false;
+    }
+    if (m_groupAddress.isMulticast() && !m_notifySocket.joinMulticastGroup(m_groupAddress)) {
+        qDebug() << "SsdpDiscovery::listen: failed to join" << m_groupAddress;
+        m_notifySocket.close();
+
+        return false;
+    }
+
+    return true;
+}
+
+QList<QUrl> SsdpDiscovery::locations() const
+{
+    auto locations = QList<QUrl>();
+
+    for (const auto &entry : m_cache)
+        if (!locations.contains(entry.location))
+            locations << entry.location;
+
+    return locations;
+}
+
+quint64 SsdpDiscovery::duplicates() const
+{
+    return m_duplicates;
+}
+
+void SsdpDiscovery::onReadyRead()
+{
+    auto *socket = qobject_cast<QUdpSocket *>(sender());
+
+    while (socket->hasPendingDatagrams()) {
+        auto datagram = QByteArray(static_cast<int>(std::max(socket->pendingDatagramSize(), 0ll)),
+                                   Qt::Uninitialized);
+
+        socket->readDatagram(datagram.data(), datagram.size());
+        handleMessage(datagram);
+    }
+}
+
+void SsdpDiscovery::onSearchTimeout()
+{
+    emit searchFinished();
+}
+
+void SsdpDiscovery::expireEntries()
+{
+    auto now = QDateTime::currentMSecsSinceEpoch();
+    auto expired = QStringList();
+
+    for (auto it = m_cache.cbegin(); it != m_cache.cend(); ++it)
+        if (it->expiresAt <= now)
+            expired << it.key();
+    for (const auto &usn : expired)
+        removeEntry(usn);
+}
+
+void SsdpDiscovery::handleMessage(const QByteArray &datagram)
+{
+    auto lines = datagram.split('\n');
+
+    if (lines.isEmpty())
+        return;
+
+    auto startLine = lines.takeFirst().trimmed();
+    auto fields = parseFields(lines);
+    auto usn = QString::fromUtf8(fields.value(USN_FIELD));
+    auto matches = [this](const QByteArray &target) {
+        return (m_searchTarget == SSDP_ALL) || (QString::fromUtf8(target) == m_searchTarget);
+    };
+
+    if (usn.isEmpty())
+        return;
+    if (startLine == RESPONSE_LINE) {
+        if (matches(fields.value(ST_FIELD)))
+            addEntry(usn, QUrl(QString::fromUtf8(fields.value(LOCATION_FIELD))),
+                     parseMaxAge(fields.value(CACHE_CONTROL_FIELD)));
+    } else if (startLine == NOTIFY_LINE) {
+        auto nts = fields.value(NTS_FIELD);
+
+        if (!matches(fields.value(NT_FIELD)))
+            return;
+        if (nts == SSDP_ALIVE)
+            addEntry(usn, QUrl(QString::fromUtf8(fields.value(LOCATION_FIELD))),
+                     parseMaxAge(fields.value(CACHE_CONTROL_FIELD)));
+        else if (nts == SSDP_BYEBYE)
+            removeEntry(usn);
+    }
+}
+
+void SsdpDiscovery::addEntry(const QString &usn, const QUrl &location, int maxAge)
+{
+    if (!location.isValid() || location.isRelative()) {
+        qDebug() << "SsdpDiscovery::addEntry: invalid location for" << usn;
+
+        return;
+    }
+
+    auto expiresAt = QDateTime::currentMSecsSinceEpoch() + maxAge * 1000ll;
+    auto entry = m_cache.find(usn);
+
+    if ((entry != m_cache.end()) && (entry->location == location)) {
+        entry->expiresAt = expiresAt;
+        ++m_duplicates;
+
+        return;
+    }
+    m_cache.insert(usn, CacheEntry{ location, expiresAt });
+    if (!m_expiryTimer.isActive())
+        m_expiryTimer.start(EXPIRY_INTERVAL);
+
+    emit deviceFound(usn, location);
+}
+
+void SsdpDiscovery::removeEntry(const QString &usn)
+{
+    auto entry = m_cache.find(usn);
+
+    if (entry == m_cache.end())
+        return;
+
+    auto location = entry->location;
+
+    m_cache.erase(entry);
+    if (m_cache.isEmpty())
+        m_expiryTimer.stop();
+
+    emit deviceLost(usn, location);
+}
+
+} // namespace upnp
+} // namespace fritzmon
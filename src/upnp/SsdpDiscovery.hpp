@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FRITZMON_UPNP_SSDPDISCOVERY_HPP
+#define FRITZMON_UPNP_SSDPDISCOVERY_HPP
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QTimer>
+#include <QtCore/QUrl>
+
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QUdpSocket>
+
+namespace fritzmon {
+namespace upnp {
+
+/* SSDP discovery (UPnP Device Architecture 1.1, chapter 1) of the devices of one search target.
+ *
+ * ``search`` multicasts an ``M-SEARCH`` and collects the responses which arrive within ``mx``
+ * seconds, ``listen`` receives the ``NOTIFY`` announcements of the devices.  Both are
+ * deduplicated by their USN and cached for their ``max-age``, so ``deviceFound`` is only emitted
+ * for new devices or changed locations and ``deviceLost`` when a device says goodbye or its
+ * announcement expires.
+ */
+class SsdpDiscovery : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr auto DEFAULT_MX = 2; //< in s
+
+    explicit SsdpDiscovery(QObject *parent=nullptr);
+    ~SsdpDiscovery();
+
+    // 239.255.255.250:1900 by default, a responder on loopback can be used instead
+    void setGroup(const QHostAddress &address, quint16 port);
+
+    void search(const QString &searchTarget, int mx=DEFAULT_MX);
+    bool isSearching() const;
+    bool listen(const QString &searchTarget);
+
+    QList<QUrl> locations() const; //< of the cached devices
+    quint64 duplicates() const;    //< responses and announcements of known devices
+
+Q_SIGNALS:
+    void deviceFound(const QString &usn, const QUrl &location);
+    void deviceLost(const QString &usn, const QUrl &location);
+    void searchFinished();
+
+private:
+    struct CacheEntry
+    {
+        QUrl location;
+        qint64 expiresAt; //< in ms since the epoch
+    };
+
+    Q_SLOT void onReadyRead();
+    Q_SLOT void onSearchTimeout();
+    Q_SLOT void expireEntries();
+    void handleMessage(const QByteArray &datagram);
+    void addEntry(const QString &usn, const QUrl &location, int maxAge);
+    void removeEntry(const QString &usn);
+
+    QUdpSocket m_searchSocket;
+    QUdpSocket m_notifySocket;
+    QHostAddress m_groupAddress;
+    quint16 m_groupPort;
+    QString m_searchTarget;
+    QTimer m_searchTimer;
+    QTimer m_expiryTimer;
+    QHash<QString, CacheEntry> m_cache; //< by USN
+    quint64 m_duplicates;
+
+    Q_DISABLE_COPY(SsdpDiscovery)
+};
+
+} // namespace upnp
+} // namespace fritzmon
+
+#endif // FRITZMON_UPNP_SSDPDISCOVERY_HPP
@@ -26,13 +26,64 @@
 
 #include "StateVariable.hpp"
 
+#include <limits>
+
 namespace fritzmon {
 namespace upnp {
 
+static constexpr auto *TRUE_VALUE = "1";
+static constexpr auto *FALSE_VALUE = "0";
+static constexpr auto *TRUE_NAME = "true";
+static constexpr auto *FALSE_NAME = "false";
+static constexpr auto *YES_NAME = "yes";
+static constexpr auto *NO_NAME = "no";
+
+// the bounds of the integer types, false for the other types
+static bool integerBounds(StateVariable::Type type, qlonglong *minimum, qlonglong *maximum)
+{
+    switch (type) {
+    case StateVariable::Type::Uint1:
+        *minimum = 0;
+        *maximum = std::numeric_limits<quint8>::max();
+        break;
+    case StateVariable::Type::Uint2:
+        *minimum = 0;
+        *maximum = std::numeric_limits<quint16>::max();
+        break;
+    case StateVariable::Type::Uint4:
+        *minimum = 0;
+        *maximum = std::numeric_limits<quint32>::max();
+        break;
+    case StateVariable::Type::Int1:
+        *minimum = std::numeric_limits<qint8>::min();
+        *maximum = std::numeric_limits<qint8>::max();
+        break;
+    case StateVariable::Type::Int2:
+        *minimum = std::numeric_limits<qint16>::min();
+        *maximum = std::numeric_limits<qint16>::max();
+        break;
+    case StateVariable::Type::Int4:
+    case StateVariable::Type::Int:
+        *minimum = std::numeric_limits<qint32>::min();
+        *maximum = std::numeric_limits<qint32>::max();
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
 StateVariable::StateVariable(const QString &name, Type type, const QVariant &value)
   : m_name(name),
     m_type(type),
-    m_value(value)
+    m_value(value),
+    m_updated(),
+    m_defaultValue(),
+    m_allowedValues(),
+    m_minimum(),
+    m_maximum(),
+    m_step()
 {}
 
 QString StateVariable::name() const
@@ -50,5 +101,148 @@ QVariant StateVariable::value() const
     return m_value;
 }
 
+QDateTime StateVariable::updated() const
+{
+    return m_updated;
+}
+
+bool StateVariable::setValue(const QVariant &value, const QDateTime &updated)
+{
+    m_updated = updated;
+    if (m_value.isValid() && (m_value == value))
+        return false;
+    m_value = value;
+
+    return true;
+}
+
+QVariant StateVariable::defaultValue() const
+{
+    return m_defaultValue;
+}
+
+QStringList StateVariable::allowedValues() const
+{
+    return m_allowedValues;
+}
+
+QVariant StateVariable::minimum() const
+{
+    return m_minimum;
+}
+
+QVariant StateVariable::maximum() const
+{
+    return m_maximum;
+}
+
+QVariant StateVariable::step() const
+{
+    return m_step;
+}
+
+void StateVariable::setDefaultValue(const QVariant &defaultValue)
+{
+    m_defaultValue = defaultValue;
+}
+
+void StateVariable::setAllowedValues(const QStringList &allowedValues)
+{
+    m_allowedValues = allowedValues;
+}
+
+void StateVariable::setAllowedValueRange(const QVariant &minimum, const QVariant &maximum,
+                                         const QVariant &step)
+{
+    m_minimum = minimum;
+    m_maximum = maximum;
+    m_step = step;
+}
+
+bool StateVariable::validate(const QString &value, QString *coerced) const
+{
+    switch (m_type) {
+    case Type::Uint1:
+    case Type::Uint2:
+    case Type::Uint4:
+    case Type::Int1:
+    case Type::Int2:
+    case Type::Int4:
+    case Type::Int:
+        return validateInteger(value, coerced);
+    case Type::Real4:
+    case Type::Real8:
+    case Type::Number:
+    case Type::Fixed_14_4:
+    case Type::Float:
+        return validateReal(value, coerced);
+    case Type::Boolean: {
+        auto normalized = value.trimmed().toLower();
+
+        if ((normalized == TRUE_VALUE) || (normalized == TRUE_NAME) || (normalized == YES_NAME))
+            *coerced = TRUE_VALUE;
+        else if ((normalized == FALSE_VALUE) || (normalized == FALSE_NAME)
+                 || (normalized == NO_NAME))
+            *coerced = FALSE_VALUE;
+        else
+            return false;
+
+        return true;
+    }
+    case Type::Char:
+        *coerced = value;
+
+        return value.size() == 1;
+    default:
+        // the allowed values are only defined for strings
+        if (!m_allowedValues.isEmpty() && !m_allowedValues.contains(value))
+            return false;
+        *coerced = value;
+
+        return true;
+    }
+}
+
+bool StateVariable::validateInteger(const QString &value, QString *coerced) const
+{
+    auto minimum = qlonglong(0);
+    auto maximum = qlonglong(0);
+    auto ok = false;
+    auto number = value.trimmed().toLongLong(&ok);
+
+    integerBounds(m_type, &minimum, &maximum);
+    if (!ok || (number < minimum) || (number > maximum))
+        return false;
+    if (m_minimum.isValid() && (number < m_minimum.toLongLong()))
+        return false;
+    if (m_maximum.isValid() && (number > m_maximum.toLongLong()))
+        return false;
+    // the steps are counted from the minimum of the range
+    if (m_step.isValid() && (m_step.toLongLong() > 0)
+            && (((number - m_minimum.toLongLong()) % m_step.toLongLong()) != 0))
+        return false;
+    *coerced = QString::number(number);
+
+    return true;
+}
+
+bool StateVariable::validateReal(const QString &value, QString *coerced) const
+{
+    auto ok = false;
+    auto trimmed = value.trimmed();
+    auto number = trimmed.toDouble(&ok);
+
+    if (!ok)
+        return false;
+    if (m_minimum.isValid() && (number < m_minimum.toDouble()))
+        return false;
+    if (m_maximum.isValid() && (number > m_maximum.toDouble()))
+        return false;
+    // reformatting would only lose precision
+    *coerced = trimmed;
+
+    return true;
+}
+
 } // namespace upnp
 } // namespace fritzmon
@@ -27,7 +27,9 @@
 #ifndef FRITZMON_UPNP_STATEVARIABLE_HPP
 #define FRITZMON_UPNP_STATEVARIABLE_HPP
 
+#include <QtCore/QDateTime>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QVariant>
 
 namespace fritzmon {
@@ -68,11 +70,42 @@ public:
     QString name() const;
     Type type() const;
     QVariant value() const;
+    // when the value was learned last, invalid if it is not known
+    QDateTime updated() const;
+
+    // returns false if the value is unchanged, ``updated`` is taken over in any case
+    bool setValue(const QVariant &value, const QDateTime &updated);
+
+    // the constraints of the service description, invalid or empty if there are none
+    QVariant defaultValue() const;
+    QStringList allowedValues() const;
+    QVariant minimum() const;
+    QVariant maximum() const;
+    QVariant step() const;
+    void setDefaultValue(const QVariant &defaultValue);
+    void setAllowedValues(const QStringList &allowedValues);
+    void setAllowedValueRange(const QVariant &minimum, const QVariant &maximum,
+                              const QVariant &step);
+
+    /* Checks ``value`` against the type and the constraints of the variable.  ``coerced``
+     * receives the value in the form the router expects, e.g. ``1`` for ``true`` or ``7`` for
+     * `` +7``; it is only valid if true is returned.
+     */
+    bool validate(const QString &value, QString *coerced) const;
 
 private:
+    bool validateInteger(const QString &value, QString *coerced) const;
+    bool validateReal(const QString &value, QString *coerced) const;
+
     QString m_name;
     Type m_type;
     QVariant m_value;
+    QDateTime m_updated;
+    QVariant m_defaultValue;
+    QStringList m_allowedValues;
+    QVariant m_minimum;
+    QVariant m_maximum;
+    QVariant m_step;
 };
 
 } // namespace upnp
@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2016 Florian Limberger <flo@snakeoilproductions.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* scpdgen - generates typed action stubs from a service description (SCPD)
+ *
+ * For every action of the service, a response structure with one native field per output
+ * argument and an invocation method taking the typed input arguments are generated.  The
+ * responses are decoded directly into the fields while the reply is parsed.
+ *
+ * usage: scpdgen <scpd.xml> <output directory> <service name>
+ */
+
+#include "upnp/Action.hpp"
+#include "upnp/ServiceDescriptionParser.hpp"
+#include "upnp/StateVariable.hpp"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QString>
+#include <QtCore/QTextStream>
+
+#include <algorithm>
+#include <vector>
+
+using namespace fritzmon::upnp;
+
+static constexpr auto *USAGE = "usage: scpdgen <scpd.xml> <output directory> <service name>";
+static constexpr auto *OUTPUT_NAMESPACE = "tr064";
+
+static QString fieldName(const QString &argumentName)
+{
+    auto name = argumentName;
+
+    if (!name.isEmpty())
+        name[0] = name[0].toLower();
+
+    return name;
+}
+
+// the member which keeps the resolved action of the stub
+static QString handleName(const Action &action)
+{
+    return "m_" + fieldName(action.name()) + "Action";
+}
+
+static QString cppType(StateVariable::Type type)
+{
+    switch (type) {
+    case StateVariable::Type::Uint1:
+        return "quint8";
+    case StateVariable::Type::Uint2:
+        return "quint16";
+    case StateVariable::Type::Uint4:
+        return "quint32";
+    case StateVariable::Type::Int1:
+        return "qint8";
+    case StateVariable::Type::Int2:
+        return "qint16";
+    case StateVariable::Type::Int4:
+    case StateVariable::Type::Int:
+        return "qint32";
+    case StateVariable::Type::Real4:
+    case StateVariable::Type::Float:
+        return "float";
+    case StateVariable::Type::Real8:
+    case StateVariable::Type::Number:
+    case StateVariable::Type::Fixed_14_4:
+        return "double";
+    case StateVariable::Type::Boolean:
+        return "bool";
+    case StateVariable::Type::Char:
+        return "QChar";
+    default:
+        return "QString";
+    }
+}
+
+static QString initializer(StateVariable::Type type)
+{
+    switch (type) {
+    case StateVariable::Type::Uint1:
+    case StateVariable::Type::Uint2:
+    case StateVariable::Type::Uint4:
+    case StateVariable::Type::Int1:
+    case StateVariable::Type::Int2:
+    case StateVariable::Type::Int4:
+    case StateVariable::Type::Int:
+        return " = 0";
+    case StateVariable::Type::Real4:
+    case StateVariable::Type::Float:
+        return " = 0.0f";
+    case StateVariable::Type::Real8:
+    case StateVariable::Type::Number:
+    case StateVariable::Type::Fixed_14_4:
+        return " = 0.0";
+    case StateVariable::Type::Boolean:
+        return " = false";
+    default:
+        return QString();
+    }
+}
+
+// converts the reply text ``value`` to the native type, setting ``ok``
+static QString decodeExpression(StateVariable::Type type)
+{
+    switch (type) {
+    case StateVariable::Type::Uint1:
+        return "static_cast<quint8>(value.toUShort(&ok))";
+    case StateVariable::Type::Uint2:
+        return "value.toUShort(&ok)";
+    case StateVariable::Type::Uint4:
+        return "value.toUInt(&ok)";
+    case StateVariable::Type::Int1:
+        return "static_cast<qint8>(value.toShort(&ok))";
+    case StateVariable::Type::Int2:
+        return "value.toShort(&ok)";
+    case StateVariable::Type::Int4:
+    case StateVariable::Type::Int:
+        return "value.toInt(&ok)";
+    case StateVariable::Type::Real4:
+    case StateVariable::Type::Float:
+        return "value.toFloat(&ok)";
+    case StateVariable::Type::Real8:
+    case StateVariable::Type::Number:
+    case StateVariable::Type::Fixed_14_4:
+        return "value.toDouble(&ok)";
+    case StateVariable::Type::Boolean:
+        return "(value == QLatin1String(\"1\")) || (value == QLatin1String(\"true\"))"
+               " || (value == QLatin1String(\"yes\"))";
+    case StateVariable::Type::Char:
+        return "value.isEmpty() ? QChar() : value.at(0)";
+    default:
+        return "value";
+    }
+}
+
+// converts the input argument ``name`` to its request text
+static QString encodeExpression(StateVariable::Type type, const QString &name)
+{
+    switch (type) {
+    case StateVariable::Type::Boolean:
+        return QString("QString(%1 ? QLatin1Char('1') : QLatin1Char('0'))").arg(name);
+    case StateVariable::Type::Char:
+        return QString("QString(%1)").arg(name);
+    case StateVariable::Type::Date:
+    case StateVariable::Type::Datetime:
+    case StateVariable::Type::Datetime_tz:
+    case StateVariable::Type::Time:
+    case StateVariable::Type::Time_tz:
+    case StateVariable::Type::String:
+    case StateVariable::Type::Bin_Base64:
+    case StateVariable::Type::Bin_Hex:
+    case StateVariable::Type::Uri:
+    case StateVariable::Type::Uuid:
+        return name;
+    default:
+        return QString("QString::number(%1)").arg(name);
+    }
+}
+
+static bool isPassedByReference(StateVariable::Type type)
+{
+    return cppType(type) == "QString";
+}
+
+class Generator
+{
+public:
+    Generator(const QString &serviceName, const QString &sourceName,
+              const std::vector<Action> &actions,
+              const std::vector<StateVariable> &stateVariables);
+
+    QString header() const;
+    QString source() const;
+
+private:
+    StateVariable::Type argumentType(const Argument &argument) const;
+    // with the default arguments in the ``declaration``
+    QString parameterList(const Action &action, bool declaration) const;
+
+    QString m_serviceName;
+    QString m_sourceName;
+    const std::vector<Action> &m_actions;
+    const std::vector<StateVariable> &m_stateVariables;
+};
+
+Generator::Generator(const QString &serviceName, const QString &sourceName,
+                     const std::vector<Action> &actions,
+                     const std::vector<StateVariable> &stateVariables)
+  : m_serviceName(serviceName),
+    m_sourceName(sourceName),
+    m_actions(actions),
+    m_stateVariables(stateVariables)
+{}
+
+QString Generator::header() const
+{
+    auto guard = QString("FRITZMON_%1_%2_HPP").arg(OUTPUT_NAMESPACE).arg(m_serviceName).toUpper();
+    auto text = QString();
+    QTextStream out(&text);
+
+    out << "/* Generated by scpdgen from " << m_sourceName << ", do not edit. */\n"
+        << "\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n"
+        << "\n"
+        << "#include \"upnp/Service.hpp\"\n"
+        << "\n"
+        << "#include <QtCore/QChar>\n"
+        << "#include <QtCore/QString>\n"
+        << "\n"
+        << "#include <functional>\n"
+        << "\n"
+        << "namespace fritzmon {\n"
+        << "namespace " << OUTPUT_NAMESPACE << " {\n"
+        << "\n"
+        << "class " << m_serviceName << "\n"
+        << "{\n"
+        << "public:\n";
+    for (const auto &action : m_actions) {
+        out << "    struct " << action.name() << "Response\n"
+            << "    {\n";
+        for (const auto &argument : action.arguments())
+            if (argument.direction() == Argument::Direction::Out) {
+                auto type = argumentType(argument);
+
+                out << "        " << cppType(type) << " " << fieldName(argument.name())
+                    << initializer(type) << ";\n";
+            }
+        out << "    };\n"
+            << "    using " << action.name() << "Callback = std::function<void(const "
+            << action.name() << "Response &response)>;\n"
+            << "\n";
+    }
+    out << "    explicit " << m_serviceName << "(upnp::Service *service);\n"
+        << "\n"
+        << "    upnp::Service *service() const;\n"
+        << "\n";
+    for (const auto &action : m_actions)
+        out << "    upnp::Service::InvokeActionResult " << fieldName(action.name()) << "("
+            << parameterList(action, true) << ");\n";
+    out << "\n"
+        << "private:\n"
+        << "    upnp::Service *m_service;\n";
+    // resolved on the first invocation after the service description has been loaded
+    for (const auto &action : m_actions)
+        out << "    upnp::Service::ActionHandle " << handleName(action) << ";\n";
+    out << "};\n"
+        << "\n"
+        << "} // namespace " << OUTPUT_NAMESPACE << "\n"
+        << "} // namespace fritzmon\n"
+        << "\n"
+        << "#endif // " << guard << "\n";
+    out.flush();
+
+    return text;
+}
+
+QString Generator::source() const
+{
+    auto text = QString();
+    QTextStream out(&text);
+
+    out << "/* Generated by scpdgen from " << m_sourceName << ", do not edit. */\n"
+        << "\n"
+        << "#include \"" << m_serviceName << ".hpp\"\n"
+        << "\n"
+        << "#include \"upnp/ActionDecoder.hpp\"\n"
+        << "\n"
+        << "#include <QtCore/QLatin1String>\n"
+        << "#include <QtCore/QStringList>\n"
+        << "\n"
+        << "#include <memory>\n"
+        << "\n"
+        << "namespace fritzmon {\n"
+        << "namespace " << OUTPUT_NAMESPACE << " {\n"
+        << "\n"
+        << "namespace {\n";
+    for (const auto &action : m_actions) {
+        auto decoderName = action.name() + "Decoder";
+        auto hasOutputs = false;
+
+        out << "\n"
+            << "class " << decoderName << " : public upnp::ActionDecoder\n"
+            << "{\n"
+            << "public:\n"
+            << "    bool decodeArgument(const QString &name, const QString &value) override\n"
+            << "    {\n"
+            << "        auto ok = true;\n"
+            << "\n";
+        for (const auto &argument : action.arguments()) {
+            if (argument.direction() != Argument::Direction::Out)
+                continue;
+            out << "        " << (hasOutputs ? "else if" : "if") << " (name == QLatin1String(\""
+                << argument.name() << "\"))\n"
+                << "            response." << fieldName(argument.name()) << " = "
+                << decodeExpression(argumentType(argument)) << ";\n";
+            hasOutputs = true;
+        }
+        if (hasOutputs)
+            out << "        else\n"
+                << "            return false;\n";
+        else
+            out << "        Q_UNUSED(name);\n"
+                << "        Q_UNUSED(value);\n"
+                << "        ok = false;\n";
+        out << "\n"
+            << "        return ok;\n"
+            << "    }\n"
+            << "\n"
+            << "    " << m_serviceName << "::" << action.name() << "Response response;\n"
+            << "};\n";
+    }
+    out << "\n"
+        << "} // namespace\n"
+        << "\n"
+        << m_serviceName << "::" << m_serviceName << "(upnp::Service *service)\n"
+        << "  : m_service(service)";
+    for (const auto &action : m_actions)
+        out << ",\n"
+            << "    " << handleName(action) << "()";
+    out << "\n"
+        << "{}\n"
+        << "\n"
+        << "upnp::Service *" << m_serviceName << "::service() const\n"
+        << "{\n"
+        << "    return m_service;\n"
+        << "}\n";
+    for (const auto &action : m_actions) {
+        auto arguments = QString("QStringList()");
+
+        for (const auto &argument : action.arguments())
+            if (argument.direction() == Argument::Direction::In)
+                arguments += " << " + encodeExpression(argumentType(argument),
+                                                       fieldName(argument.name()));
+        out << "\n"
+            << "upnp::Service::InvokeActionResult " << m_serviceName << "::"
+            << fieldName(action.name()) << "(" << parameterList(action, false) << ")\n"
+            << "{\n"
+            << "    auto decoder = std::make_shared<" << action.name() << "Decoder>();\n"
+            << "    auto arguments = " << arguments << ";\n"
+            << "    auto callback = [decoder, finished](const QVariantMap &, const QVariant &) {\n"
+            << "        if (finished)\n"
+            << "            finished(decoder->response);\n"
+            << "    };\n"
+            << "\n"
+            << "    if (!" << handleName(action) << ".isValid())\n"
+            << "        " << handleName(action) << " = m_service->resolveAction(QStringLiteral(\""
+            << action.name() << "\"));\n"
+            << "    // before the description is loaded, the service looks up the name itself\n"
+            << "    if (!" << handleName(action) << ".isValid())\n"
+            << "        return m_service->invokeAction(QStringLiteral(\"" << action.name()
+            << "\"), arguments, decoder,\n"
+            << "                                       callback, failed);\n"
+            << "\n"
+            << "    return m_service->invokeAction(" << handleName(action)
+            << ", arguments, decoder, callback, failed);\n"
+            << "}\n";
+    }
+    out << "\n"
+        << "} // namespace " << OUTPUT_NAMESPACE << "\n"
+        << "} // namespace fritzmon\n";
+    out.flush();
+
+    return text;
+}
+
+StateVariable::Type Generator::argumentType(const Argument &argument) const
+{
+    auto variable = std::find_if(std::cbegin(m_stateVariables), std::cend(m_stateVariables),
+                                 [&argument](const StateVariable &candidate) {
+        return candidate.name() == argument.stateVariable();
+    });
+
+    if (variable == std::cend(m_stateVariables)) {
+        qWarning() << "scpdgen: unknown state variable" << argument.stateVariable()
+                   << "of argument" << argument.name() << ", using string";
+
+        return StateVariable::Type::String;
+    }
+
+    return variable->type();
+}
+
+QString Generator::parameterList(const Action &action, bool declaration) const
+{
+    auto parameters = QStringList();
+
+    for (const auto &argument : action.arguments())
+        if (argument.direction() == Argument::Direction::In) {
+            auto type = argumentType(argument);
+
+            if (isPassedByReference(type))
+                parameters << QString("const %1 &%2").arg(cppType(type))
+                                                     .arg(fieldName(argument.name()));
+            else
+                parameters << QString("%1 %2").arg(cppType(type)).arg(fieldName(argument.name()));
+        }
+    parameters << QString("const %1Callback &finished").arg(action.name());
+    // the failure is reported to ``failed`` as well, as the stub does not pass the invocation id
+    parameters << QString("const upnp::Service::FailureCallback &failed%1")
+                  .arg(declaration ? "=upnp::Service::FailureCallback()" : "");
+
+    return parameters.join(", ");
+}
+
+// only touches the file if the content changed, so dependent objects are not rebuilt needlessly
+static bool writeFile(const QString &path, const QString &text)
+{
+    auto data = text.toUtf8();
+    QFile file(path);
+
+    if (file.open(QIODevice::ReadOnly) && (file.readAll() == data))
+        return true;
+    file.close();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "scpdgen: failed to open" << path << ":" << file.errorString();
+
+        return false;
+    }
+
+    return file.write(data) == data.size();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    auto arguments = app.arguments();
+
+    if (arguments.size() != 4) {
+        qWarning() << USAGE;
+
+        return 2;
+    }
+
+    auto inputPath = arguments.at(1);
+    auto outputDirectory = QDir(arguments.at(2));
+    auto serviceName = arguments.at(3);
+    QFile input(inputPath);
+
+    if (!input.open(QIODevice::ReadOnly)) {
+        qWarning() << "scpdgen: failed to open" << inputPath << ":" << input.errorString();
+
+        return 1;
+    }
+
+    auto actions = std::vector<Action>();
+    auto stateVariables = std::vector<StateVariable>();
+    internal::ServiceDescriptionParser parser(actions, stateVariables);
+
+    parser.addData(input.readAll());
+    if (!parser.finish()) {
+        qWarning() << "scpdgen: invalid service description" << inputPath;
+
+        return 1;
+    }
+    if (!outputDirectory.mkpath(".")) {
+        qWarning() << "scpdgen: failed to create" << outputDirectory.path();
+
+        return 1;
+    }
+
+    Generator generator(serviceName, QFileInfo(inputPath).fileName(), actions, stateVariables);
+
+    if (!writeFile(outputDirectory.filePath(serviceName + ".hpp"), generator.header())
+            || !writeFile(outputDirectory.filePath(serviceName + ".cpp"), generator.source()))
+        return 1;
+
+    return 0;
+}